@@ -17,6 +17,9 @@
 enum avb_stream_format_t
 {
   AVB_FORMAT_MBLA_24BIT, /*!< 24bit MBLA */
+  AVB_FORMAT_AAF_INT16,  /*!< 16bit PCM in IEEE 1722 AAF, requires AVB_1722_FORMAT_AAF */
+  AVB_FORMAT_AAF_INT24,  /*!< 24bit PCM in IEEE 1722 AAF, requires AVB_1722_FORMAT_AAF */
+  AVB_FORMAT_AAF_INT32,  /*!< 32bit PCM in IEEE 1722 AAF, requires AVB_1722_FORMAT_AAF */
 };
 
 
@@ -59,6 +62,26 @@ enum device_media_clock_commands_t
   DEVICE_MEDIA_CLOCK_SET_SAMPLING_RATE /*!< A command to indicate a change in nominal sampling rate */
 };
 
+/** The servo that recovers a stream derived media clock */
+enum media_clock_servo_type_t
+{
+  MEDIA_CLOCK_SERVO_PI,            /*!< A fixed gain loop on the presentation time error, tuned for the CS2100-CP PLL */
+  MEDIA_CLOCK_SERVO_ACQUIRE_TRACK  /*!< Frequency only acquisition, then phase and frequency tracking */
+};
+
+/** The parameters of a media clock recovery servo. Gains are the fraction
+ *  of the measured error corrected by each update, in 1/65536ths.
+ */
+typedef struct media_clock_servo_t {
+  enum media_clock_servo_type_t type; ///< The servo to use
+  int acquire_gain;         ///< The frequency gain while acquiring
+  int track_freq_gain;      ///< The frequency gain while tracking
+  int track_phase_gain;     ///< The phase gain while tracking
+  int error_filter_shift;   ///< The presentation time error is low pass filtered with a coefficient of 2^-shift, 0 for no filter
+  int track_threshold_ns;   ///< Acquisition hands over to tracking once the error changes by less than this between updates
+  int track_count;          ///< The number of updates in a row that must be under the threshold
+} media_clock_servo_t;
+
 typedef struct media_clock_info_t {
   int active;
   enum device_media_clock_type_t clock_type;  ///< The type of the clock
@@ -68,6 +91,7 @@ typedef struct media_clock_info_t {
   int rate;                 ///<  The rate of the media clock in Hz
   int lock_counter;         ///< A count of the number of lock events on this media clock
   int unlock_counter;       ///< A count of the number of unlock events on this media clock
+  media_clock_servo_t servo; ///< The servo used if the clock is derived from a fifo
 } media_clock_info_t;
 
 /** Struct containing fields required for SRP reservations */
@@ -116,7 +140,28 @@ typedef struct avb_sink_info_t
 
 struct avb_debug_counters {
   unsigned sent_1722;
+  unsigned input_frame_overruns;   /**< Audio input frames dropped because a talker had not read the frames before them */
   unsigned received_1722;
+  unsigned format_mismatch_1722; /**< 61883-6 packets whose DBC disagreed with the locked stream format */
+  unsigned format_relock_1722;   /**< Times a listener stream format was inferred again after disagreeing */
+  unsigned output_fifo_overflows;  /**< Samples dropped because a media output FIFO of an active listener stream was full, over all FIFOs */
+  unsigned output_fifo_underflows; /**< Samples played out while a media output FIFO of an active listener stream was empty, over all FIFOs */
+  unsigned mrp_attrs_in_use;       /**< MRP attributes currently allocated, of MRP_MAX_ATTRS */
+  unsigned mrp_attrs_high_water;   /**< The most MRP attributes that have been allocated at once */
+  unsigned mrp_attr_exhausted;     /**< MRP attributes, such as received registrations, dropped because none was free */
+};
+
+/** Transmit launch statistics of an AVB source.
+ *
+ *  The talker launches each packet of a stream when it is complete, but no
+ *  sooner than one packet period after the previous launch. The jitter is
+ *  the delay, in 10ns timer ticks, between that launch time and the send.
+ */
+struct avb_source_launch_stats {
+  unsigned launches;      /**< Packets sent at or after their launch time */
+  unsigned forced;        /**< Packets sent early because the stream's transmit buffers were full */
+  unsigned jitter_max;    /**< The largest launch delay */
+  unsigned jitter_total;  /**< The sum of the launch delays, for the mean */
 };
 
 
@@ -137,6 +182,8 @@ interface avb_interface {
   void _set_media_clock_info(unsigned clock_num, media_clock_info_t info);
   /** Intended for internal use within client interface extension only */
   struct avb_debug_counters _get_debug_counters(void);
+  /** Intended for internal use within client interface extension only */
+  struct avb_source_launch_stats _get_source_launch_stats(unsigned source_num);
 };
 
 interface media_clock_if {
@@ -1014,6 +1061,47 @@ extends client interface avb_interface : {
     return 1;
   }
 
+  /** Get the recovery servo of a media clock.
+   *
+   *  \param i          interface to AVB manager
+   *  \param clock_num the number of the media clock
+   *  \param servo     the servo type and parameters
+   */
+  static inline int get_device_media_clock_servo(client interface avb_interface i,
+                                   int clock_num,
+                                   media_clock_servo_t &servo)
+  {
+    if (clock_num >= AVB_NUM_MEDIA_CLOCKS)
+      return 0;
+    media_clock_info_t info;
+    info = i._get_media_clock_info(clock_num);
+    servo = info.servo;
+    return 1;
+  }
+
+  /** Set the recovery servo of a media clock.
+   *
+   *  Takes effect from the next clock recovery update. The servo returns
+   *  to acquisition when it is changed.
+   *
+   *  \param i          interface to AVB manager
+   *  \param clock_num the number of the media clock
+   *  \param servo     the servo type and parameters
+   *
+   **/
+  static inline int set_device_media_clock_servo(client interface avb_interface i,
+                                   int clock_num,
+                                   media_clock_servo_t servo)
+  {
+    if (clock_num >= AVB_NUM_MEDIA_CLOCKS)
+      return 0;
+    media_clock_info_t info;
+    info = i._get_media_clock_info(clock_num);
+    info.servo = servo;
+    i._set_media_clock_info(clock_num, info);
+    return 1;
+  }
+
   /** Read back debug counters
     *
     * \param i          interface to AVB manager
@@ -1024,6 +1112,23 @@ extends client interface avb_interface : {
   {
     return i._get_debug_counters();
   }
+
+  /** Read back the transmit launch statistics of an AVB source
+    *
+    * \param i          interface to AVB manager
+    * \param source_num the local source number
+    * \param stats      the statistics of the source
+    * \return 1 if the source number is valid
+    *
+    **/
+  static inline int get_source_launch_stats(client interface avb_interface i, unsigned source_num,
+                                            struct avb_source_launch_stats &stats)
+  {
+    if (source_num >= AVB_NUM_SOURCES)
+      return 0;
+    stats = i._get_source_launch_stats(source_num);
+    return 1;
+  }
 }
 
 /** An interface used to register and deregister stream reservations via MSRP */
@@ -1054,6 +1159,10 @@ interface srp_interface {
    *  \param stream_id two int array containing the Stream ID of the stream to deregister
    */
   void deregister_attach_request(unsigned stream_id[2]);
+
+  /** Intended for internal use within avb_manager only. Returns the MRP
+   *  attribute pool counters of avb_debug_counters, with the rest zero. */
+  struct avb_debug_counters _get_debug_counters(void);
 };
 
 
@@ -57,6 +57,39 @@ struct ptp_time_info_mod64 {
  **/
 typedef struct ptp_time_info_mod64 ptp_time_info_mod64;
 
+/** The type of a record captured by the PTP server */
+enum ptp_capture_type {
+  PTP_CAPTURE_SYNC,  /*!< A Sync and its Follow_Up */
+  PTP_CAPTURE_PDELAY /*!< A Pdelay_Req, Pdelay_Resp and Pdelay_Resp_Follow_Up
+                          exchange */
+};
+
+/** A record of the timestamps of one Sync or Pdelay exchange and of what
+ *  the PTP server made of them. It can be retrieved from the PTP server
+ *  using the ptp_get_capture() function.
+ *
+ *  For a Sync local_ts[0] is the ingress time of the Sync and master_ts[0]
+ *  the precise origin timestamp of its Follow_Up with the correction field
+ *  added. For a Pdelay exchange local_ts[0] and local_ts[1] are the egress
+ *  time of the request and the ingress time of the response (t1 and t4),
+ *  and master_ts[0] and master_ts[1] the peer's ingress time of the request
+ *  and egress time of the response (t2 and t3).
+ **/
+typedef struct ptp_capture_record_t {
+  unsigned int index;        /*!< The number of records captured before
+                                  this one */
+  unsigned char type;        /*!< A ptp_capture_type */
+  unsigned char port;        /*!< The port the messages were received on */
+  unsigned short seq_id;     /*!< The messages' sequence ID */
+  int discarded;             /*!< 1 if the servo or path delay filter
+                                  discarded the measurement as an outlier */
+  unsigned int local_ts[2];  /*!< Local timestamps */
+  ptp_timestamp master_ts[2]; /*!< Timestamps of the master or peer */
+  int ptp_adjust;            /*!< The adjust after the measurement */
+  unsigned int pdelay;       /*!< The port's path delay in nanoseconds after
+                                  the measurement */
+} ptp_capture_record_t;
+
 /** The type of a PTP server. Can be passed into the ptp_server() function.
  **/
 enum ptp_server_type {
@@ -108,6 +141,43 @@ void ptp_get_time_info(chanend ptp_server,
 void ptp_get_time_info_mod64(NULLABLE_RESOURCE(chanend,ptp_server),
                               REFERENCE_PARAM(ptp_time_info_mod64, info));
 
+/** Retrieve time information without a request to the PTP server
+ *
+ *  The PTP server publishes its time information to shared memory whenever
+ *  it changes. A client on the same tile as the server can read the latest
+ *  information at any time with this function and without the server's
+ *  involvement. On other tiles nothing is published and the time
+ *  information has to be requested over a channel.
+ *
+ *  \param info       structure to be filled with time information
+ *
+ *  \returns          1 if info was filled, 0 if the PTP server does not
+ *                    run on this tile or has not started yet
+ **/
+int ptp_get_time_snapshot_mod64(REFERENCE_PARAM(ptp_time_info_mod64, info));
+
+/** Read the Sync and Pdelay exchanges captured by the PTP server
+ *
+ *  The PTP server keeps the timestamps of its last PTP_CAPTURE_RECORDS
+ *  Sync and Pdelay exchanges in a ring. This function copies records from
+ *  the ring, oldest first, starting from record number ``next`` or from
+ *  the oldest record still in the ring if that has been overwritten.
+ *  Passing the updated ``next`` to the following call reads the records
+ *  captured since.
+ *
+ *  \param ptp_server chanend connected to the ptp_server
+ *  \param next       the number of the first record wanted, updated to
+ *                    the number of the record after the last one copied
+ *  \param records    array to be filled with the records
+ *  \param n          the size of records
+ *
+ *  \returns          the number of records copied
+ **/
+unsigned ptp_get_capture(chanend ptp_server,
+                         REFERENCE_PARAM(unsigned, next),
+                         ptp_capture_record_t records[],
+                         unsigned n);
+
 // Asynchronous PTP client functions
 // --------------------------------
 
@@ -0,0 +1,146 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include <xclib.h>
+#include "avb.h"
+#include "avb_1722_def.h"
+#include "avb_1722_aaf.h"
+#include "avb_1722_format.h"
+
+int avb1722_aaf_nsr_from_rate(int rate)
+{
+  int f = avb1722_format_from_rate(rate);
+  return f < 0 ? AVB1722_AAF_NSR_USER : avb1722_formats[f].aaf_nsr;
+}
+
+int avb1722_aaf_rate_from_nsr(int nsr)
+{
+  int f = avb1722_format_from_aaf_nsr(nsr);
+  return f < 0 ? 0 : avb1722_formats[f].rate;
+}
+
+int avb1722_aaf_samples_per_frame(int rate)
+{
+  return (rate + AVB1722_PACKET_RATE - 1) / AVB1722_PACKET_RATE;
+}
+
+int avb1722_aaf_format_from_stream_format(int stream_format)
+{
+  switch (stream_format)
+  {
+    case AVB_FORMAT_AAF_INT16: return AVB1722_AAF_FORMAT_INT16;
+    case AVB_FORMAT_AAF_INT24: return AVB1722_AAF_FORMAT_INT24;
+    case AVB_FORMAT_AAF_INT32: return AVB1722_AAF_FORMAT_INT32;
+    default:                   return 0;
+  }
+}
+
+int avb1722_aaf_stream_format_from_format(int aaf_format)
+{
+  switch (aaf_format)
+  {
+    case AVB1722_AAF_FORMAT_INT16: return AVB_FORMAT_AAF_INT16;
+    case AVB1722_AAF_FORMAT_INT24: return AVB_FORMAT_AAF_INT24;
+    case AVB1722_AAF_FORMAT_INT32: return AVB_FORMAT_AAF_INT32;
+    default:                       return -1;
+  }
+}
+
+void avb1722_aaf_get_stream_format(unsigned char stream_format[8],
+                                   int aaf_format,
+                                   int rate,
+                                   int channels)
+{
+  int samples_per_frame = avb1722_aaf_samples_per_frame(rate);
+
+  stream_format[0] = AVB1722_AAF_SUBTYPE; // vendor_defined[0], subtype[1:7]
+  stream_format[1] = avb1722_aaf_nsr_from_rate(rate); // reserved[0], ut[1], reserved[2:3], nsr[4:7]
+  stream_format[2] = aaf_format;
+  stream_format[3] = AVB1722_AAF_SAMPLE_SIZE(aaf_format) * 8; // bit_depth
+  stream_format[4] = channels >> 2; // channels_per_frame[0:9]
+  stream_format[5] = ((channels & 0x3) << 6) | ((samples_per_frame >> 4) & 0x3F); // samples_per_frame[10:19]
+  stream_format[6] = (samples_per_frame & 0xF) << 4; // reserved[20:31]
+  stream_format[7] = 0;
+}
+
+int avb1722_aaf_parse_stream_format(const unsigned char stream_format[8],
+                                    int *aaf_format,
+                                    int *rate,
+                                    int *channels)
+{
+  if (stream_format[0] != AVB1722_AAF_SUBTYPE) {
+    return 0;
+  }
+
+  *aaf_format = stream_format[2];
+  *rate = avb1722_aaf_rate_from_nsr(stream_format[1] & 0xF);
+  *channels = (stream_format[4] << 2) | (stream_format[5] >> 6);
+
+  if (AVB1722_AAF_SAMPLE_SIZE(*aaf_format) == 0 || *rate == 0 || *channels == 0) {
+    return 0;
+  }
+
+  return 1;
+}
+
+void avb1722_aaf_pack(unsigned char dest[],
+                      const unsigned int samples[],
+                      const unsigned int map[],
+                      int num_channels,
+                      int sample_size)
+{
+  switch (sample_size)
+  {
+    case 4:
+      // Frames of 32 bit samples stay word aligned in the payload
+      for (int i = 0; i < num_channels; i++) {
+        ((unsigned int *) dest)[i] = byterev(samples[map[i]]);
+      }
+      break;
+    case 3:
+      for (int i = 0; i < num_channels; i++) {
+        unsigned sample = samples[map[i]];
+        dest[0] = sample >> 24;
+        dest[1] = sample >> 16;
+        dest[2] = sample >> 8;
+        dest += 3;
+      }
+      break;
+    case 2:
+      for (int i = 0; i < num_channels; i++) {
+        unsigned sample = samples[map[i]];
+        dest[0] = sample >> 24;
+        dest[1] = sample >> 16;
+        dest += 2;
+      }
+      break;
+  }
+}
+
+void avb1722_aaf_unpack(unsigned int dest[],
+                        const unsigned char src[],
+                        int stride,
+                        int n,
+                        int sample_size)
+{
+  switch (sample_size)
+  {
+    case 4:
+      for (int i = 0; i < n; i++) {
+        dest[i] = ((unsigned) src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
+        src += stride;
+      }
+      break;
+    case 3:
+      for (int i = 0; i < n; i++) {
+        dest[i] = ((unsigned) src[0] << 24) | (src[1] << 16) | (src[2] << 8);
+        src += stride;
+      }
+      break;
+    case 2:
+      for (int i = 0; i < n; i++) {
+        dest[i] = ((unsigned) src[0] << 24) | (src[1] << 16);
+        src += stride;
+      }
+      break;
+  }
+}
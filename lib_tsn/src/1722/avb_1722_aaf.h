@@ -0,0 +1,146 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file avb_1722_aaf.h
+ * \brief IEEE 1722-2016 AVTP Audio Format (AAF) definitions
+ *
+ * AAF carries interleaved big endian PCM directly after the AVTP stream
+ * header, without a CIP header or per-sample labels. The format specific
+ * fields share the layout of the common stream data header:
+ *
+ *   gateway_info[0]      format
+ *   gateway_info[1..2]   nsr (4 bits), reserved (2 bits), channels_per_frame (10 bits)
+ *   gateway_info[3]      bit_depth
+ *   packet_data_length   stream_data_length
+ *   protocol_specific[0] reserved (3 bits), sp (1 bit), evt (4 bits)
+ */
+
+#ifndef __AVB_1722_AAF_H__
+#define __AVB_1722_AAF_H__
+
+#include <xccompat.h>
+#include "avb_1722_common.h"
+
+#define AVB1722_AAF_SUBTYPE                (0x02)
+
+// AAF format field
+#define AVB1722_AAF_FORMAT_USER            (0x00)
+#define AVB1722_AAF_FORMAT_FLOAT32         (0x01)
+#define AVB1722_AAF_FORMAT_INT32           (0x02)
+#define AVB1722_AAF_FORMAT_INT24           (0x03)
+#define AVB1722_AAF_FORMAT_INT16           (0x04)
+
+// AAF nominal sample rate (nsr) field
+#define AVB1722_AAF_NSR_USER               (0x0)
+#define AVB1722_AAF_NSR_8KHZ               (0x1)
+#define AVB1722_AAF_NSR_16KHZ              (0x2)
+#define AVB1722_AAF_NSR_32KHZ              (0x3)
+#define AVB1722_AAF_NSR_44_1KHZ            (0x4)
+#define AVB1722_AAF_NSR_48KHZ              (0x5)
+#define AVB1722_AAF_NSR_88_2KHZ            (0x6)
+#define AVB1722_AAF_NSR_96KHZ              (0x7)
+#define AVB1722_AAF_NSR_176_4KHZ           (0x8)
+#define AVB1722_AAF_NSR_192KHZ             (0x9)
+#define AVB1722_AAF_NSR_24KHZ              (0xA)
+
+/** The number of bytes per sample of an integer AAF format, 0 if unsupported */
+#define AVB1722_AAF_SAMPLE_SIZE(format) \
+  ((format) == AVB1722_AAF_FORMAT_INT32 ? 4 : \
+   (format) == AVB1722_AAF_FORMAT_INT24 ? 3 : \
+   (format) == AVB1722_AAF_FORMAT_INT16 ? 2 : 0)
+
+//
+// Macros for the AAF header. "x" is a pointer to an AVB_DataHeader_t.
+//
+#define AVB1722_AAF_FORMAT(x)                  ((x)->gateway_info[0])
+#define AVB1722_AAF_NSR(x)                     ((x)->gateway_info[1] >> 4)
+#define AVB1722_AAF_CHANNELS_PER_FRAME(x)      ((((x)->gateway_info[1] & 0x3) << 8) | (x)->gateway_info[2])
+#define AVB1722_AAF_BIT_DEPTH(x)               ((x)->gateway_info[3])
+#define AVB1722_AAF_SP(x)                      (((x)->protocol_specific[0] >> 4) & 0x1)
+
+#define SET_AVB1722_AAF_FORMAT(x, a)           ((x)->gateway_info[0] = (a))
+#define SET_AVB1722_AAF_NSR_CHANNELS(x, n, c)  do { (x)->gateway_info[1] = (((n) & 0xF) << 4) | (((c) >> 8) & 0x3); \
+                                                    (x)->gateway_info[2] = (c) & 0xFF; } while (0)
+#define SET_AVB1722_AAF_BIT_DEPTH(x, a)        ((x)->gateway_info[3] = (a))
+
+/** The eight byte IEEE 1722.1 stream_format for an AAF PCM stream, as a list
+ *  of bytes for use in AEM descriptor initialisers.
+ */
+#define AVB1722_1_AAF_STREAM_FORMAT(nsr, format, bit_depth, channels, samples_per_frame) \
+  AVB1722_AAF_SUBTYPE, (nsr), (format), (bit_depth), \
+  (unsigned char)((channels) >> 2), \
+  (unsigned char)((((channels) & 0x3) << 6) | (((samples_per_frame) >> 4) & 0x3F)), \
+  (unsigned char)(((samples_per_frame) & 0xF) << 4), \
+  0
+
+/** Map a sample rate in Hz to an AAF nsr code, 0 if there is no code for it */
+int avb1722_aaf_nsr_from_rate(int rate);
+
+/** Map an AAF nsr code to a sample rate in Hz, 0 if the code is not known */
+int avb1722_aaf_rate_from_nsr(int nsr);
+
+/** The number of samples per channel in each AAF packet of a stream.
+ *
+ *  AAF packets carry a constant number of samples, so rates that are not a
+ *  multiple of ``AVB1722_PACKET_RATE`` round up and send slightly fewer
+ *  packets per second.
+ */
+int avb1722_aaf_samples_per_frame(int rate);
+
+/** Map an ``avb_stream_format_t`` to its AAF format code, 0 for non-AAF formats */
+int avb1722_aaf_format_from_stream_format(int stream_format);
+
+/** Map an AAF format code to an ``avb_stream_format_t``, -1 if unsupported */
+int avb1722_aaf_stream_format_from_format(int aaf_format);
+
+/** Fill in an IEEE 1722.1 stream_format field for an AAF stream */
+void avb1722_aaf_get_stream_format(unsigned char stream_format[8],
+                                   int aaf_format,
+                                   int rate,
+                                   int channels);
+
+/** Parse an IEEE 1722.1 stream_format field.
+ *
+ *  \returns 1 if the field describes a supported AAF stream, otherwise 0
+ */
+int avb1722_aaf_parse_stream_format(const unsigned char stream_format[8],
+                                    REFERENCE_PARAM(int, aaf_format),
+                                    REFERENCE_PARAM(int, rate),
+                                    REFERENCE_PARAM(int, channels));
+
+/** Interleave one frame of samples into an AAF payload.
+ *
+ *  Writes ``num_channels`` big endian samples of ``sample_size`` bytes,
+ *  taking the sample for channel ``i`` from the top bits of the left
+ *  justified ``samples[map[i]]``.
+ *
+ *  \param dest         the payload position of the first channel of the frame
+ *  \param samples      the frame of PCM samples
+ *  \param map          the sample index for each channel of the stream
+ *  \param num_channels the number of channels in the stream
+ *  \param sample_size  2, 3 or 4 bytes per sample
+ */
+void avb1722_aaf_pack(unsigned char dest[],
+                      const unsigned int samples[],
+                      const unsigned int map[],
+                      int num_channels,
+                      int sample_size);
+
+/** De-interleave one channel of an AAF payload.
+ *
+ *  Reads ``n`` samples of ``sample_size`` bytes from ``src``, ``stride``
+ *  bytes apart, and writes them as left justified PCM samples to ``dest``.
+ *  The payload does not need to be word aligned.
+ *
+ *  \param dest         destination for the PCM samples
+ *  \param src          the first sample of the channel in the payload
+ *  \param stride       the number of bytes between successive samples
+ *  \param n            the number of samples to convert
+ *  \param sample_size  2, 3 or 4 bytes per sample
+ */
+void avb1722_aaf_unpack(unsigned int dest[],
+                        const unsigned char src[],
+                        int stride,
+                        int n,
+                        int sample_size);
+
+#endif
@@ -0,0 +1,113 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include <xclib.h>
+#include "avb_1722_am824.h"
+
+void avb1722_am824_pack_ref(unsigned int dest[],
+                            const unsigned int samples[],
+                            const unsigned int map[],
+                            int num_channels,
+                            unsigned int label)
+{
+  for (int i = 0; i < num_channels; i++) {
+    unsigned sample = (samples[map[i]] >> 8) | label;
+    sample = byterev(sample);
+    dest[i] = sample;
+  }
+}
+
+void avb1722_am824_unpack_ref(unsigned int dest[],
+                              const unsigned int src[],
+                              int stride,
+                              int n)
+{
+  for (int i = 0; i < n; i++) {
+    unsigned sample = src[i * stride];
+    sample = byterev(sample);
+    dest[i] = sample << 8;
+  }
+}
+
+// Fixed channel count variants: the loop bound is a constant so the compiler
+// can fully unroll the gather and keep the label in a register
+#define AM824_PACK_FIXED(N) \
+static inline void am824_pack_##N(unsigned int dest[], \
+                                  const unsigned int samples[], \
+                                  const unsigned int map[], \
+                                  unsigned int label) \
+{ \
+  for (int i = 0; i < N; i++) { \
+    dest[i] = AVB1722_AM824_ENCODE(samples[map[i]], label); \
+  } \
+}
+
+AM824_PACK_FIXED(2)
+AM824_PACK_FIXED(8)
+AM824_PACK_FIXED(16)
+AM824_PACK_FIXED(32)
+
+static inline void am824_pack_unrolled(unsigned int dest[],
+                                       const unsigned int samples[],
+                                       const unsigned int map[],
+                                       int num_channels,
+                                       unsigned int label)
+{
+  int i = 0;
+
+  // Issue the four loads before the stores so they are not serialised
+  // behind each byterev
+  for (; i + 4 <= num_channels; i += 4) {
+    unsigned s0 = samples[map[i]];
+    unsigned s1 = samples[map[i+1]];
+    unsigned s2 = samples[map[i+2]];
+    unsigned s3 = samples[map[i+3]];
+    dest[i]   = AVB1722_AM824_ENCODE(s0, label);
+    dest[i+1] = AVB1722_AM824_ENCODE(s1, label);
+    dest[i+2] = AVB1722_AM824_ENCODE(s2, label);
+    dest[i+3] = AVB1722_AM824_ENCODE(s3, label);
+  }
+
+  for (; i < num_channels; i++) {
+    dest[i] = AVB1722_AM824_ENCODE(samples[map[i]], label);
+  }
+}
+
+void avb1722_am824_pack(unsigned int dest[],
+                        const unsigned int samples[],
+                        const unsigned int map[],
+                        int num_channels,
+                        unsigned int label)
+{
+  switch (num_channels) {
+  case 2:  am824_pack_2(dest, samples, map, label); break;
+  case 8:  am824_pack_8(dest, samples, map, label); break;
+  case 16: am824_pack_16(dest, samples, map, label); break;
+  case 32: am824_pack_32(dest, samples, map, label); break;
+  default: am824_pack_unrolled(dest, samples, map, num_channels, label); break;
+  }
+}
+
+void avb1722_am824_unpack(unsigned int dest[],
+                          const unsigned int src[],
+                          int stride,
+                          int n)
+{
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    unsigned q0 = src[0];
+    unsigned q1 = src[stride];
+    unsigned q2 = src[2*stride];
+    unsigned q3 = src[3*stride];
+    dest[i]   = AVB1722_AM824_DECODE(q0);
+    dest[i+1] = AVB1722_AM824_DECODE(q1);
+    dest[i+2] = AVB1722_AM824_DECODE(q2);
+    dest[i+3] = AVB1722_AM824_DECODE(q3);
+    src += 4*stride;
+  }
+
+  for (; i < n; i++) {
+    dest[i] = AVB1722_AM824_DECODE(*src);
+    src += stride;
+  }
+}
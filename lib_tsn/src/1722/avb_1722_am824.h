@@ -0,0 +1,74 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file avb_1722_am824.h
+ * \brief IEC 61883-6 AM824 sample conversion kernels
+ *
+ * The talker packs 32 bit left justified PCM samples into network order
+ * AM824 quadlets (8 bit label, 24 bit sample) and the listener does the
+ * inverse. These kernels are shared by both so that there is a single
+ * place to tune the per-sample cost.
+ */
+
+#ifndef __AVB_1722_AM824_H__
+#define __AVB_1722_AM824_H__
+
+#include <xccompat.h>
+
+#ifndef __XC__
+#include <xclib.h>
+
+/** Convert one left justified PCM sample into a network order AM824 quadlet */
+#define AVB1722_AM824_ENCODE(sample, label) byterev(((sample) >> 8) | (label))
+
+/** Convert one network order AM824 quadlet into a left justified PCM sample */
+#define AVB1722_AM824_DECODE(quadlet) (byterev(quadlet) << 8)
+#endif
+
+/** Interleave one frame of samples into an AM824 payload.
+ *
+ *  Writes ``num_channels`` consecutive quadlets to ``dest``, taking the
+ *  sample for channel ``i`` from ``samples[map[i]]``. Channel counts of
+ *  2, 8, 16 and 32 use fixed length code paths, other counts use a four
+ *  lane unrolled loop.
+ *
+ *  \param dest         the payload position of the first channel of the frame
+ *  \param samples      the frame of PCM samples
+ *  \param map          the sample index for each channel of the stream
+ *  \param num_channels the number of channels in the stream
+ *  \param label        the AM824 label, e.g. MBLA_24BIT
+ */
+void avb1722_am824_pack(unsigned int dest[],
+                        const unsigned int samples[],
+                        const unsigned int map[],
+                        int num_channels,
+                        unsigned int label);
+
+/** Reference version of avb1722_am824_pack(), one channel at a time */
+void avb1722_am824_pack_ref(unsigned int dest[],
+                            const unsigned int samples[],
+                            const unsigned int map[],
+                            int num_channels,
+                            unsigned int label);
+
+/** De-interleave one channel of an AM824 payload.
+ *
+ *  Reads ``n`` quadlets from ``src``, ``stride`` words apart, and writes
+ *  them as consecutive left justified PCM samples to ``dest``.
+ *
+ *  \param dest   destination for the PCM samples
+ *  \param src    the first quadlet of the channel in the payload
+ *  \param stride the number of words between successive quadlets
+ *  \param n      the number of samples to convert
+ */
+void avb1722_am824_unpack(unsigned int dest[],
+                          const unsigned int src[],
+                          int stride,
+                          int n);
+
+/** Reference version of avb1722_am824_unpack(), one sample at a time */
+void avb1722_am824_unpack_ref(unsigned int dest[],
+                              const unsigned int src[],
+                              int stride,
+                              int n);
+
+#endif
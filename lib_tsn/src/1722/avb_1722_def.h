@@ -118,15 +118,18 @@ enum {
   AVB1722_SET_PORT,
   AVB1722_ADJUST_LISTENER_CHANNEL_MAP,
   AVB1722_ADJUST_LISTENER_VOLUME,
-  AVB1722_GET_COUNTERS
+  AVB1722_GET_COUNTERS,
+  AVB1722_GET_LAUNCH_STATS
 };
 
 // The rate of 1722 packets (8kHz)
 #define AVB1722_PACKET_RATE (8000)
 
-// The number of samples per stream in each 1722 packet
+// The number of samples per stream in each 1722 packet. AAF talkers round
+// rates that are not a multiple of the packet rate up, see
+// avb1722_aaf_samples_per_frame()
 #define AVB1722_LISTENER_MAX_NUM_SAMPLES_PER_CHANNEL ((AVB_MAX_AUDIO_SAMPLE_RATE / AVB1722_PACKET_RATE)+1)
-#define AVB1722_TALKER_MAX_NUM_SAMPLES_PER_CHANNEL (AVB_MAX_AUDIO_SAMPLE_RATE / AVB1722_PACKET_RATE)
+#define AVB1722_TALKER_MAX_NUM_SAMPLES_PER_CHANNEL ((AVB_MAX_AUDIO_SAMPLE_RATE + AVB1722_PACKET_RATE - 1) / AVB1722_PACKET_RATE)
 
 // We add a 2% fudge factor to handle clock difference in the stream transmission shaping
 #define AVB1722_PACKET_PERIOD_TIMER_TICKS (((100000000 / AVB1722_PACKET_RATE)*98)/100)
@@ -0,0 +1,66 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include "avb_1722_format.h"
+#include "avb_1722_aaf.h"
+
+// Samples per channel per packet in 16.16 fixed point
+#define SAMPLES_PER_PACKET(rate, packet_rate) \
+  ((unsigned int) ((((unsigned long long) (rate)) << 16) / (packet_rate)))
+
+#define FORMAT(rate, base_rate, sfc, nsr, syt_interval) \
+  { (rate), (base_rate), (sfc), (nsr), (syt_interval), (syt_interval) - 1, \
+    { SAMPLES_PER_PACKET(rate, AVB1722_CLASS_A_PACKET_RATE), \
+      SAMPLES_PER_PACKET(rate, AVB1722_CLASS_B_PACKET_RATE), \
+      SAMPLES_PER_PACKET(rate, AVB1722_CLASS_C_PACKET_RATE) } }
+
+const avb1722_format_t avb1722_formats[AVB1722_NUM_FORMATS] = {
+  FORMAT(8000,   48000, AVB1722_FORMAT_NO_CODE, AVB1722_AAF_NSR_8KHZ,     1),
+  FORMAT(16000,  48000, AVB1722_FORMAT_NO_CODE, AVB1722_AAF_NSR_16KHZ,    2),
+  FORMAT(24000,  48000, AVB1722_FORMAT_NO_CODE, AVB1722_AAF_NSR_24KHZ,    4),
+  FORMAT(32000,  32000, 0,                      AVB1722_AAF_NSR_32KHZ,    8),
+  FORMAT(44100,  44100, 1,                      AVB1722_AAF_NSR_44_1KHZ,  8),
+  FORMAT(48000,  48000, 2,                      AVB1722_AAF_NSR_48KHZ,    8),
+  FORMAT(88200,  44100, 3,                      AVB1722_AAF_NSR_88_2KHZ,  16),
+  FORMAT(96000,  48000, 4,                      AVB1722_AAF_NSR_96KHZ,    16),
+  FORMAT(176400, 44100, 5,                      AVB1722_AAF_NSR_176_4KHZ, 32),
+  FORMAT(192000, 48000, 6,                      AVB1722_AAF_NSR_192KHZ,   32),
+};
+
+int avb1722_format_from_rate(int rate)
+{
+  for (int i = 0; i < AVB1722_NUM_FORMATS; i++) {
+    if (avb1722_formats[i].rate == rate)
+      return i;
+  }
+  return -1;
+}
+
+int avb1722_format_from_sfc(int sfc)
+{
+  if (sfc == AVB1722_FORMAT_NO_CODE)
+    return -1;
+
+  for (int i = 0; i < AVB1722_NUM_FORMATS; i++) {
+    if (avb1722_formats[i].sfc == sfc)
+      return i;
+  }
+  return -1;
+}
+
+int avb1722_format_from_aaf_nsr(int nsr)
+{
+  for (int i = 0; i < AVB1722_NUM_FORMATS; i++) {
+    if (avb1722_formats[i].aaf_nsr == nsr)
+      return i;
+  }
+  return -1;
+}
+
+int avb1722_format_from_samples_per_packet(int samples, int sr_class)
+{
+  for (int i = 0; i < AVB1722_NUM_FORMATS; i++) {
+    if ((avb1722_formats[i].samples_per_packet[sr_class] >> 16) == samples)
+      return i;
+  }
+  return -1;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file avb_1722_format.h
+ * \brief Sample rate descriptors shared by the 1722 talker, listener,
+ *        1722.1 and media clock code
+ *
+ * Each supported sample rate has one descriptor holding the 61883-6 and AAF
+ * codes for the rate together with the values the packet processing needs,
+ * worked out in advance so that no rate has to be decoded per packet.
+ */
+
+#ifndef __AVB_1722_FORMAT_H__
+#define __AVB_1722_FORMAT_H__
+
+#include <xccompat.h>
+
+/** SRP traffic classes, used to index the per class fields of a descriptor */
+enum avb1722_sr_class_t {
+  AVB1722_SR_CLASS_A,     //!< 125us packet interval
+  AVB1722_SR_CLASS_B,     //!< 250us packet interval
+  AVB1722_SR_CLASS_C,     //!< 1333us packet interval (AVnu automotive profile)
+  AVB1722_NUM_SR_CLASSES
+};
+
+#define AVB1722_CLASS_A_PACKET_RATE (8000)
+#define AVB1722_CLASS_B_PACKET_RATE (4000)
+#define AVB1722_CLASS_C_PACKET_RATE (750)
+
+/** Marks a rate that has no code in a field of the descriptor */
+#define AVB1722_FORMAT_NO_CODE (0xff)
+
+/** The number of sample rate descriptors */
+#define AVB1722_NUM_FORMATS (10)
+
+typedef struct avb1722_format_t {
+  unsigned int rate;            //!< The sample rate in Hz
+  unsigned int base_rate;       //!< 48000, 44100 or 32000, the family of the rate
+  unsigned char sfc;            //!< 61883-6 sampling frequency code, or AVB1722_FORMAT_NO_CODE
+  unsigned char aaf_nsr;        //!< AAF nominal sample rate code
+  unsigned char syt_interval;   //!< 61883-6 SYT_INTERVAL, the data blocks between timestamps
+  unsigned char syt_mask;       //!< syt_interval - 1
+  //! Samples per channel in each packet of each class, in 16.16 fixed point
+  unsigned int samples_per_packet[AVB1722_NUM_SR_CLASSES];
+} avb1722_format_t;
+
+/** The sample rate descriptors, in ascending order of rate */
+extern const avb1722_format_t avb1722_formats[AVB1722_NUM_FORMATS];
+
+/** The descriptor index for a sample rate in Hz, -1 if it is not supported */
+int avb1722_format_from_rate(int rate);
+
+/** The descriptor index for a 61883-6 SFC code, -1 if it is not known */
+int avb1722_format_from_sfc(int sfc);
+
+/** The descriptor index for an AAF nsr code, -1 if it is not known */
+int avb1722_format_from_aaf_nsr(int nsr);
+
+/** The descriptor index for the whole number of samples per channel that
+ *  packets of a stream of the given class carry on average, as inferred by
+ *  a listener, -1 if no rate matches.
+ */
+int avb1722_format_from_samples_per_packet(int samples, int sr_class);
+
+#endif
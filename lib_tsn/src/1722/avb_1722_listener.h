@@ -14,6 +14,7 @@
 #include "avb_1722_def.h"
 #include "gptp.h"
 #include "audio_buffering.h"
+#include "audio_output_fifo.h"
 
 #ifndef MAX_INCOMING_AVB_STREAMS
 #define MAX_INCOMING_AVB_STREAMS (AVB_NUM_SINKS)
@@ -27,18 +28,30 @@
 #define MAX_AVB_STREAMS_PER_LISTENER 4
 #endif
 
+// The number of packets used to infer the format of a 61883-6 stream
+#define AVB_1722_LISTENER_CHAN_LOCK_PACKETS 16
+
+// The number of consecutive packets that must disagree with the format of a
+// locked stream before it is inferred again
+#define AVB_1722_LISTENER_FORMAT_MISMATCH_LIMIT 4
+
 
 typedef struct avb_1722_stream_info_t {
   short active;                    //!< 1-bit flag to say if the stream is active
   short state;                     //!< Generic state info
   int chan_lock;                   //!< Counter for locking onto a data stream
   int rate;                        //!< The estimated rate of the audio traffic
+  int format;                      //!< The avb1722_formats index of rate, -1 until it is known
   int prev_num_samples;            //!< Number of samples in last received 1722 packet
   int num_channels_in_payload;     //!< The number of channels in the 1722 payloads
   int num_channels;
   int dbc;                         //!< The DBC of the last seen packet
   int last_sequence;               //!< The sequence number from the last 1722 packet
+  int format_mismatches;           //!< Consecutive packets that disagreed with the locked format
+  unsigned format_mismatch_count;  //!< Packets that disagreed with the locked format, kept across reconfiguration
+  unsigned format_relock_count;    //!< Times the format was inferred again after disagreeing, kept across reconfiguration
   audio_output_fifo_t map[AVB_MAX_CHANNELS_PER_LISTENER_STREAM];
+  audio_output_fifo_group_t fifos; //!< The mapped channels of map, rebuilt when it changes
 } avb_1722_stream_info_t;
 
 
@@ -62,8 +75,14 @@ int avb_1722_listener_process_packet(chanend buf_ctl,
                                      buffer_handle_t h);
 #endif
 
+/** Totals over every stream and media output FIFO of a listener task, as
+ *  returned for AVB1722_GET_COUNTERS, so each task is asked once */
 struct listener_counters {
   unsigned received_1722;
+  unsigned format_mismatch_1722;
+  unsigned format_relock_1722;
+  unsigned output_fifo_overflows;
+  unsigned output_fifo_underflows;
 };
 
 typedef struct avb_1722_listener_state_s {
@@ -3,6 +3,8 @@
 #include "avb_1722_common.h"
 #include "gptp.h"
 #include "avb_1722_def.h"
+#include "avb_1722_aaf.h"
+#include "avb_1722_format.h"
 #include "audio_output_fifo.h"
 #include <string.h>
 #include <xs1.h>
@@ -16,6 +18,46 @@
 static unsigned char prev_seq_num = 0;
 #endif
 
+#if AVB_1722_FORMAT_AAF
+/** Handle an AAF packet. The stream format is read from each packet header
+ *  so, unlike 61883-6, there is no need to lock on to the stream first.
+ */
+static int avb_1722_listener_process_aaf_packet(chanend buf_ctl,
+                                                AVB_DataHeader_t *pAVBHdr,
+                                                int payload_length,
+                                                avb_1722_stream_info_t *stream_info,
+                                                int *notified_buf_ctl,
+                                                buffer_handle_t h)
+{
+  unsigned char *sample_ptr = (unsigned char *) pAVBHdr + AVB_TP_HDR_SIZE;
+  int stream_data_length = NTOH_U16(pAVBHdr->packet_data_length);
+  int num_channels_in_payload = AVB1722_AAF_CHANNELS_PER_FRAME(pAVBHdr);
+  int sample_size = AVB1722_AAF_SAMPLE_SIZE(AVB1722_AAF_FORMAT(pAVBHdr));
+  int stride;
+
+  if (sample_size == 0 || num_channels_in_payload == 0 ||
+      stream_data_length > payload_length)
+  {
+    return 0;
+  }
+
+  stride = num_channels_in_payload * sample_size;
+
+  stream_info->num_channels_in_payload = num_channels_in_payload;
+  stream_info->format = avb1722_format_from_aaf_nsr(AVB1722_AAF_NSR(pAVBHdr));
+  stream_info->rate = stream_info->format < 0 ? 0 : avb1722_formats[stream_info->format].rate;
+
+  // The AAF timestamp applies to the first sample of the packet
+  audio_output_fifo_group_push(h, &stream_info->fifos,
+                               AVBTP_TV(pAVBHdr) == 1, AVBTP_TIMESTAMP(pAVBHdr), 0,
+                               buf_ctl, notified_buf_ctl,
+                               sample_ptr, num_channels_in_payload,
+                               stream_data_length / stride, sample_size);
+
+  return 1;
+}
+#endif
+
 int avb_1722_listener_process_packet(chanend buf_ctl,
                                      unsigned char Buf[],
                                      int numBytes,
@@ -33,14 +75,11 @@ int avb_1722_listener_process_packet(chanend buf_ctl,
   pAVBHdr = (AVB_DataHeader_t *) &(Buf[avb_ethernet_hdr_size]);
   pAVB1722Hdr = (AVB_AVB1722_CIP_Header_t *) &(Buf[avb_ethernet_hdr_size + AVB_TP_HDR_SIZE]);
   unsigned char *sample_ptr;
-  int i;
-  int num_channels = stream_info->num_channels;
-  audio_output_fifo_t *map = &stream_info->map[0];
-  int stride;
+  unsigned sample_num = 0;
   int dbc_diff;
 
   // sanity check on number bytes in payload
-  if (numBytes <= avb_ethernet_hdr_size + AVB_TP_HDR_SIZE + AVB_CIP_HDR_SIZE)
+  if (numBytes <= avb_ethernet_hdr_size + AVB_TP_HDR_SIZE)
   {
     return (0);
   }
@@ -57,6 +96,20 @@ int avb_1722_listener_process_packet(chanend buf_ctl,
     return (0);
   }
 
+#if AVB_1722_FORMAT_AAF
+  if (AVBTP_SUBTYPE(pAVBHdr) == AVB1722_AAF_SUBTYPE)
+  {
+    return avb_1722_listener_process_aaf_packet(buf_ctl, pAVBHdr,
+                                                numBytes - avb_ethernet_hdr_size - AVB_TP_HDR_SIZE,
+                                                stream_info, notified_buf_ctl, h);
+  }
+#endif
+
+  if (numBytes <= avb_ethernet_hdr_size + AVB_TP_HDR_SIZE + AVB_CIP_HDR_SIZE)
+  {
+    return (0);
+  }
+
 #if AVB_1722_RECORD_ERRORS
   unsigned char seq_num = AVBTP_SEQUENCE_NUMBER(pAVBHdr);
   if ((unsigned char)((unsigned char)seq_num - (unsigned char)prev_seq_num) != 1) {
@@ -79,7 +132,32 @@ int avb_1722_listener_process_packet(chanend buf_ctl,
   int prev_num_samples = stream_info->prev_num_samples;
   stream_info->prev_num_samples = num_samples_in_payload;
 
-  if (stream_info->chan_lock < 16)
+  if (stream_info->chan_lock >= AVB_1722_LISTENER_CHAN_LOCK_PACKETS &&
+      prev_num_samples && dbc_diff)
+  {
+    // Check the locked format against the data blocks of the previous
+    // packet. A lost packet also causes a mismatch, so only infer the format
+    // again if the mismatches persist.
+    if (prev_num_samples != dbc_diff * stream_info->num_channels_in_payload)
+    {
+      stream_info->format_mismatch_count++;
+      if (++stream_info->format_mismatches == AVB_1722_LISTENER_FORMAT_MISMATCH_LIMIT)
+      {
+        stream_info->format_relock_count++;
+        stream_info->format_mismatches = 0;
+        stream_info->num_channels_in_payload = 0;
+        stream_info->chan_lock = 0;
+        stream_info->rate = 0;
+        stream_info->format = -1;
+      }
+    }
+    else
+    {
+      stream_info->format_mismatches = 0;
+    }
+  }
+
+  if (stream_info->chan_lock < AVB_1722_LISTENER_CHAN_LOCK_PACKETS)
   {
     int num_channels;
 
@@ -101,22 +179,12 @@ int avb_1722_listener_process_packet(chanend buf_ctl,
 
     stream_info->chan_lock++;
 
-    if (stream_info->chan_lock == 16)
+    if (stream_info->chan_lock == AVB_1722_LISTENER_CHAN_LOCK_PACKETS)
     {
-      stream_info->rate = (stream_info->rate / stream_info->num_channels_in_payload / 16);
+      int samples_per_packet = stream_info->rate / stream_info->num_channels_in_payload / AVB_1722_LISTENER_CHAN_LOCK_PACKETS;
 
-      switch (stream_info->rate)
-      {
-      case 1: stream_info->rate = 8000; break;
-      case 2: stream_info->rate = 16000; break;
-      case 4: stream_info->rate = 32000; break;
-      case 5: stream_info->rate = 44100; break;
-      case 6: stream_info->rate = 48000; break;
-      case 11: stream_info->rate = 88200; break;
-      case 12: stream_info->rate = 96000; break;
-      case 24: stream_info->rate = 192000; break;
-      default: stream_info->rate = 0; break;
-      }
+      stream_info->format = avb1722_format_from_samples_per_packet(samples_per_packet, AVB1722_SR_CLASS_A);
+      stream_info->rate = stream_info->format < 0 ? 0 : avb1722_formats[stream_info->format].rate;
     }
 
     return 0;
@@ -127,65 +195,28 @@ int avb_1722_listener_process_packet(chanend buf_ctl,
     // See 61883-6 section 6.2 which explains that the receiver can calculate
     // which data block (sample) the timestamp refers to using the formula:
     //   index = (SYT_INTERVAL - dbc % SYT_INTERVAL) % SYT_INTERVAL
+    // which, as SYT_INTERVAL is a power of two, is -dbc & (SYT_INTERVAL - 1)
 
-    unsigned syt_interval = 0, sample_num = 0;
-
-    switch (stream_info->rate)
-    {
-    case 8000:   syt_interval = 1; break;
-    case 16000:  syt_interval = 2; break;
-    case 32000:  syt_interval = 8; break;
-    case 44100:  syt_interval = 8; break;
-    case 48000:  syt_interval = 8; break;
-    case 88200:  syt_interval = 16; break;
-    case 96000:  syt_interval = 16; break;
-    case 176400: syt_interval = 32; break;
-    case 192000: syt_interval = 32; break;
-    default: return 0; break;
-    }
-    sample_num = (syt_interval - (dbc_value & (syt_interval-1))) & (syt_interval-1);
-    // register timestamp
-    for (int i=0; i<num_channels; i++)
-    {
-      if (map[i] >= 0)
-      {
-        audio_output_fifo_set_ptp_timestamp(h, map[i], AVBTP_TIMESTAMP(pAVBHdr), sample_num);
-      }
-    }
-  }
-
-  for (i=0; i<num_channels; i++)
-  {
-    if (map[i] >= 0)
+    if (stream_info->format < 0)
     {
-      audio_output_fifo_maintain(h, map[i], buf_ctl, notified_buf_ctl);
+      return 0;
     }
+    sample_num = -dbc_value & avb1722_formats[stream_info->format].syt_mask;
   }
 
-
-  // now send the samples
+  // register the timestamp, maintain the FIFOs and send the samples
   sample_ptr = (unsigned char *) &Buf[(avb_ethernet_hdr_size +
                                        AVB_TP_HDR_SIZE +
                                        AVB_CIP_HDR_SIZE)];
 
   num_channels_in_payload = stream_info->num_channels_in_payload;
 
-  stride = num_channels_in_payload;
-
-  num_channels =
-    num_channels < num_channels_in_payload ?
-    num_channels :
-    num_channels_in_payload;
-
-  for(i=0; i<num_channels; i++)
-  {
-    if (map[i] >= 0)
-    {
-      audio_output_fifo_strided_push(h, map[i], (unsigned int *) sample_ptr,
-                                   stride, num_samples_in_payload);
-    }
-    sample_ptr += 4;
-  }
+  audio_output_fifo_group_push(h, &stream_info->fifos,
+                               AVBTP_TV(pAVBHdr) == 1, AVBTP_TIMESTAMP(pAVBHdr), sample_num,
+                               buf_ctl, notified_buf_ctl,
+                               sample_ptr, num_channels_in_payload,
+                               (num_samples_in_payload + num_channels_in_payload - 1) / num_channels_in_payload,
+                               0);
 
   return(1);
 }
@@ -24,6 +24,24 @@
 #define AVB_MAX_STREAMS_PER_TALKER_UNIT (AVB_NUM_SOURCES)
 #endif
 
+/** Fixed format talker fast paths.
+ *
+ *  Define this in ``avb_conf.h`` as a list of
+ *  ``AVB_1722_TALKER_FAST_PATH(channels, sample rate, sample type)`` entries
+ *  to generate packetizers with the stream format built in, e.g.::
+ *
+ *    #define AVB_1722_TALKER_FAST_PATHS \
+ *      AVB_1722_TALKER_FAST_PATH(8, 48000, MBLA_24BIT) \
+ *      AVB_1722_TALKER_FAST_PATH(2, 48000, MBLA_24BIT)
+ *
+ *  A stream whose configuration matches an entry uses that packetizer,
+ *  any other stream uses the generic one. The sample rate must be a whole
+ *  number of samples per packet at ``AVB1722_PACKET_RATE``.
+ */
+#ifndef AVB_1722_TALKER_FAST_PATHS
+#define AVB_1722_TALKER_FAST_PATHS
+#endif
+
 //! Data structure to identify Ethernet/AVB stream configuration.
 typedef struct avb1722_Talker_StreamConfig_t
 {
@@ -68,10 +86,20 @@ typedef struct avb1722_Talker_StreamConfig_t
   unsigned presentation_delay;
   //! the internal clock count when the last 1722 packet was transmitted
   int last_transmit_time;
+  //! true once last_transmit_time holds the launch time of a packet
+  unsigned int transmit_time_valid;
+  //! the minimum number of timer ticks between packet launches
+  unsigned int transmit_period;
   //! the port to transmit the packet on
   int txport;
   //! a transmitted packet sequence counter
   char sequence_number;
+  //! the fixed format packetizer for this stream, 0 for the generic one
+  unsigned int fast_path;
+  //! the AAF format code of the stream, 0 for a 61883-6 stream
+  unsigned int aaf_format;
+  //! the AAF nominal sample rate code of the stream
+  unsigned int aaf_nsr;
 } avb1722_Talker_StreamConfig_t;
 
 
@@ -101,6 +129,35 @@ int avb1722_create_packet(unsigned char Buf[],
                                           timeInfo),
                           audio_frame_t *frame,
                           int stream);
+
+/** Returns the number of audio frames still required to complete the packet
+ *  currently being built for a stream.
+ */
+int avb1722_frames_to_complete_packet(REFERENCE_PARAM(avb1722_Talker_StreamConfig_t,
+                                                      stream_info));
+
+/** Block version of avb1722_create_packet(). Packetizes a contiguous run of
+ *  audio frames in one call rather than one call per frame.
+ *
+ *  At most avb1722_frames_to_complete_packet() frames are consumed; any
+ *  frames beyond the end of the packet are left for the next call.
+ *
+ *  \param Buf          the stream's transmit buffer
+ *  \param stream_info  the stream configuration and packetizer state
+ *  \param timeInfo     PTP time information used to convert the presentation time
+ *  \param frames       the audio frames to packetize
+ *  \param num_frames   the number of frames in ``frames``
+ *  \param stream       the stream number
+ *  \returns            the size of the packet if it was completed, otherwise 0
+ */
+int avb1722_create_packet_block(unsigned char Buf[],
+                                REFERENCE_PARAM(avb1722_Talker_StreamConfig_t,
+                                                stream_info),
+                                REFERENCE_PARAM(ptp_time_info_mod64,
+                                                timeInfo),
+                                audio_frame_t *frames,
+                                int num_frames,
+                                int stream);
 #ifdef __XC__
 }
 #endif
@@ -111,11 +168,46 @@ int avb1722_create_packet(unsigned char Buf[],
 
 struct talker_counters {
   unsigned sent_1722;
+  unsigned input_frame_overruns;
 };
 
+/** Transmit launch statistics of a talker stream. Times are in timer ticks
+ *  after the launch time the scheduler computed for each packet.
+ */
+struct talker_launch_stats {
+  //! packets sent at or after their launch time
+  unsigned launches;
+  //! packets sent early because all of the stream's buffers were full
+  unsigned forced;
+  //! the largest launch delay
+  unsigned jitter_max;
+  //! the sum of the launch delays, for the mean
+  unsigned jitter_total;
+};
+
+/** The number of transmit buffers per talker stream.
+ *
+ *  Each packet is built in place in a free buffer and committed for
+ *  transmission once complete. With more than one buffer a committed packet
+ *  can wait for the next transmit slot while the following packet is built,
+ *  instead of being sent early to free its buffer. Set to 1 for the single
+ *  buffer behaviour.
+ */
+#ifndef AVB_1722_TALKER_TX_SLOTS
+#define AVB_1722_TALKER_TX_SLOTS 2
+#endif
+
 typedef struct avb_1722_talker_state_s {
-  unsigned int tx_buf[AVB_NUM_SOURCES][(MAX_PKT_BUF_SIZE_TALKER + 3) / 4];
-  unsigned int tx_buf_fill_size[AVB_NUM_SOURCES];
+  unsigned int tx_buf[AVB_NUM_SOURCES][AVB_1722_TALKER_TX_SLOTS][(MAX_PKT_BUF_SIZE_TALKER + 3) / 4];
+  //! size of the committed packet in each buffer, 0 if the buffer is free
+  unsigned int tx_buf_fill_size[AVB_NUM_SOURCES][AVB_1722_TALKER_TX_SLOTS];
+  //! the buffer the next packet of each stream is built in
+  unsigned int tx_build_slot[AVB_NUM_SOURCES];
+  //! the buffer holding the oldest committed packet of each stream
+  unsigned int tx_send_slot[AVB_NUM_SOURCES];
+  //! the time each committed packet was completed
+  int tx_commit_time[AVB_NUM_SOURCES][AVB_1722_TALKER_TX_SLOTS];
+  struct talker_launch_stats launch_stats[AVB_NUM_SOURCES];
   avb1722_Talker_StreamConfig_t
     talker_streams[AVB_MAX_STREAMS_PER_TALKER_UNIT];
   int max_active_avb_stream ;
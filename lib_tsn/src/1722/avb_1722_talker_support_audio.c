@@ -11,6 +11,8 @@
 #include <string.h>
 
 #include "avb_1722_talker.h"
+#include "avb_1722_am824.h"
+#include "avb_1722_aaf.h"
 #include "gptp.h"
 
 // default audio sample type 24bits.
@@ -68,6 +70,17 @@ static void AVB1722_AVBTP_HeaderGen(unsigned char Buf[],
 }
 
 
+enum avb1722_talker_fast_path_t {
+    AVB1722_TALKER_GENERIC_PATH = 0,
+#define AVB_1722_TALKER_FAST_PATH(channels, rate, type) \
+    AVB1722_TALKER_FAST_PATH_##channels##_##rate##_##type,
+    AVB_1722_TALKER_FAST_PATHS
+#undef AVB_1722_TALKER_FAST_PATH
+};
+
+static unsigned AVB1722_Talker_selectFastPath(avb1722_Talker_StreamConfig_t *pStreamConfig,
+        unsigned label);
+
 /** This configure AVB Talker buffer for a given stream configuration.
  *  It updates the static portion of Ehternet/AVB transport layer headers.
  */
@@ -104,6 +117,8 @@ void AVB1722_Talker_bufInit(unsigned char Buf0[],
         break;
     }
 
+    pStreamConfig->fast_path = AVB1722_Talker_selectFastPath(pStreamConfig, AVB1722_audioSampleType);
+
     // clear all the bytes in header.
     memset( (void *) Buf, 0, (AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + AVB_CIP_HDR_SIZE));
 
@@ -125,6 +140,17 @@ void AVB1722_Talker_bufInit(unsigned char Buf0[],
     SET_AVBTP_STREAM_ID0(p1722Hdr, pStreamConfig->streamId[0]);
     SET_AVBTP_STREAM_ID1(p1722Hdr, pStreamConfig->streamId[1]);
 
+#if AVB_1722_FORMAT_AAF
+    if (pStreamConfig->aaf_format) {
+        // 3. Initialise the AAF format specific part, there is no CIP header
+        SET_AVBTP_SUBTYPE(p1722Hdr, AVB1722_AAF_SUBTYPE);
+        SET_AVB1722_AAF_FORMAT(p1722Hdr, pStreamConfig->aaf_format);
+        SET_AVB1722_AAF_NSR_CHANNELS(p1722Hdr, pStreamConfig->aaf_nsr, pStreamConfig->num_channels);
+        SET_AVB1722_AAF_BIT_DEPTH(p1722Hdr, AVB1722_AAF_SAMPLE_SIZE(pStreamConfig->aaf_format) * 8);
+        return;
+    }
+#endif
+
     // 3. Initialise the 61883 CIP protocol specific part
     SET_AVB1722_CIP_TAG(p1722Hdr, AVB1722_DEFAULT_TAG);
     SET_AVB1722_CIP_CHANNEL(p1722Hdr, AVB1722_DEFAULT_CHANNEL);
@@ -145,7 +171,228 @@ void AVB1722_Talker_bufInit(unsigned char Buf0[],
     SET_AVB1722_CIP_FDF(p61883Hdr, AVB1722_DEFAULT_FDF);
     SET_AVB1722_CIP_SYT(p61883Hdr, AVB1722_DEFAULT_SYT);
 
+    // Fast path packets are all the same length, so the header is complete
+    // but for the fields AVB1722_Talker_finishPacketFixed() patches
+    if (pStreamConfig->fast_path != AVB1722_TALKER_GENERIC_PATH) {
+        SET_AVBTP_PACKET_DATA_LENGTH(p1722Hdr, AVB_CIP_HDR_SIZE +
+            ((pStreamConfig->samples_per_packet_base * pStreamConfig->num_channels) << 2));
+    }
+}
+
+/** Close off a packet once all of its samples have been written: advance the
+ *  fractional sample accumulator and the DBC, then fill in the CIP and AVBTP
+ *  header fields that change for each PDU.
+ *
+ *  \return the size of the packet in bytes (excluding the 2 byte alignment)
+ */
+static inline int AVB1722_Talker_finishPacket(unsigned char Buf[],
+        avb1722_Talker_StreamConfig_t *stream_info,
+        ptp_time_info_mod64 *timeInfo,
+        int num_channels,
+        int samples_per_channel,
+        int timestamp_valid,
+        unsigned int presentation_time)
+{
+    int dbc = stream_info->dbc_at_start_of_last_packet;
+    unsigned ptp_ts = 0;
+    int pkt_data_length;
+
+    stream_info->rem += stream_info->samples_per_packet_fractional;
+    if (samples_per_channel > stream_info->samples_per_packet_base) {
+        stream_info->rem &= 0xffff;
+    }
+
+    pkt_data_length = AVB_CIP_HDR_SIZE + ((samples_per_channel * num_channels) << 2);
+
+    AVB1722_CIP_HeaderGen(Buf, dbc & 0xFF);
+
+    dbc += samples_per_channel;
+    stream_info->dbc_at_start_of_last_packet = dbc;
+
+    // perform required updates to header
+    if (timestamp_valid) {
+        ptp_ts = local_timestamp_to_ptp_mod32(presentation_time, timeInfo);
+        ptp_ts = ptp_ts + stream_info->presentation_delay;
+    }
+
+    // Update timestamp value and valid flag.
+    AVB1722_AVBTP_HeaderGen(Buf, timestamp_valid, ptp_ts, pkt_data_length, stream_info->sequence_number, stream_info->streamId[0]);
+
+    stream_info->sequence_number++;
+    stream_info->current_samples_in_packet = 0;
+    stream_info->timestamp_valid = 0;
+    return (AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + pkt_data_length);
+}
+
+static inline int AVB1722_Talker_samplesInPacket(avb1722_Talker_StreamConfig_t *stream_info)
+{
+    int samples_per_channel = stream_info->samples_per_packet_base;
+
+    if (stream_info->rem & 0xffff0000) {
+        samples_per_channel += 1;
+    }
+    return samples_per_channel;
+}
+
+// 61883-6 SYT_INTERVAL for a sample rate as a constant expression, matching
+// the syt_interval of the rate in avb1722_formats
+#define AVB1722_SYT_INTERVAL(rate) \
+    ((rate) <= 8000 ? 1 : (rate) <= 16000 ? 2 : (rate) <= 24000 ? 4 : (rate) <= 48000 ? 8 : (rate) <= 96000 ? 16 : 32)
+
+/** Close off a fast path packet. Each stream builds into its own TX slots,
+ *  whose headers AVB1722_Talker_bufInit() filled in when the stream was
+ *  configured, and a fast path's packet length and stream ID never change.
+ *  So only the DBC, the timestamp and the sequence number are written here.
+ *
+ *  \return the size of the packet in bytes (excluding the 2 byte alignment)
+ */
+static inline __attribute__((always_inline))
+int AVB1722_Talker_finishPacketFixed(unsigned char Buf[],
+        avb1722_Talker_StreamConfig_t *stream_info,
+        ptp_time_info_mod64 *timeInfo,
+        const int num_channels,
+        const int samples_per_channel)
+{
+    AVB_DataHeader_t *pAVBHdr = (AVB_DataHeader_t *) &(Buf[AVB_ETHERNET_HDR_SIZE]);
+    AVB_AVB1722_CIP_Header_t *pCIPHdr = (AVB_AVB1722_CIP_Header_t *) &(Buf[AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE]);
+    int dbc = stream_info->dbc_at_start_of_last_packet;
+
+    SET_AVB1722_CIP_DBC(pCIPHdr, dbc & 0xFF);
+    stream_info->dbc_at_start_of_last_packet = dbc + samples_per_channel;
+
+    if (stream_info->timestamp_valid) {
+        unsigned ptp_ts = local_timestamp_to_ptp_mod32(stream_info->timestamp, timeInfo);
+        SET_AVBTP_TV(pAVBHdr, 1);
+        SET_AVBTP_TIMESTAMP(pAVBHdr, ptp_ts + stream_info->presentation_delay);
+    } else {
+        SET_AVBTP_TV(pAVBHdr, 0);
+        SET_AVBTP_TIMESTAMP(pAVBHdr, 0);
+    }
+
+    SET_AVBTP_SEQUENCE_NUMBER(pAVBHdr, stream_info->sequence_number);
+
+    stream_info->sequence_number++;
+    stream_info->current_samples_in_packet = 0;
+    stream_info->timestamp_valid = 0;
+    return (AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + AVB_CIP_HDR_SIZE + ((samples_per_channel * num_channels) << 2));
+}
+
+/** Single frame packetizer with the stream format as compile time constants.
+ *  Once inlined into a fast path the channel loop has a constant trip count,
+ *  there is no fractional sample accounting and the packet length is fixed,
+ *  so it is never rewritten.
+ */
+static inline __attribute__((always_inline))
+int AVB1722_Talker_createPacketFixed(unsigned char Buf0[],
+        avb1722_Talker_StreamConfig_t *stream_info,
+        ptp_time_info_mod64 *timeInfo,
+        audio_frame_t *frame,
+        const int num_channels,
+        const int samples_per_channel,
+        const unsigned ts_interval,
+        const unsigned label)
+{
+    int current_samples_in_packet = stream_info->current_samples_in_packet;
+    unsigned char *Buf = &Buf0[2];
+    unsigned int *dest = (unsigned int *) &Buf[(AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + AVB_CIP_HDR_SIZE)];
+    unsigned int *map = stream_info->map;
+
+    dest += current_samples_in_packet * num_channels;
+
+    for (int i = 0; i < num_channels; i++) {
+        dest[i] = AVB1722_AM824_ENCODE(frame->samples[map[i]], label);
+    }
+
+    if (((stream_info->dbc_at_start_of_last_packet + current_samples_in_packet) & (ts_interval-1)) == 0) {
+        stream_info->timestamp_valid = 1;
+        stream_info->timestamp = frame->timestamp;
+    }
+
+    current_samples_in_packet++;
+
+    if (current_samples_in_packet == samples_per_channel) {
+        return AVB1722_Talker_finishPacketFixed(Buf, stream_info, timeInfo, num_channels, samples_per_channel);
+    }
+
+    stream_info->current_samples_in_packet = current_samples_in_packet;
+    return 0;
+}
+
+#define AVB_1722_TALKER_FAST_PATH(channels, rate, type) \
+typedef char avb1722_fast_path_##channels##_##rate##_##type##_whole_samples_per_packet \
+    [((rate) % AVB1722_PACKET_RATE) == 0 ? 1 : -1]; \
+static int avb1722_create_packet_##channels##_##rate##_##type(unsigned char Buf0[], \
+        avb1722_Talker_StreamConfig_t *stream_info, \
+        ptp_time_info_mod64 *timeInfo, \
+        audio_frame_t *frame) \
+{ \
+    return AVB1722_Talker_createPacketFixed(Buf0, stream_info, timeInfo, frame, \
+        channels, (rate) / AVB1722_PACKET_RATE, AVB1722_SYT_INTERVAL(rate), type); \
+}
+AVB_1722_TALKER_FAST_PATHS
+#undef AVB_1722_TALKER_FAST_PATH
+
+/** Find the fast path, if any, generated for the format of a stream */
+static unsigned AVB1722_Talker_selectFastPath(avb1722_Talker_StreamConfig_t *pStreamConfig,
+        unsigned label)
+{
+#define AVB_1722_TALKER_FAST_PATH(channels, rate, type) \
+    if (pStreamConfig->num_channels == (channels) && \
+        pStreamConfig->samples_per_packet_base == (rate) / AVB1722_PACKET_RATE && \
+        pStreamConfig->samples_per_packet_fractional == 0 && \
+        pStreamConfig->ts_interval == AVB1722_SYT_INTERVAL(rate) && \
+        label == (type)) { \
+        return AVB1722_TALKER_FAST_PATH_##channels##_##rate##_##type; \
+    }
+    AVB_1722_TALKER_FAST_PATHS
+#undef AVB_1722_TALKER_FAST_PATH
+
+    return AVB1722_TALKER_GENERIC_PATH;
+}
+
+#if AVB_1722_FORMAT_AAF
+/** Single frame packetizer for AAF streams. Every packet carries a fixed
+ *  number of samples and is timestamped with the presentation time of its
+ *  first sample.
+ */
+static int AVB1722_Talker_createPacketAAF(unsigned char Buf0[],
+        avb1722_Talker_StreamConfig_t *stream_info,
+        ptp_time_info_mod64 *timeInfo,
+        audio_frame_t *frame)
+{
+    int num_channels = stream_info->num_channels;
+    int current_samples_in_packet = stream_info->current_samples_in_packet;
+    int samples_per_channel = stream_info->samples_per_packet_base;
+    int sample_size = AVB1722_AAF_SAMPLE_SIZE(stream_info->aaf_format);
+    unsigned char *Buf = &Buf0[2];
+    unsigned char *dest = &Buf[AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE];
+
+    dest += current_samples_in_packet * num_channels * sample_size;
+
+    avb1722_aaf_pack(dest, frame->samples, stream_info->map, num_channels, sample_size);
+
+    if (current_samples_in_packet == 0) {
+        stream_info->timestamp = frame->timestamp;
+    }
+
+    current_samples_in_packet++;
+
+    if (current_samples_in_packet == samples_per_channel) {
+        int stream_data_length = samples_per_channel * num_channels * sample_size;
+        unsigned ptp_ts = local_timestamp_to_ptp_mod32(stream_info->timestamp, timeInfo);
+        ptp_ts = ptp_ts + stream_info->presentation_delay;
+
+        AVB1722_AVBTP_HeaderGen(Buf, 1, ptp_ts, stream_data_length, stream_info->sequence_number, stream_info->streamId[0]);
+
+        stream_info->sequence_number++;
+        stream_info->current_samples_in_packet = 0;
+        return (AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + stream_data_length);
+    }
+
+    stream_info->current_samples_in_packet = current_samples_in_packet;
+    return 0;
 }
+#endif
 
 int avb1722_create_packet(unsigned char Buf0[],
         avb1722_Talker_StreamConfig_t *stream_info,
@@ -153,13 +400,27 @@ int avb1722_create_packet(unsigned char Buf0[],
         audio_frame_t *frame,
         int stream)
 {
+#if AVB_1722_FORMAT_AAF
+    if (stream_info->aaf_format) {
+        return AVB1722_Talker_createPacketAAF(Buf0, stream_info, timeInfo, frame);
+    }
+#endif
+
+    switch (stream_info->fast_path) {
+#define AVB_1722_TALKER_FAST_PATH(channels, rate, type) \
+    case AVB1722_TALKER_FAST_PATH_##channels##_##rate##_##type: \
+        return avb1722_create_packet_##channels##_##rate##_##type(Buf0, stream_info, timeInfo, frame);
+    AVB_1722_TALKER_FAST_PATHS
+#undef AVB_1722_TALKER_FAST_PATH
+    default:
+        break;
+    }
+
     unsigned int presentation_time = stream_info->timestamp;
     int timestamp_valid = stream_info->timestamp_valid;
     int num_channels = stream_info->num_channels;
     int current_samples_in_packet = stream_info->current_samples_in_packet;
-    int stream_id0 = stream_info->streamId[0];
     unsigned int *map = stream_info->map;
-    int total_samples_in_packet;
     int samples_per_channel;
 
     // align packet 2 chars into the buffer so that samples are
@@ -168,28 +429,17 @@ int avb1722_create_packet(unsigned char Buf0[],
     unsigned int *dest = (unsigned int *) &Buf[(AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + AVB_CIP_HDR_SIZE)];
 
     int stride = num_channels;
-    unsigned ptp_ts = 0;
     int dbc;
-    int pkt_data_length;
 
     dest += (current_samples_in_packet * stride);
 
     // Figure out the number of samples in the 1722 packet
-    samples_per_channel = stream_info->samples_per_packet_base;
-
-    if (stream_info->rem & 0xffff0000) {
-        samples_per_channel += 1;
-    }
+    samples_per_channel = AVB1722_Talker_samplesInPacket(stream_info);
 
     // Find the DBC for the current stream
     dbc = stream_info->dbc_at_start_of_last_packet;
 
-    for (int i = 0; i < num_channels; i++) {
-        unsigned sample = (frame->samples[map[i]] >> 8) | AVB1722_audioSampleType;
-        sample = byterev(sample);
-        *dest = sample;
-        dest += 1;
-    }
+    avb1722_am824_pack(dest, frame->samples, map, num_channels, AVB1722_audioSampleType);
 
     unsigned this_dbc = dbc + current_samples_in_packet;
     unsigned int ts_this_dbc = ((this_dbc & (stream_info->ts_interval-1)) == 0);
@@ -204,38 +454,88 @@ int avb1722_create_packet(unsigned char Buf0[],
     // samples_per_channel is the number of times we need to call this function
     // i.e. the number of audio frames we need to iterate through to get a full packet worth of samples
     if (current_samples_in_packet == samples_per_channel) {
-        stream_info->rem += stream_info->samples_per_packet_fractional;
-        if (samples_per_channel > stream_info->samples_per_packet_base) {
-            stream_info->rem &= 0xffff;
-        }
+        return AVB1722_Talker_finishPacket(Buf, stream_info, timeInfo, num_channels, samples_per_channel,
+                                           timestamp_valid, presentation_time);
+    }
 
-        total_samples_in_packet = samples_per_channel * num_channels;
+    stream_info->timestamp_valid = timestamp_valid;
+    stream_info->timestamp = presentation_time;
+    stream_info->current_samples_in_packet = current_samples_in_packet;
 
-        pkt_data_length = AVB_CIP_HDR_SIZE + (total_samples_in_packet << 2);
+    return 0;
+}
 
-        AVB1722_CIP_HeaderGen(Buf, dbc & 0xFF);
+int avb1722_frames_to_complete_packet(avb1722_Talker_StreamConfig_t *stream_info)
+{
+    return AVB1722_Talker_samplesInPacket(stream_info) - stream_info->current_samples_in_packet;
+}
 
-        dbc += samples_per_channel;
-        stream_info->dbc_at_start_of_last_packet = dbc;
+int avb1722_create_packet_block(unsigned char Buf0[],
+        avb1722_Talker_StreamConfig_t *stream_info,
+        ptp_time_info_mod64 *timeInfo,
+        audio_frame_t *frames,
+        int num_frames,
+        int stream)
+{
+    // AAF streams and fixed format streams keep their per frame packetizers
+    if (stream_info->aaf_format || stream_info->fast_path) {
+        int frames_to_complete = avb1722_frames_to_complete_packet(stream_info);
+        int size = 0;
 
-        // perform required updates to header
-        if (timestamp_valid) {
-            ptp_ts = local_timestamp_to_ptp_mod32(presentation_time, timeInfo);
-            ptp_ts = ptp_ts + stream_info->presentation_delay;
+        if (num_frames > frames_to_complete) {
+            num_frames = frames_to_complete;
         }
+        for (int f = 0; f < num_frames; f++) {
+            size = avb1722_create_packet(Buf0, stream_info, timeInfo, &frames[f], stream);
+        }
+        return size;
+    }
 
-        // Update timestamp value and valid flag.
-        AVB1722_AVBTP_HeaderGen(Buf, timestamp_valid, ptp_ts, pkt_data_length, stream_info->sequence_number, stream_id0);
+    unsigned int presentation_time = stream_info->timestamp;
+    int timestamp_valid = stream_info->timestamp_valid;
+    const int num_channels = stream_info->num_channels;
+    const int current_samples_in_packet = stream_info->current_samples_in_packet;
+    const unsigned int *map = stream_info->map;
+    const unsigned int sample_type = AVB1722_audioSampleType;
+    const unsigned int ts_mask = stream_info->ts_interval - 1;
+    const int samples_per_channel = AVB1722_Talker_samplesInPacket(stream_info);
+    int frames_to_complete = samples_per_channel - current_samples_in_packet;
 
-        stream_info->sequence_number++;
-        stream_info->current_samples_in_packet = 0;
-        stream_info->timestamp_valid = 0;
-        return (AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + pkt_data_length);
+    unsigned char *Buf = &Buf0[2];
+    unsigned int *dest = (unsigned int *) &Buf[(AVB_ETHERNET_HDR_SIZE + AVB_TP_HDR_SIZE + AVB_CIP_HDR_SIZE)];
+
+    if (num_frames > frames_to_complete) {
+        num_frames = frames_to_complete;
+    }
+
+    dest += (current_samples_in_packet * num_channels);
+
+    for (int f = 0; f < num_frames; f++) {
+        avb1722_am824_pack(dest, frames[f].samples, map, num_channels, sample_type);
+        dest += num_channels;
+    }
+
+    // Frames that land on a SYT_INTERVAL boundary of the running DBC carry a
+    // timestamp. Find the first in the block, then step on to the last one:
+    // avb1722_create_packet() overwrites the timestamp at every boundary frame,
+    // so the last one in the block is what it would have left.
+    unsigned this_dbc = stream_info->dbc_at_start_of_last_packet + current_samples_in_packet;
+    unsigned ts_frame = (-this_dbc) & ts_mask;
+
+    if (ts_frame < num_frames) {
+        ts_frame += (num_frames - 1 - ts_frame) & ~ts_mask;
+        timestamp_valid = 1;
+        presentation_time = frames[ts_frame].timestamp;
+    }
+
+    if (num_frames == frames_to_complete) {
+        return AVB1722_Talker_finishPacket(Buf, stream_info, timeInfo, num_channels, samples_per_channel,
+                                           timestamp_valid, presentation_time);
     }
 
     stream_info->timestamp_valid = timestamp_valid;
     stream_info->timestamp = presentation_time;
-    stream_info->current_samples_in_packet = current_samples_in_packet;
+    stream_info->current_samples_in_packet = current_samples_in_packet + num_frames;
 
     return 0;
 }
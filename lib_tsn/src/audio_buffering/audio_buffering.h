@@ -8,34 +8,42 @@
 #include <string.h>
 #include "xc2compat.h"
 #include "hwlock.h"
+#include "audio_frame_ring.h"
 
 /**
  * \brief This type provides a handle to an audio buffer.
  **/
 typedef void * unsafe buffer_handle_t;
 
-typedef struct audio_frame_t {
-    uint32_t timestamp;
-    uint32_t samples[AVB_NUM_MEDIA_INPUTS];
-} audio_frame_t;
-
-typedef struct audio_double_buffer_t {
-  unsigned int active_buffer;
-  unsigned int data_ready;
-  unsigned int data_taken;
-  audio_frame_t buffer[2];
-} audio_double_buffer_t;
-
 struct input_finfo {
-  audio_double_buffer_t * unsafe p_buffer;
+  audio_frame_ring_t * unsafe p_buffer;
 };
 
 struct output_finfo {
   unsigned int *unsafe p_buffer[AVB_NUM_MEDIA_OUTPUTS];
+  unsigned int *unsafe p_arena;
 };
 
 typedef int audio_output_fifo_t;
 
+/** The number of TDM slots on each audio output line. With TDM IO the
+ *  media outputs are AUDIO_TDM_LINES lines of this many slots, output
+ *  ``slot + line * AUDIO_TDM_SLOTS_PER_LINE`` being in the given slot of the
+ *  given line.
+ */
+#ifndef AUDIO_TDM_SLOTS_PER_LINE
+#define AUDIO_TDM_SLOTS_PER_LINE (8)
+#endif
+
+/** The number of TDM audio output lines */
+#define AUDIO_TDM_LINES (AVB_NUM_MEDIA_OUTPUTS / AUDIO_TDM_SLOTS_PER_LINE)
+
+/** The entry of the output sample buffer sent by audio_buffer_manager()
+ *  that is set when the audio interface should restart, after the samples
+ *  of all of the outputs.
+ */
+#define AUDIO_OUTPUT_RESTART_FLAG (AVB_NUM_MEDIA_OUTPUTS > 8 ? AVB_NUM_MEDIA_OUTPUTS : 8)
+
 #ifdef __XC__
 typedef interface push_if {
   buffer_handle_t get_handle();
@@ -68,28 +76,4 @@ unsafe void media_ctl_register(chanend media_ctl,
                         int clk_ctl_index);
 #endif
 
-
-void audio_buffers_initialize(REFERENCE_PARAM(audio_double_buffer_t, buffer));
-
-
-#define audio_buffers_swap_active_buffer audio_buffers_swap_active_buffer0
-
-#ifdef __XC__
-
-unsafe static audio_frame_t *unsafe audio_buffers_swap_active_buffer0(audio_double_buffer_t &buffer)
-{
-  volatile audio_double_buffer_t * unsafe p_buffer = (volatile audio_double_buffer_t * unsafe)(&buffer);
-  asm("#write_active_buffer");
-  p_buffer->active_buffer = !p_buffer->active_buffer;
-  asm("#write_data_ready");
-  p_buffer->data_ready = 1;
-
-  return &p_buffer->buffer[p_buffer->active_buffer];
-}
-
-unsafe inline void audio_buffers_swap_active_buffer1(audio_double_buffer_t &buffer){
-  audio_buffers_swap_active_buffer0(buffer);
-}
-#endif
-
 #endif // __AUDIO_BUFFERING_H__
@@ -0,0 +1,122 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file audio_frame_ring.h
+ * \brief Ring of audio input frames passed from the audio hardware interface
+ *        to the 1722 talker
+ *
+ * The audio hardware interface fills one frame at a time and publishes it;
+ * the talker takes whatever frames have been published in one batch. The
+ * two sides count frames with free running sequence numbers that only the
+ * owning side writes, so no lock is needed and a talker that falls behind by
+ * up to AUDIO_INPUT_FRAME_RING_DEPTH - 1 frames loses nothing. When the ring
+ * is full the newest frame is dropped and counted as an overrun; the frames
+ * already published are never overwritten.
+ *
+ * Like audio_output_fifo_ring.h this header can be built on a host.
+ */
+#ifndef __AUDIO_FRAME_RING_H__
+#define __AUDIO_FRAME_RING_H__
+
+#include <stdint.h>
+#include <xc2compat.h>
+#include "default_avb_conf.h"
+#include "audio_output_fifo_ring.h"
+
+/** The number of audio frames between the audio hardware interface and the
+ *  talker, a power of two of at least 2. One frame is always being filled,
+ *  the rest hold frames waiting for the talker.
+ */
+#ifndef AUDIO_INPUT_FRAME_RING_DEPTH
+#define AUDIO_INPUT_FRAME_RING_DEPTH (8)
+#endif
+
+#if AUDIO_INPUT_FRAME_RING_DEPTH < 2 || !AUDIO_OUTPUT_FIFO_RING_POW2(AUDIO_INPUT_FRAME_RING_DEPTH)
+#error AUDIO_INPUT_FRAME_RING_DEPTH must be a power of two of at least 2
+#endif
+
+#define AUDIO_INPUT_FRAME_RING_MASK (AUDIO_INPUT_FRAME_RING_DEPTH - 1)
+
+typedef struct audio_frame_t {
+    uint32_t timestamp;
+    uint32_t samples[AVB_NUM_MEDIA_INPUTS];
+} audio_frame_t;
+
+typedef struct audio_frame_ring_t {
+  // Written by the audio hardware interface only
+  unsigned int wr_seq;          //!< The number of frames published
+  unsigned int overruns;        //!< Frames dropped because the talker had not freed a slot
+#if AUDIO_OUTPUT_FIFO_RING_LINE_WORDS > 2
+  unsigned int producer_pad[AUDIO_OUTPUT_FIFO_RING_LINE_WORDS - 2];
+#endif
+  // Written by the talker only
+  unsigned int rd_seq;          //!< The number of frames released
+#if AUDIO_OUTPUT_FIFO_RING_LINE_WORDS > 1
+  unsigned int consumer_pad[AUDIO_OUTPUT_FIFO_RING_LINE_WORDS - 1];
+#endif
+  audio_frame_t buffer[AUDIO_INPUT_FRAME_RING_DEPTH];
+} AUDIO_OUTPUT_FIFO_RING_ALIGNED audio_frame_ring_t;
+
+unsafe static inline void
+audio_frame_ring_init(audio_frame_ring_t *unsafe r)
+{
+  r->wr_seq = 0;
+  r->overruns = 0;
+  r->rd_seq = 0;
+}
+
+/** Producer: the frame to fill next */
+unsafe static inline audio_frame_t *unsafe
+audio_frame_ring_first_frame(audio_frame_ring_t *unsafe r)
+{
+  return &r->buffer[r->wr_seq & AUDIO_INPUT_FRAME_RING_MASK];
+}
+
+/** Producer: publish the frame that has just been filled.
+ *
+ *  \returns the frame to fill next. If the ring was full the frame is not
+ *           published and the same frame is returned to be filled again.
+ */
+unsafe static inline audio_frame_t *unsafe
+audio_frame_ring_publish(audio_frame_ring_t *unsafe r)
+{
+  unsigned int wr_seq = r->wr_seq;
+
+  // The frame being filled is not published, so one slot less is usable
+  if (wr_seq - AUDIO_OUTPUT_FIFO_RING_LOAD(r->rd_seq) >= AUDIO_INPUT_FRAME_RING_MASK) {
+    r->overruns++;
+  }
+  else {
+    wr_seq++;
+    AUDIO_OUTPUT_FIFO_RING_STORE(r->wr_seq, wr_seq);
+  }
+  return &r->buffer[wr_seq & AUDIO_INPUT_FRAME_RING_MASK];
+}
+
+/** Consumer: the number of published frames that can be read from
+ *  audio_frame_ring_read_ptr() onwards without wrapping
+ */
+unsafe static inline unsigned int
+audio_frame_ring_available(audio_frame_ring_t *unsafe r)
+{
+  unsigned int rd_seq = r->rd_seq;
+  unsigned int n = AUDIO_OUTPUT_FIFO_RING_LOAD(r->wr_seq) - rd_seq;
+  unsigned int to_end = AUDIO_INPUT_FRAME_RING_DEPTH - (rd_seq & AUDIO_INPUT_FRAME_RING_MASK);
+
+  return n < to_end ? n : to_end;
+}
+
+/** Consumer: the oldest published frame */
+unsafe static inline audio_frame_t *unsafe
+audio_frame_ring_read_ptr(audio_frame_ring_t *unsafe r)
+{
+  return &r->buffer[r->rd_seq & AUDIO_INPUT_FRAME_RING_MASK];
+}
+
+/** Consumer: free the oldest n frames for the producer */
+unsafe static inline void
+audio_frame_ring_release(audio_frame_ring_t *unsafe r, unsigned int n)
+{
+  AUDIO_OUTPUT_FIFO_RING_STORE(r->rd_seq, r->rd_seq + n);
+}
+
+#endif
@@ -5,6 +5,9 @@
 #include "audio_output_fifo.h"
 #include "avb_1722_def.h"
 #include "media_clock_client.h"
+#include "avb_1722_am824.h"
+#include "avb_1722_aaf.h"
+#include <string.h>
 
 #define OUTPUT_DURING_LOCK 0
 #define NOTIFICATION_PERIOD 250
@@ -16,48 +19,215 @@
 //    of -2 to 2
 #define MAX_VOLUME 0x40000000
 
+typedef char audio_output_fifo_word_size_is_pow2[AUDIO_OUTPUT_FIFO_RING_POW2(AUDIO_OUTPUT_FIFO_WORD_SIZE) ? 1 : -1];
+typedef char audio_output_fifo_min_words_is_pow2[AUDIO_OUTPUT_FIFO_RING_POW2(AUDIO_OUTPUT_FIFO_MIN_WORDS) &&
+                                                 AUDIO_OUTPUT_FIFO_MIN_WORDS <= AUDIO_OUTPUT_FIFO_WORD_SIZE ? 1 : -1];
+typedef char audio_output_fifo_arena_is_whole_blocks[AUDIO_OUTPUT_FIFO_ARENA_WORDS % AUDIO_OUTPUT_FIFO_MIN_WORDS == 0 ? 1 : -1];
+
+static inline int
+arena_block_used(audio_output_fifo_arena_t *a, unsigned block)
+{
+  return (a->used[block >> 5] >> (block & 31)) & 1;
+}
+
+static void
+arena_mark(audio_output_fifo_arena_t *a, unsigned first, unsigned n, int used)
+{
+  for (unsigned b = first; b < first + n; b++) {
+    if (used)
+      a->used[b >> 5] |= 1 << (b & 31);
+    else
+      a->used[b >> 5] &= ~(1 << (b & 31));
+  }
+}
+
+// Blocks of a FIFO are aligned to its size so that freed FIFOs of one size
+// leave holes that fit FIFOs of the same or a smaller size
+static unsigned int *
+arena_alloc(audio_output_fifo_arena_t *a, unsigned words)
+{
+  unsigned n = words / AUDIO_OUTPUT_FIFO_MIN_WORDS;
+
+  for (unsigned first = 0; first + n <= AUDIO_OUTPUT_FIFO_ARENA_BLOCKS; first += n) {
+    unsigned b;
+    for (b = first; b < first + n; b++) {
+      if (arena_block_used(a, b))
+        break;
+    }
+    if (b == first + n) {
+      arena_mark(a, first, n, 1);
+      a->words_allocated += words;
+      if (a->words_allocated > a->words_high_water)
+        a->words_high_water = a->words_allocated;
+      return &a->words[first * AUDIO_OUTPUT_FIFO_MIN_WORDS];
+    }
+  }
+  a->failed_allocations++;
+  return 0;
+}
+
+static void
+arena_free(audio_output_fifo_arena_t *a, unsigned int *fifo, unsigned words)
+{
+  unsigned first = (fifo - a->words) / AUDIO_OUTPUT_FIFO_MIN_WORDS;
+
+  arena_mark(a, first, words / AUDIO_OUTPUT_FIFO_MIN_WORDS, 0);
+  a->words_allocated -= words;
+}
+
+// The samples in flight for the presentation time plus two packets of
+// jitter, as a power of two within the FIFO size limits
+static unsigned
+fifo_words_for_stream(int rate, unsigned presentation_ns)
+{
+  unsigned long long samples = ((unsigned long long) rate * presentation_ns) / 1000000000;
+  unsigned words = AUDIO_OUTPUT_FIFO_MIN_WORDS;
+
+  samples += 2 * ((rate + AVB1722_PACKET_RATE - 1) / AVB1722_PACKET_RATE);
+  while (words < samples && words < AUDIO_OUTPUT_FIFO_WORD_SIZE)
+    words <<= 1;
+
+  return words;
+}
+
+void
+audio_output_fifo_arena_init(buffer_handle_t s0)
+{
+  audio_output_fifo_arena_t *a = (audio_output_fifo_arena_t *)((struct output_finfo *)s0)->p_arena;
+
+  a->lock = hwlock_alloc();
+  a->words_allocated = 0;
+  a->words_high_water = 0;
+  a->failed_allocations = 0;
+  memset(a->used, 0, sizeof(a->used));
+}
+
 void
 audio_output_fifo_init(buffer_handle_t s0, unsigned index)
 {
   ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
 
   s->state = DISABLED;
-  s->dptr = START_OF_FIFO(s);
-  s->wrptr = START_OF_FIFO(s);
+  audio_output_fifo_ring_init(&s->ring);
+  s->zero_flag = 1;
+  s->mask = 0;
+  s->fifo = ((audio_output_fifo_arena_t *)((struct output_finfo *)s0)->p_arena)->words;
   s->media_clock = -1;
   s->pending_init_notification = 0;
   s->last_notification_time = 0;
   s->volume = MAX_VOLUME;
 }
 
-void
-disable_audio_output_fifo(buffer_handle_t s0, unsigned index)
+// Mutes the FIFO and returns its storage to the arena
+static void
+release_fifo(struct output_finfo *finfo, ofifo_t *s)
 {
-  ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
+  audio_output_fifo_arena_t *a = (audio_output_fifo_arena_t *)finfo->p_arena;
 
   s->state = DISABLED;
   s->zero_flag = 1;
+  // Leave the FIFO empty so that the audio thread stops reading it
+  audio_output_fifo_ring_commit(&s->ring,
+                                AUDIO_OUTPUT_FIFO_RING_LOAD(s->ring.rd) - s->ring.wr);
+
+  // The storage pointer is left as it is, the audio thread may be part way
+  // through reading a sample from it
+  if (s->mask) {
+    hwlock_acquire(a->lock);
+    arena_free(a, s->fifo, s->mask + 1);
+    hwlock_release(a->lock);
+    s->mask = 0;
+  }
 }
 
 void
-enable_audio_output_fifo(buffer_handle_t s0, unsigned index, int media_clock)
+disable_audio_output_fifo(buffer_handle_t s0, unsigned index)
 {
-  ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
+  struct output_finfo *finfo = (struct output_finfo *)s0;
+  ofifo_t *s = (ofifo_t *)finfo->p_buffer[index];
 
-  s->state = ZEROING;
-  s->dptr = START_OF_FIFO(s);
-  s->wrptr = START_OF_FIFO(s);
-  s->marker = (unsigned int *) 0;
+  release_fifo(finfo, s);
+}
+
+void
+enable_audio_output_fifo(buffer_handle_t s0,
+                         unsigned index,
+                         int media_clock,
+                         int rate,
+                         unsigned presentation_ns)
+{
+  struct output_finfo *finfo = (struct output_finfo *)s0;
+  audio_output_fifo_arena_t *a = (audio_output_fifo_arena_t *)finfo->p_arena;
+  ofifo_t *s = (ofifo_t *)finfo->p_buffer[index];
+  unsigned words = fifo_words_for_stream(rate, presentation_ns);
+  unsigned int *fifo;
+
+  release_fifo(finfo, s);
+
+  hwlock_acquire(a->lock);
+  fifo = arena_alloc(a, words);
+  hwlock_release(a->lock);
+
+  if (!fifo)
+    return;
+
+  // release_fifo() left the ring empty. The read index is the audio thread's,
+  // so the indices carry on from where they are into the new storage
+  s->fifo = fifo;
+  s->mask = words - 1;
+  s->marker = AUDIO_OUTPUT_FIFO_NO_MARKER;
   s->local_ts = 0;
   s->ptp_ts = 0;
-  s->zero_marker = END_OF_FIFO(s)-1;
-  s->zero_flag = 1;
-  *s->zero_marker = 1;
+  s->zero_marker = (s->ring.wr - 1) & s->mask;
+  s->fifo[s->zero_marker] = 1;
   s->sample_count = 0;
   s->media_clock = media_clock;
   s->pending_init_notification = 1;
+  s->state = ZEROING;
+}
+
+void
+audio_output_fifo_get_memory(buffer_handle_t s0,
+                             audio_output_fifo_memory_t *info)
+{
+  audio_output_fifo_arena_t *a = (audio_output_fifo_arena_t *)((struct output_finfo *)s0)->p_arena;
+
+  hwlock_acquire(a->lock);
+  info->control_bytes = AVB_NUM_MEDIA_OUTPUTS * sizeof(ofifo_t);
+  info->arena_bytes = sizeof(audio_output_fifo_arena_t);
+  info->total_bytes = info->control_bytes + info->arena_bytes;
+  info->allocated_bytes = a->words_allocated * sizeof(unsigned int);
+  info->high_water_bytes = a->words_high_water * sizeof(unsigned int);
+  info->failed_allocations = a->failed_allocations;
+  hwlock_release(a->lock);
+}
+
+
+void
+audio_output_fifo_group_init(audio_output_fifo_group_t *g,
+                             const audio_output_fifo_t map[],
+                             int num_channels)
+{
+  g->num_fifos = 0;
+  for (int i = 0; i < num_channels; i++) {
+    if (map[i] >= 0) {
+      g->fifo[g->num_fifos] = map[i];
+      g->channel[g->num_fifos] = i;
+      g->num_fifos++;
+    }
+  }
 }
 
+static inline void
+set_ptp_timestamp(ofifo_t *s, unsigned int ptp_ts, unsigned sample_number)
+{
+  if (s->marker == AUDIO_OUTPUT_FIFO_NO_MARKER) {
+    if (ptp_ts==0) ptp_ts = 1;
+    s->ptp_ts = ptp_ts;
+    s->local_ts = 0;
+    s->marker = (s->ring.wr + sample_number) & s->mask;
+  }
+}
 
 // 1722 thread
 void audio_output_fifo_set_ptp_timestamp(buffer_handle_t s0,
@@ -67,30 +237,12 @@ void audio_output_fifo_set_ptp_timestamp(buffer_handle_t s0,
 {
   ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
 
-  if (s->marker == 0) {
-	unsigned int* new_marker = s->wrptr + sample_number;
-	if (new_marker >= END_OF_FIFO(s)) new_marker -= AUDIO_OUTPUT_FIFO_WORD_SIZE;
-
-	if (ptp_ts==0) ptp_ts = 1;
-    s->ptp_ts = ptp_ts;
-    s->local_ts = 0;
-    s->marker = new_marker;
-  }
+  set_ptp_timestamp(s, ptp_ts, sample_number);
 }
 
-static inline unsigned int
-audio_output_fifo_pull_sample(buffer_handle_t s0,
-                              unsigned index,
-                              unsigned int timestamp);
-
-// 1722 thread
-void
-audio_output_fifo_maintain(buffer_handle_t s0,
-                           unsigned index,
-                           chanend buf_ctl,
-                           int *notified_buf_ctl)
+static inline void
+maintain(ofifo_t *s, chanend buf_ctl, int *notified_buf_ctl)
 {
-  ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
   unsigned time_since_last_notification;
 
   if (s->pending_init_notification && !(*notified_buf_ctl)) {
@@ -104,21 +256,17 @@ audio_output_fifo_maintain(buffer_handle_t s0,
     case DISABLED:
       break;
     case ZEROING:
-      if (*s->zero_marker == 0) {
+      if (s->fifo[s->zero_marker] == 0) {
         // we have zero-ed the entire fifo
-        // set the wrptr so that the fifo size is 1/2 of the buffer size
-        int buf_len = (END_OF_FIFO(s) - START_OF_FIFO(s));
-        unsigned int *new_wrptr;
-
-        new_wrptr = s->dptr + ((buf_len>>1));
-        while (new_wrptr >= END_OF_FIFO(s))
-          new_wrptr -= buf_len;
+        // set the write index so that the fifo size is 1/2 of the buffer size
+        unsigned int rd = AUDIO_OUTPUT_FIFO_RING_LOAD(s->ring.rd);
 
-        s->wrptr = new_wrptr;
+        audio_output_fifo_ring_commit(&s->ring,
+                                      rd + ((s->mask + 1) >> 1) - s->ring.wr);
         s->state = LOCKING;
         s->local_ts = 0;
         s->ptp_ts = 0;
-        s->marker = 0;
+        s->marker = AUDIO_OUTPUT_FIFO_NO_MARKER;
 #if (OUTPUT_DURING_LOCK == 0)
         s->zero_flag = 1;
 #endif
@@ -144,6 +292,104 @@ audio_output_fifo_maintain(buffer_handle_t s0,
     }
 }
 
+// 1722 thread
+void
+audio_output_fifo_maintain(buffer_handle_t s0,
+                           unsigned index,
+                           chanend buf_ctl,
+                           int *notified_buf_ctl)
+{
+  ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
+
+  maintain(s, buf_ctl, notified_buf_ctl);
+}
+
+static inline void
+unpack_samples(unsigned int *dest, unsigned int *src, int stride, int n)
+{
+#ifndef AVB_1722_FORMAT_SAF
+  avb1722_am824_unpack(dest, src, stride, n);
+#else
+  for (int i = 0; i < n; i++) {
+    dest[i] = __builtin_bswap32(*src);
+    src += stride;
+  }
+#endif
+}
+
+// sample_size is the number of bytes per AAF sample, or 0 for 61883-6
+// quadlets. stride is in bytes.
+static inline void
+write_samples(unsigned int *dest, unsigned char *src, int stride, int n, int volume, int sample_size)
+{
+  if (volume == 0) {
+    memset(dest, 0, n << 2);
+    return;
+  }
+
+#if AVB_1722_FORMAT_AAF
+  if (sample_size) {
+    avb1722_aaf_unpack(dest, src, stride, n, sample_size);
+  }
+  else
+#endif
+  {
+    unpack_samples(dest, (unsigned int *) src, stride >> 2, n);
+  }
+
+#ifdef AUDIO_OUTPUT_FIFO_VOLUME_CONTROL
+  for (int i = 0; i < n; i++) {
+    // Multiply volume into upper word of 64 bit result
+    int sample = dest[i];
+    int h=0, l=0;
+    asm ("maccs %0,%1,%2,%3":"+r"(h),"+r"(l):"r"(sample),"r"(volume));
+    sample = h >> 6;
+    dest[i] = sample & 0xffffff;
+  }
+#endif
+}
+
+static inline void
+push_samples(ofifo_t *s, unsigned char *sample_ptr, int stride, int count, int sample_size)
+{
+  unsigned int wr = s->ring.wr & s->mask;
+  unsigned int size = s->mask + 1;
+  int space;
+  int len;
+#ifdef AUDIO_OUTPUT_FIFO_VOLUME_CONTROL
+  int volume = (s->state == ZEROING) ? 0 : s->volume;
+#else
+  int volume = (s->state == ZEROING) ? 0 : 1;
+#endif
+
+  if (s->state == DISABLED)
+    return;
+
+  space = audio_output_fifo_ring_space(&s->ring, s->mask);
+
+  // Samples that do not fit are dropped (overflow)
+  if (count > space) {
+    s->ring.overflow_count += count - space;
+    len = space;
+  }
+  else {
+    len = count;
+  }
+
+  // Convert straight into the FIFO, in at most two runs either side of the wrap
+  if (len > size - wr) {
+    int run = size - wr;
+    write_samples(&s->fifo[wr], sample_ptr, stride, run, volume, sample_size);
+    write_samples(&s->fifo[0], sample_ptr + run * stride, stride, len - run, volume, sample_size);
+  }
+  else {
+    write_samples(&s->fifo[wr], sample_ptr, stride, len, volume, sample_size);
+  }
+
+  audio_output_fifo_ring_commit(&s->ring, len);
+  s->sample_count+=count;
+}
+
 // 1722 thread
 void
 audio_output_fifo_strided_push(buffer_handle_t s0,
@@ -154,55 +400,91 @@ audio_output_fifo_strided_push(buffer_handle_t s0,
 
 {
   ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
-  unsigned int *wrptr = s->wrptr;
-  unsigned int *new_wrptr;
-  int i;
-  int sample;
-#ifdef AUDIO_OUTPUT_FIFO_VOLUME_CONTROL
-  int volume = (s->state == ZEROING) ? 0 : s->volume;
-#else
-  int volume = (s->state == ZEROING) ? 0 : 1;
-#endif
-  int count=0;
+  int count = (n + stride - 1) / stride;
 
-  for(i=0;i<n;i+=stride) {
-    count++;
-    sample = *sample_ptr;
-    sample = __builtin_bswap32(sample);
-    sample_ptr += stride;
+  push_samples(s, (unsigned char *) sample_ptr, stride << 2, count, 0);
+}
 
-#ifndef AVB_1722_FORMAT_SAF
-    sample = sample << 8;
+#if AVB_1722_FORMAT_AAF
+// 1722 thread
+void
+audio_output_fifo_strided_push_aaf(buffer_handle_t s0,
+                                   unsigned index,
+                                   unsigned char *sample_ptr,
+                                   int stride,
+                                   int n,
+                                   int sample_size)
+{
+  ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
+
+  push_samples(s, sample_ptr, stride, n, sample_size);
+}
 #endif
 
-#ifdef AUDIO_OUTPUT_FIFO_VOLUME_CONTROL
+// 1722 thread
+void
+audio_output_fifo_group_push(buffer_handle_t s0,
+                             audio_output_fifo_group_t *g,
+                             int timestamp_valid,
+                             unsigned int timestamp,
+                             unsigned sample_number,
+                             chanend buf_ctl,
+                             int *notified_buf_ctl,
+                             unsigned char *sample_ptr,
+                             int num_channels_in_payload,
+                             int n,
+                             int sample_size)
+{
+  struct output_finfo *finfo = (struct output_finfo *)s0;
+  int sample_bytes = sample_size ? sample_size : 4;
+  int stride = num_channels_in_payload * sample_bytes;
 
-    {
-        // Multiply volume into upper word of 64 bit result
-    	int h=0, l=0;
-		asm ("maccs %0,%1,%2,%3":"+r"(h),"+r"(l):"r"(sample),"r"(volume));
-		sample = h >> 6;
-	    sample &= 0xffffff;
-	}
-#else
-    sample = (sample * volume);
-#endif
+  // Each FIFO only depends on its own state and the shared notification
+  // flag, so marking, maintenance and the push can be done FIFO by FIFO
+  for (int i = 0; i < g->num_fifos; i++) {
+    ofifo_t *s = (ofifo_t *)finfo->p_buffer[g->fifo[i]];
+    int channel = g->channel[i];
 
-    new_wrptr = wrptr+1;
+    if (timestamp_valid)
+      set_ptp_timestamp(s, timestamp, sample_number);
 
-    if (new_wrptr == END_OF_FIFO(s)) new_wrptr = START_OF_FIFO(s);
+    maintain(s, buf_ctl, notified_buf_ctl);
+
+    if (channel < num_channels_in_payload)
+      push_samples(s, sample_ptr + channel * sample_bytes, stride, n, sample_size);
+  }
+}
 
-    if (new_wrptr != s->dptr) {
-      *wrptr = sample;
-      wrptr = new_wrptr;
+// Audio thread
+void audio_output_fifo_pull_frame(buffer_handle_t s0,
+                                  int32_t samples[],
+                                  unsigned first,
+                                  unsigned stride,
+                                  unsigned n,
+                                  unsigned int timestamp)
+{
+  unsigned int *const *p_buffer = &((struct output_finfo *)s0)->p_buffer[first];
+
+  if (timestamp==0) timestamp=1;
+
+  for (unsigned i = 0; i < n; i++) {
+    ofifo_t *s = (ofifo_t *)p_buffer[i * stride];
+    int rd = audio_output_fifo_ring_peek(&s->ring, s->mask);
+    unsigned int sample = 0;
+
+    if (rd >= 0) {
+      // No marker is AUDIO_OUTPUT_FIFO_NO_MARKER, which never matches an index
+      if ((unsigned) rd == s->marker && s->local_ts == 0)
+        s->local_ts = timestamp;
+      if (!s->zero_flag)
+        sample = s->fifo[rd];
+      audio_output_fifo_ring_consume(&s->ring);
     }
-    else {
-        // Overflow
+    else if (!s->zero_flag) {
+      s->ring.underflow_count++;
     }
+    samples[i] = sample;
   }
-
-  s->wrptr = wrptr;
-  s->sample_count+=count;
 }
 
 // 1722 thread
@@ -223,12 +505,12 @@ audio_output_fifo_handle_buf_ctl(chanend buf_ctl,
                         s->state == LOCKED,
                         s->ptp_ts,
                         s->local_ts,
-                        s->dptr - START_OF_FIFO(s),
-                        s->wrptr - START_OF_FIFO(s),
+                        audio_output_fifo_ring_fill(&s->ring, s->mask),
+                        s->mask ? s->mask + 1 : 0,
                         tmr);
       s->ptp_ts = 0;
       s->local_ts = 0;
-      s->marker = (unsigned int *) 0;
+      s->marker = AUDIO_OUTPUT_FIFO_NO_MARKER;
       break;
     }
     case BUF_CTL_REQUEST_NEW_STREAM_INFO: {
@@ -241,34 +523,29 @@ audio_output_fifo_handle_buf_ctl(chanend buf_ctl,
     case BUF_CTL_ADJUST_FILL:
       {
         int adjust;
-        unsigned int *new_wrptr;
         adjust = get_buf_ctl_adjust(buf_ctl);
 
-        new_wrptr = s->wrptr - adjust;
-        while (new_wrptr < START_OF_FIFO(s))
-          new_wrptr += (END_OF_FIFO(s) - START_OF_FIFO(s));
-
-        while (new_wrptr >= END_OF_FIFO(s))
-          new_wrptr -= (END_OF_FIFO(s) - START_OF_FIFO(s));
-
-        s->wrptr = new_wrptr;
+        // A FIFO disabled since the media clock server asked for its
+        // info has no storage to adjust
+        if (s->state != DISABLED) {
+          audio_output_fifo_ring_commit(&s->ring, -adjust);
+          s->state = LOCKED;
+          s->zero_flag = 0;
+        }
       }
-      s->state = LOCKED;
-      s->zero_flag = 0;
       s->ptp_ts = 0;
       s->local_ts = 0;
-      s->marker = (unsigned int *) 0;
+      s->marker = AUDIO_OUTPUT_FIFO_NO_MARKER;
       buf_ctl_ack(buf_ctl);
       *buf_ctl_notified = 0;
       break;
     case BUF_CTL_RESET:
-      s->state = ZEROING;
-      if (s->wrptr == START_OF_FIFO(s))
-        s->zero_marker = END_OF_FIFO(s) - 1;
-      else
-        s->zero_marker = s->wrptr - 1;
-      s->zero_flag = 1;
-      *s->zero_marker = 1;
+      if (s->state != DISABLED) {
+        s->state = ZEROING;
+        s->zero_marker = (s->ring.wr - 1) & s->mask;
+        s->zero_flag = 1;
+        s->fifo[s->zero_marker] = 1;
+      }
       buf_ctl_ack(buf_ctl);
       *buf_ctl_notified = 0;
       break;
@@ -289,3 +566,14 @@ audio_output_fifo_set_volume(buffer_handle_t s0,
 	  ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
 	  s->volume = volume;
 }
+
+void
+audio_output_fifo_get_xrun_counts(buffer_handle_t s0,
+                                  unsigned index,
+                                  unsigned *overflows,
+                                  unsigned *underflows)
+{
+  ofifo_t *s = (ofifo_t *)((struct output_finfo *)s0)->p_buffer[index];
+  *overflows = s->ring.overflow_count;
+  *underflows = AUDIO_OUTPUT_FIFO_RING_LOAD(s->ring.underflow_count);
+}
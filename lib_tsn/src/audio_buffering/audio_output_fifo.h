@@ -6,17 +6,49 @@
 #include <xc2compat.h>
 #include "default_avb_conf.h"
 #include "audio_buffering.h"
+#include "audio_output_fifo_ring.h"
 
 #ifndef AVB_MAX_AUDIO_SAMPLE_RATE
 #define AVB_MAX_AUDIO_SAMPLE_RATE (48000)
 #endif
 
+/** The largest number of words in a media output FIFO, a power of two. Each
+ *  FIFO is sized for its stream when it is enabled, up to this size. The
+ *  default is the smallest that holds AVB_MAX_AUDIO_SAMPLE_RATE/450 samples.
+ */
 #ifndef AUDIO_OUTPUT_FIFO_WORD_SIZE
-#define AUDIO_OUTPUT_FIFO_WORD_SIZE (AVB_MAX_AUDIO_SAMPLE_RATE/450)
+#if AVB_MAX_AUDIO_SAMPLE_RATE <= 450 * 64
+#define AUDIO_OUTPUT_FIFO_WORD_SIZE (64)
+#elif AVB_MAX_AUDIO_SAMPLE_RATE <= 450 * 128
+#define AUDIO_OUTPUT_FIFO_WORD_SIZE (128)
+#elif AVB_MAX_AUDIO_SAMPLE_RATE <= 450 * 256
+#define AUDIO_OUTPUT_FIFO_WORD_SIZE (256)
+#else
+#define AUDIO_OUTPUT_FIFO_WORD_SIZE (512)
+#endif
+#endif
+
+/** The smallest number of words in a media output FIFO, a power of two.
+ *  This is also the unit that FIFOs are allocated from the arena in.
+ */
+#ifndef AUDIO_OUTPUT_FIFO_MIN_WORDS
+#define AUDIO_OUTPUT_FIFO_MIN_WORDS (32)
 #endif
 
-#define START_OF_FIFO(s) ((unsigned int*)&((s)->fifo[0]))
-#define END_OF_FIFO(s)   ((unsigned int*)&((s)->fifo[AUDIO_OUTPUT_FIFO_WORD_SIZE]))
+/** The number of words of sample storage shared by all of the media output
+ *  FIFOs. The default allows every output to have a FIFO of the largest
+ *  size; if the outputs are not all used at AVB_MAX_AUDIO_SAMPLE_RATE at the
+ *  same time this can be reduced. It must be a multiple of
+ *  AUDIO_OUTPUT_FIFO_MIN_WORDS.
+ */
+#ifndef AUDIO_OUTPUT_FIFO_ARENA_WORDS
+#define AUDIO_OUTPUT_FIFO_ARENA_WORDS (AVB_NUM_MEDIA_OUTPUTS * AUDIO_OUTPUT_FIFO_WORD_SIZE)
+#endif
+
+#define AUDIO_OUTPUT_FIFO_ARENA_BLOCKS (AUDIO_OUTPUT_FIFO_ARENA_WORDS / AUDIO_OUTPUT_FIFO_MIN_WORDS)
+
+//! No marked sample in the FIFO
+#define AUDIO_OUTPUT_FIFO_NO_MARKER (0xffffffff)
 
 typedef enum ofifo_state_t {
   DISABLED, //!< Not active
@@ -27,44 +59,87 @@ typedef enum ofifo_state_t {
 
 
 struct audio_output_fifo_data_t {
-  int zero_flag;							//!< When set, the FIFO will output zero samples instead of its contents
-  unsigned int dptr;						//!< The read pointer
-  unsigned int wrptr;						//!< The write pointer
-  unsigned int marker;						//!< This indicates which sample is the one which the timestamps apply to
+  audio_output_fifo_ring_t ring;            //!< The read and write indices, written by the audio and 1722 threads respectively
   int local_ts;								//!< When a marked sample has played out, this contains the ref clock when it happened.
+  int zero_flag;							//!< When set, the FIFO will output zero samples instead of its contents
+  unsigned int marker;						//!< The index of the sample which the timestamps apply to, or AUDIO_OUTPUT_FIFO_NO_MARKER
   int ptp_ts;								//!< Contains the PTP timestamp of the marked sample.
   unsigned int sample_count;				//!< The count of samples that have passed through the buffer.
-  unsigned int zero_marker;					//!<
+  unsigned int zero_marker;					//!< The index of the last sample to be zeroed before locking
   ofifo_state_t state;						//!< State of the FIFO
   int last_notification_time;				//!< Last time that the clock recovery thread was informed of the timestamp info
   int media_clock;							//!<
   int pending_init_notification;			//!<
   int volume;                               //!< The linear volume multipler in 2.30 signed fixed point format
-  unsigned int fifo[AUDIO_OUTPUT_FIFO_WORD_SIZE];
+  unsigned int mask;                        //!< The FIFO size in words less one, 0 while no storage is allocated
+  unsigned int *unsafe fifo;                //!< The sample storage in the arena, only valid while mask is non-zero
 };
 
-typedef struct ofifo_t {
-  int zero_flag;
-  unsigned int *unsafe dptr;
-  unsigned int *unsafe wrptr;
-  unsigned int *unsafe marker;
-  int local_ts;
-  int ptp_ts;
-  unsigned int sample_count;
-  unsigned int *unsafe zero_marker;
-  ofifo_state_t state;
-  int last_notification_time;
-  int media_clock;
-  int pending_init_notification;
-  int volume;
-  unsigned int fifo[AUDIO_OUTPUT_FIFO_WORD_SIZE];
-} ofifo_t;
+typedef struct audio_output_fifo_data_t ofifo_t;
 
 /**
  * \brief This type provides the data structure used by a media output FIFO.
  */
 typedef struct audio_output_fifo_data_t audio_output_fifo_data_t;
 
+/**
+ * \brief The sample storage shared by the media output FIFOs
+ *
+ * FIFOs are allocated from the arena in units of AUDIO_OUTPUT_FIFO_MIN_WORDS
+ * words. The listener units that enable and disable FIFOs may run on
+ * different cores, so the allocation state is guarded by a hardware lock.
+ */
+typedef struct audio_output_fifo_arena_t {
+  hwlock_t lock;
+  unsigned int words_allocated;        //!< The words currently allocated to FIFOs
+  unsigned int words_high_water;       //!< The most words that have been allocated at once
+  unsigned int failed_allocations;     //!< The number of FIFOs that could not be enabled for lack of space
+  unsigned int used[(AUDIO_OUTPUT_FIFO_ARENA_BLOCKS + 31) / 32]; //!< A bit per allocation unit, set if it is in use
+  unsigned int words[AUDIO_OUTPUT_FIFO_ARENA_WORDS];
+} audio_output_fifo_arena_t;
+
+/**
+ * \brief A report of the memory used by the media output FIFOs
+ */
+typedef struct audio_output_fifo_memory_t {
+  unsigned int total_bytes;           //!< All of the memory of the FIFOs, the sum of the next two
+  unsigned int control_bytes;         //!< The memory of the per FIFO control structures
+  unsigned int arena_bytes;           //!< The memory of the shared sample storage
+  unsigned int allocated_bytes;       //!< The sample storage currently in use
+  unsigned int high_water_bytes;      //!< The most sample storage that has been in use at once
+  unsigned int failed_allocations;    //!< The number of FIFOs that could not be enabled for lack of space
+} audio_output_fifo_memory_t;
+
+/**
+ * \brief The output FIFOs fed by one 1722 listener stream
+ *
+ * Holds the mapped channels of a stream so that each received packet is
+ * handled in one pass over the FIFOs that are actually in use.
+ */
+typedef struct audio_output_fifo_group_t {
+  int num_fifos;                                                  //!< The number of mapped channels
+  audio_output_fifo_t fifo[AVB_MAX_CHANNELS_PER_LISTENER_STREAM]; //!< The FIFO of each mapped channel
+  int channel[AVB_MAX_CHANNELS_PER_LISTENER_STREAM];              //!< The payload channel of each, in ascending order
+} audio_output_fifo_group_t;
+
+/**
+ * \brief Build the FIFO group of a stream from its channel map
+ *
+ * \param g the group to fill in
+ * \param map the FIFO for each channel of the stream, negative if unmapped
+ * \param num_channels the number of channels in the stream
+ */
+void audio_output_fifo_group_init(REFERENCE_PARAM(audio_output_fifo_group_t, g),
+                                  const audio_output_fifo_t map[],
+                                  int num_channels);
+
+/**
+ * \brief Initialise the arena that the FIFOs of a buffer are allocated from
+ *
+ * Must be called once, before any FIFO of the buffer is enabled.
+ */
+void audio_output_fifo_arena_init(buffer_handle_t s);
+
 /**
  * \brief Intiialise a FIFO
  */
@@ -73,18 +148,41 @@ void audio_output_fifo_init(buffer_handle_t s, unsigned index);
 /**
  * \brief Disable a FIFO
  *
- * This prevents samples from flowing through the FIFO
+ * This prevents samples from flowing through the FIFO and returns its
+ * storage to the arena.
  */
 void disable_audio_output_fifo(buffer_handle_t s, unsigned index);
 
 /**
  * \brief Enable a FIFO
  *
- * This starts samples flowing through the FIFO
+ * This allocates storage for the FIFO and starts samples flowing through
+ * it. The FIFO is sized to hold the samples of the stream that are in
+ * flight for the presentation time plus two packets of jitter, rounded up
+ * to a power of two between AUDIO_OUTPUT_FIFO_MIN_WORDS and
+ * AUDIO_OUTPUT_FIFO_WORD_SIZE words. If the arena does not have the space
+ * the FIFO stays disabled and the failure is counted.
+ *
+ * \param s handle to FIFO buffers
+ * \param index which buffer to operate on
+ * \param media_clock the media clock that the FIFO is recovered against
+ * \param rate the sample rate of the stream in Hz
+ * \param presentation_ns the presentation time offset of the stream in nanoseconds
  */
 void enable_audio_output_fifo(buffer_handle_t s,
                               unsigned index,
-                              int media_clock);
+                              int media_clock,
+                              int rate,
+                              unsigned presentation_ns);
+
+/**
+ * \brief Get a report of the memory used by the FIFOs of a buffer
+ *
+ * \param s0 handle to FIFO buffers
+ * \param info set to the memory report
+ */
+void audio_output_fifo_get_memory(buffer_handle_t s0,
+                                  REFERENCE_PARAM(audio_output_fifo_memory_t, info));
 
 /**
  *  \brief Perform maintanance on the FIFO, called periodically
@@ -128,6 +226,59 @@ audio_output_fifo_strided_push(buffer_handle_t s0,
                                unsigned int *sample_ptr,
                                int stride,
                                int n);
+
+/**
+ *  \brief Push one channel of an AAF payload into the FIFO
+ *
+ *  Like audio_output_fifo_strided_push() but for the big endian PCM
+ *  samples of an IEEE 1722 AAF payload, which need not be word aligned.
+ *
+ *  \param s0 handle to FIFO buffers
+ *  \param index which buffer to operate on
+ *  \param sample_ptr a pointer to the first sample of the channel in the 1722 packet
+ *  \param stride the number of bytes between successive samples for this FIFO
+ *  \param n the number of samples to push into the buffer
+ *  \param sample_size the number of bytes per sample (2, 3 or 4)
+ */
+void
+audio_output_fifo_strided_push_aaf(buffer_handle_t s0,
+                                   unsigned index,
+                                   unsigned char *sample_ptr,
+                                   int stride,
+                                   int n,
+                                   int sample_size);
+
+/**
+ *  \brief Process one 1722 packet for all of the FIFOs of a stream
+ *
+ *  Equivalent to calling audio_output_fifo_set_ptp_timestamp() (if the
+ *  packet has a valid timestamp), audio_output_fifo_maintain() and then a
+ *  strided push for each FIFO in the group, but in a single pass.
+ *
+ *  \param s0 handle to FIFO buffers
+ *  \param g the FIFOs of the stream
+ *  \param timestamp_valid non-zero if the packet carries a presentation time
+ *  \param timestamp the 32 bit PTP timestamp
+ *  \param sample_number the sample in the packet which the timestamp applies to
+ *  \param buf_ctl a channel end that links the FIFOs to the media clock service
+ *  \param notified_buf_ctl pointer to the media clock notification flag
+ *  \param sample_ptr a pointer to the first sample of the packet payload
+ *  \param num_channels_in_payload the number of interleaved channels in the payload
+ *  \param n the number of samples per channel in the payload
+ *  \param sample_size the number of bytes per AAF sample, or 0 for 61883-6 quadlets
+ */
+void
+audio_output_fifo_group_push(buffer_handle_t s0,
+                             audio_output_fifo_group_t *g,
+                             int timestamp_valid,
+                             unsigned int timestamp,
+                             unsigned sample_number,
+                             chanend buf_ctl,
+                             int *notified_buf_ctl,
+                             unsigned char *sample_ptr,
+                             int num_channels_in_payload,
+                             int n,
+                             int sample_size);
 #endif
 
 
@@ -156,26 +307,22 @@ audio_output_fifo_pull_sample(buffer_handle_t s0,
 {
   ofifo_t *unsafe s = (ofifo_t *unsafe)((struct output_finfo *unsafe)s0)->p_buffer[index];
   unsigned int sample;
-  unsigned int *unsafe dptr = s->dptr;
+  int rd = audio_output_fifo_ring_peek(&s->ring, s->mask);
 
-  if (dptr == s->wrptr)
+  if (rd < 0)
   {
-    // Underflow
-    // printstrln("Media output FIFO underflow");
+    // Underflow, only counted while the FIFO is audible
+    if (!s->zero_flag)
+      s->ring.underflow_count++;
     return 0;
   }
 
-  sample = *dptr;
-  if (dptr == s->marker && s->local_ts == 0) {
+  sample = s->fifo[rd];
+  if ((unsigned) rd == s->marker && s->local_ts == 0) {
     if (timestamp==0) timestamp=1;
     s->local_ts = timestamp;
   }
-  dptr++;
-  if (dptr == END_OF_FIFO(s)) {
-    dptr = START_OF_FIFO(s);
-  }
-
-  s->dptr = dptr;
+  audio_output_fifo_ring_consume(&s->ring);
 
   if (s->zero_flag)
     sample = 0;
@@ -184,6 +331,29 @@ audio_output_fifo_pull_sample(buffer_handle_t s0,
 }
 
 
+/**
+ *  \brief Used by the audio output system to pull one sample from each of a
+ *         set of FIFOs
+ *
+ *  Equivalent to calling audio_output_fifo_pull_sample() for FIFOs
+ *  ``first``, ``first + stride``, ... in turn, but in one call. With a
+ *  stride of 1 this pulls a whole frame, with a stride of the number of TDM
+ *  slots per line it pulls one slot of every line.
+ *
+ *  \param s0 handle to FIFO buffers
+ *  \param samples the array to write the ``n`` samples to
+ *  \param first the first FIFO to pull from
+ *  \param stride the difference between successive FIFO indices
+ *  \param n the number of FIFOs to pull from
+ *  \param timestamp the ref clock time of the sample playout
+ */
+void audio_output_fifo_pull_frame(buffer_handle_t s0,
+                                  int32_t samples[],
+                                  unsigned first,
+                                  unsigned stride,
+                                  unsigned n,
+                                  unsigned int timestamp);
+
 /**
  *  \brief Set the PTP timestamp on a specific sample in the buffer
  *
@@ -229,6 +399,20 @@ audio_output_fifo_handle_buf_ctl(chanend buf_ctl,
                                  REFERENCE_PARAM(int, buf_ctl_notified),
                                  timer tmr);
 
+/**
+ *  \brief Get the overflow and underflow counts of a FIFO
+ *
+ *  \param s0 handle to FIFO buffers
+ *  \param index which buffer to operate on
+ *  \param overflows set to the number of samples dropped because the FIFO was full
+ *  \param underflows set to the number of samples pulled while the FIFO was empty and unmuted
+ */
+void
+audio_output_fifo_get_xrun_counts(buffer_handle_t s0,
+                                  unsigned index,
+                                  REFERENCE_PARAM(unsigned, overflows),
+                                  REFERENCE_PARAM(unsigned, underflows));
+
 /**
  *  \brief Set the volume control multiplier for the media FIFO
  *
@@ -0,0 +1,132 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file audio_output_fifo_ring.h
+ * \brief Single producer, single consumer index ring of the media output FIFOs
+ *
+ * The 1722 listener (producer) and the audio output thread (consumer) share
+ * each output FIFO without locks. The producer only ever writes the write
+ * index and the consumer only ever writes the read index, so each side can
+ * work out the fill from a read of the other side's index. The ring size is
+ * a power of two. The indices run freely and are masked only to address the
+ * storage, so the producer can empty the ring and give it storage of another
+ * size without either index being reset. One slot is always left empty so
+ * that a full ring can be told from an empty one.
+ *
+ * This header has no dependencies beyond the C or XC compiler so that the
+ * ring can also be built and stress tested on a host.
+ */
+#ifndef __AUDIO_OUTPUT_FIFO_RING_H__
+#define __AUDIO_OUTPUT_FIFO_RING_H__
+
+#include <xc2compat.h>
+
+#if defined(__XC__) || defined(__XS1B__) || defined(__XS2A__)
+#define AUDIO_OUTPUT_FIFO_RING_XCORE 1
+#else
+#define AUDIO_OUTPUT_FIFO_RING_XCORE 0
+#endif
+
+/** The cache line size in words that the producer and consumer indices are
+ *  kept apart by. xCORE memory has no data cache, so there only the index
+ *  words themselves are kept.
+ */
+#ifndef AUDIO_OUTPUT_FIFO_RING_LINE_WORDS
+#if AUDIO_OUTPUT_FIFO_RING_XCORE
+#define AUDIO_OUTPUT_FIFO_RING_LINE_WORDS 2
+#else
+#define AUDIO_OUTPUT_FIFO_RING_LINE_WORDS 16
+#endif
+#endif
+
+#if AUDIO_OUTPUT_FIFO_RING_XCORE
+#define AUDIO_OUTPUT_FIFO_RING_ALIGNED
+#else
+#define AUDIO_OUTPUT_FIFO_RING_ALIGNED __attribute__((aligned(AUDIO_OUTPUT_FIFO_RING_LINE_WORDS * 4)))
+#endif
+
+#if AUDIO_OUTPUT_FIFO_RING_LINE_WORDS < 2
+#error AUDIO_OUTPUT_FIFO_RING_LINE_WORDS must be at least 2
+#endif
+
+/* Reads of the other side's index and writes of a side's own index. On
+ * xCORE a thread's stores are seen by other threads in program order, on
+ * hosts the index accesses are atomic and order the sample data around them.
+ */
+#if AUDIO_OUTPUT_FIFO_RING_XCORE
+#define AUDIO_OUTPUT_FIFO_RING_LOAD(x)     (x)
+#define AUDIO_OUTPUT_FIFO_RING_STORE(x, v) ((x) = (v))
+#else
+#define AUDIO_OUTPUT_FIFO_RING_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define AUDIO_OUTPUT_FIFO_RING_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#endif
+
+/** 1 if n is a non-zero power of two */
+#define AUDIO_OUTPUT_FIFO_RING_POW2(n) ((n) != 0 && ((n) & ((n) - 1)) == 0)
+
+typedef struct audio_output_fifo_ring_t {
+  // Written by the consumer only
+  unsigned int rd;                //!< The read index
+  unsigned int underflow_count;   //!< Reads that found the ring empty and mattered to the consumer
+#if AUDIO_OUTPUT_FIFO_RING_LINE_WORDS > 2
+  unsigned int consumer_pad[AUDIO_OUTPUT_FIFO_RING_LINE_WORDS - 2];
+#endif
+  // Written by the producer only
+  unsigned int wr;                //!< The write index
+  unsigned int overflow_count;    //!< Words dropped because the ring was full
+#if AUDIO_OUTPUT_FIFO_RING_LINE_WORDS > 2
+  unsigned int producer_pad[AUDIO_OUTPUT_FIFO_RING_LINE_WORDS - 2];
+#endif
+} AUDIO_OUTPUT_FIFO_RING_ALIGNED audio_output_fifo_ring_t;
+
+unsafe static inline void
+audio_output_fifo_ring_init(audio_output_fifo_ring_t *unsafe r)
+{
+  r->rd = 0;
+  r->wr = 0;
+  r->underflow_count = 0;
+  r->overflow_count = 0;
+}
+
+/** The number of words in the ring. Exact when called by either side, a
+ *  lower bound of the consumer's view when called by the producer.
+ */
+unsafe static inline unsigned int
+audio_output_fifo_ring_fill(audio_output_fifo_ring_t *unsafe r, unsigned int mask)
+{
+  return (AUDIO_OUTPUT_FIFO_RING_LOAD(r->wr) - AUDIO_OUTPUT_FIFO_RING_LOAD(r->rd)) & mask;
+}
+
+/** Producer: the number of words that can be written */
+unsafe static inline unsigned int
+audio_output_fifo_ring_space(audio_output_fifo_ring_t *unsafe r, unsigned int mask)
+{
+  return (AUDIO_OUTPUT_FIFO_RING_LOAD(r->rd) - r->wr - 1) & mask;
+}
+
+/** Producer: publish n words written from the write index onwards */
+unsafe static inline void
+audio_output_fifo_ring_commit(audio_output_fifo_ring_t *unsafe r, unsigned int n)
+{
+  AUDIO_OUTPUT_FIFO_RING_STORE(r->wr, r->wr + n);
+}
+
+/** Consumer: the storage index of the next word, or -1 if the ring is empty */
+unsafe static inline int
+audio_output_fifo_ring_peek(audio_output_fifo_ring_t *unsafe r, unsigned int mask)
+{
+  unsigned int rd = r->rd;
+
+  if (rd == AUDIO_OUTPUT_FIFO_RING_LOAD(r->wr))
+    return -1;
+
+  return rd & mask;
+}
+
+/** Consumer: release the word returned by audio_output_fifo_ring_peek() */
+unsafe static inline void
+audio_output_fifo_ring_consume(audio_output_fifo_ring_t *unsafe r)
+{
+  AUDIO_OUTPUT_FIFO_RING_STORE(r->rd, r->rd + 1);
+}
+
+#endif
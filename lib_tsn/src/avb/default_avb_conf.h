@@ -50,6 +50,22 @@
 #define AVB_1722_FORMAT_61883_6 1
 #endif
 
+/** Enable IEEE 1722 AAF streams (``AVB_FORMAT_AAF_INT16/24/32``) alongside
+ *  61883-6. Off by default to save code space. */
+#ifndef AVB_1722_FORMAT_AAF
+#define AVB_1722_FORMAT_AAF 0
+#endif
+
+/** Start 61883-6 listener streams with the channel count and sample rate
+ *  they were configured with (by 1722.1 SET_STREAM_FORMAT or the
+ *  application), so audio plays from the first packet instead of after the
+ *  channel count has been inferred from 16 packets. The DBC of each packet is
+ *  still checked against that format, and the listener falls back to
+ *  inferring it if they keep disagreeing. */
+#ifndef AVB_1722_LISTENER_PRESEED_FORMAT
+#define AVB_1722_LISTENER_PRESEED_FORMAT 1
+#endif
+
 #ifndef AVB_NUM_MEDIA_UNITS
 #define AVB_NUM_MEDIA_UNITS 1
 #endif
@@ -58,6 +74,13 @@
 #define AVB_NUM_MEDIA_CLOCKS 1
 #endif
 
+/** The servo that stream derived media clocks start with, see
+ *  media_clock_servo_type_t. It can be changed per clock at run time with
+ *  set_device_media_clock_servo(). */
+#ifndef AVB_MEDIA_CLOCK_SERVO
+#define AVB_MEDIA_CLOCK_SERVO MEDIA_CLOCK_SERVO_ACQUIRE_TRACK
+#endif
+
 #ifndef AVB_MAX_AUDIO_SAMPLE_RATE
 #define AVB_MAX_AUDIO_SAMPLE_RATE 48000
 #endif
@@ -37,8 +37,8 @@ void send_buf_ctl_info(chanend buf_ctl,
                        int active,
                        unsigned int ptp_ts,
                        unsigned int local_ts,
-                       unsigned int rdptr,
-                       unsigned int wrptr,
+                       unsigned int fill,
+                       unsigned int size,
                        timer tmr);
 
 void send_buf_ctl_new_stream_info(chanend buf_ctl,
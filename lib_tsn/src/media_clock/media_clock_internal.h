@@ -36,6 +36,93 @@ typedef struct media_clock_t {
 // The number of ticks between period clock recovery checks
 #define CLOCK_RECOVERY_PERIOD  (1<<21)
 
+// Media output FIFO lock thresholds, in buffer info reports or samples
+#ifndef STABLE_THRESHOLD
+#define STABLE_THRESHOLD 32
+#endif
+#ifndef LOCK_COUNT_THRESHOLD
+#define LOCK_COUNT_THRESHOLD 400
+#endif
+#ifndef ACCEPTABLE_FILL_ADJUST
+#define ACCEPTABLE_FILL_ADJUST 50000
+#endif
+#ifndef LOST_LOCK_THRESHOLD
+#define LOST_LOCK_THRESHOLD 24
+#endif
+#ifndef MIN_FILL_LEVEL
+#define MIN_FILL_LEVEL 5
+#endif
+#define MAX_SAMPLES_PER_1722_PACKET (AVB_MAX_AUDIO_SAMPLE_RATE/AVB1722_PACKET_RATE)
+
+// Force unlocking if there is a large step change of word length during "debouncing" period
+// (improve handling of grandmaster transitions)
+#ifndef UNLOCK_ON_LARGE_DIFF_CHANGE
+#define UNLOCK_ON_LARGE_DIFF_CHANGE 0
+#endif
+#define LOST_LOCK_THRESHOLD_LARGE 10000
+
+// Default MEDIA_CLOCK_SERVO_ACQUIRE_TRACK parameters, see media_clock_servo_t
+#ifndef MEDIA_CLOCK_SERVO_ACQUIRE_GAIN
+#define MEDIA_CLOCK_SERVO_ACQUIRE_GAIN 32768
+#endif
+#ifndef MEDIA_CLOCK_SERVO_TRACK_FREQ_GAIN
+#define MEDIA_CLOCK_SERVO_TRACK_FREQ_GAIN 8192
+#endif
+#ifndef MEDIA_CLOCK_SERVO_TRACK_PHASE_GAIN
+#define MEDIA_CLOCK_SERVO_TRACK_PHASE_GAIN 1024
+#endif
+#ifndef MEDIA_CLOCK_SERVO_ERROR_FILTER_SHIFT
+#define MEDIA_CLOCK_SERVO_ERROR_FILTER_SHIFT 2
+#endif
+#ifndef MEDIA_CLOCK_SERVO_TRACK_THRESHOLD_NS
+#define MEDIA_CLOCK_SERVO_TRACK_THRESHOLD_NS 200
+#endif
+#ifndef MEDIA_CLOCK_SERVO_TRACK_COUNT
+#define MEDIA_CLOCK_SERVO_TRACK_COUNT 4
+#endif
+
+/** Set a servo to AVB_MEDIA_CLOCK_SERVO with the default parameters */
+void media_clock_servo_init(REFERENCE_PARAM(media_clock_servo_t, servo));
+
+/** The media clock server's view of a media output FIFO */
+typedef struct buf_info_t {
+  int lock_count;
+  int prev_diff;
+  int stability_count;
+  int media_clock;
+  int fifo;
+} buf_info_t;
+
+/** The outcome of a buffer info report from a media output FIFO */
+typedef enum media_clock_buf_action_t {
+  MEDIA_CLOCK_BUF_NONE,             //!< Nothing to do, acknowledge the report
+  MEDIA_CLOCK_BUF_LOCK,             //!< Adjust the fill by the sample difference and lock
+  MEDIA_CLOCK_BUF_ADJUST_TOO_LARGE, //!< The adjustment would not fit in the FIFO, reset it
+  MEDIA_CLOCK_BUF_LOST_LOCK,        //!< A locked FIFO has drifted out of range or run nearly empty, reset it
+  MEDIA_CLOCK_BUF_LOST_LOCK_LARGE,  //!< A FIFO has seen a large step in presentation time, reset it
+} media_clock_buf_action_t;
+
+/** Decide what to do with a media output FIFO from a buffer info report.
+ *
+ *  \param b           the server's state for the FIFO, updated
+ *  \param word_length the word length of the FIFO's media clock, 0 if it has none yet
+ *  \param rate        the sample rate of the FIFO's media clock in Hz
+ *  \param diff        the PTP time that the marked sample played out less its presentation time, in ns
+ *  \param fifo_locked non-zero if the FIFO has been locked
+ *  \param fill        the number of samples in the FIFO
+ *  \param fifo_size   the size of the FIFO in samples
+ *  \param sample_diff set to diff in samples at the given rate, the fill
+ *                     adjustment for MEDIA_CLOCK_BUF_LOCK
+ */
+media_clock_buf_action_t media_clock_manage_buffer(REFERENCE_PARAM(buf_info_t, b),
+                                                   unsigned int word_length,
+                                                   int rate,
+                                                   int diff,
+                                                   int fifo_locked,
+                                                   int fill,
+                                                   int fifo_size,
+                                                   REFERENCE_PARAM(int, sample_diff));
+
 void init_media_clock_recovery(NULLABLE_RESOURCE(chanend,ptp_svr),
                                        int clock_info,
                                        unsigned int clk_time,
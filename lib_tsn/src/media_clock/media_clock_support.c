@@ -4,6 +4,7 @@
 #include "xassert.h"
 #include "gptp.h"
 #include "avb_1722_def.h"
+#include "avb_1722_format.h"
 #include "print.h"
 #include "media_clock_internal.h"
 #include "media_clock_client.h"
@@ -13,6 +14,19 @@
 // worldlen representation.  The max percision is 26 bits before the PTP clock recovery multiplcation overflows
 #define WORDLEN_FRACTIONAL_BITS 24
 
+// The fractional bits of the filtered presentation time error, in ns
+#define SERVO_ERROR_FRACTIONAL_BITS 8
+
+// A change of presentation time error faster than this is a discontinuity, a
+// FIFO fill adjustment or a PTP step, rather than a frequency error. It is
+// well beyond the talker and listener crystal tolerances added together.
+#define SERVO_MAX_PPM 500
+
+enum media_clock_servo_stage_t {
+	SERVO_ACQUIRE,
+	SERVO_TRACK
+};
+
 /**
  *  \brief Records the state of the media stream
  *
@@ -39,6 +53,11 @@ typedef struct clock_info_t {
 	int first;
 	stream_info_t stream_info1;
 	stream_info_t stream_info2;
+	media_clock_servo_t servo;     // The servo the state below was built up with
+	int stage;                     // ACQUIRE_TRACK acquisition or tracking
+	int stage_count;               // Updates in a row that met the tracking threshold
+	int error;                     // The last presentation time error in ns
+	long long ferror;              // The filtered error in ns << SERVO_ERROR_FRACTIONAL_BITS
 } clock_info_t;
 
 /// The array of media clock state structures
@@ -53,7 +72,8 @@ static unsigned int local_wordlen_to_external_wordlen(unsigned long long w) {
 
 static unsigned long long calculate_wordlen(unsigned int sample_rate) {
 	const unsigned long long nanoseconds = (100000000LL << WORDLEN_FRACTIONAL_BITS);
-	/* Calculate what master clock we should be using */
+	/* Calculate what master clock we should be using. Rates below 44.1kHz
+	   are in avb1722_formats[] but have no media clock. */
 	if ((sample_rate % 48000) == 0) {
 	    return (nanoseconds / 48000);
 	}
@@ -82,6 +102,20 @@ void init_media_clock_recovery(chanend ptp_svr,
 
 	clock_info->stream_info1.valid = 0;
 	clock_info->stream_info2.valid = 0;
+
+	clock_info->servo.type = MEDIA_CLOCK_SERVO_PI;
+	clock_info->stage = SERVO_ACQUIRE;
+	clock_info->stage_count = 0;
+}
+
+void media_clock_servo_init(media_clock_servo_t *servo) {
+	servo->type = AVB_MEDIA_CLOCK_SERVO;
+	servo->acquire_gain = MEDIA_CLOCK_SERVO_ACQUIRE_GAIN;
+	servo->track_freq_gain = MEDIA_CLOCK_SERVO_TRACK_FREQ_GAIN;
+	servo->track_phase_gain = MEDIA_CLOCK_SERVO_TRACK_PHASE_GAIN;
+	servo->error_filter_shift = MEDIA_CLOCK_SERVO_ERROR_FILTER_SHIFT;
+	servo->track_threshold_ns = MEDIA_CLOCK_SERVO_TRACK_THRESHOLD_NS;
+	servo->track_count = MEDIA_CLOCK_SERVO_TRACK_COUNT;
 }
 
 void update_media_clock_stream_info(int clock_index,
@@ -103,10 +137,94 @@ void update_media_clock_stream_info(int clock_index,
 void inform_media_clock_of_lock(int clock_index) {
 	clock_info_t *clock_info = &clock_states[clock_index];
 	clock_info->stream_info2.valid = 0;
+	// The fill adjustment steps the presentation time error
+	clock_info->first = 1;
 }
 
 #define MAX_ERROR_TOLERANCE 100
 
+static int servo_changed(const media_clock_servo_t *a, const media_clock_servo_t *b) {
+	return a->type != b->type ||
+	       a->acquire_gain != b->acquire_gain ||
+	       a->track_freq_gain != b->track_freq_gain ||
+	       a->track_phase_gain != b->track_phase_gain ||
+	       a->error_filter_shift != b->error_filter_shift ||
+	       a->track_threshold_ns != b->track_threshold_ns ||
+	       a->track_count != b->track_count;
+}
+
+/**
+ * \brief The word length change that corrects an error of err ns, in
+ *        ns << SERVO_ERROR_FRACTIONAL_BITS, over diff_local ticks
+ *
+ * It is wordlen * err / (diff_local * 10) in wordlen units, worked out in
+ * two steps so that it does not overflow.
+ */
+static long long servo_correction(unsigned long long wordlen, long long err, long long diff_local) {
+	long long num = err * (long long) (wordlen >> WORDLEN_FRACTIONAL_BITS);
+	long long den = diff_local * 10;
+	const int shift = WORDLEN_FRACTIONAL_BITS - SERVO_ERROR_FRACTIONAL_BITS;
+
+	return ((num / den) << shift) + (((num % den) << shift) / den);
+}
+
+/**
+ * \brief One update of the MEDIA_CLOCK_SERVO_ACQUIRE_TRACK servo
+ *
+ * Acquisition only corrects the frequency, the change in the presentation
+ * time error, and runs whether or not the FIFO is locked. Once the FIFO is
+ * locked and the frequency has settled it hands over to tracking, which
+ * corrects frequency and phase with lower gains. The word length is kept
+ * when the FIFO loses lock so that a new source starts from the last
+ * frequency rather than the nominal one.
+ */
+static void update_acquire_track(clock_info_t *clock_info, const media_clock_servo_t *servo) {
+	long long diff_local = clock_info->stream_info2.local_ts - clock_info->stream_info1.local_ts;
+	int error = (signed) clock_info->stream_info2.outgoing_ptp_ts -
+	            (signed) clock_info->stream_info2.presentation_ts;
+	long long ferror, delta, correction;
+	int step = error - clock_info->error;
+
+	clock_info->error = error;
+
+	if (!clock_info->stream_info2.locked)
+		clock_info->stage = SERVO_ACQUIRE;
+
+	if (diff_local <= 0 || clock_info->first ||
+	    (long long) (step < 0 ? -step : step) * 100000 > diff_local * SERVO_MAX_PPM) {
+		// Start the filter again from here
+		clock_info->ferror = (long long) error << SERVO_ERROR_FRACTIONAL_BITS;
+		clock_info->stage_count = 0;
+		clock_info->first = 0;
+		return;
+	}
+
+	ferror = (long long) error << SERVO_ERROR_FRACTIONAL_BITS;
+	if (servo->error_filter_shift > 0)
+		ferror = clock_info->ferror + ((ferror - clock_info->ferror) >> servo->error_filter_shift);
+	delta = ferror - clock_info->ferror;
+	clock_info->ferror = ferror;
+
+	correction = servo_correction(clock_info->wordlen, delta, diff_local);
+
+	if (clock_info->stage == SERVO_ACQUIRE) {
+		clock_info->wordlen -= (correction * servo->acquire_gain) >> 16;
+
+		if (clock_info->stream_info2.locked &&
+		    (delta < 0 ? -delta : delta) < ((long long) servo->track_threshold_ns << SERVO_ERROR_FRACTIONAL_BITS)) {
+			clock_info->stage_count++;
+			if (clock_info->stage_count >= servo->track_count)
+				clock_info->stage = SERVO_TRACK;
+		} else {
+			clock_info->stage_count = 0;
+		}
+	} else {
+		correction = correction * servo->track_freq_gain +
+		             servo_correction(clock_info->wordlen, ferror, diff_local) * servo->track_phase_gain;
+		clock_info->wordlen -= correction >> 16;
+	}
+}
+
 unsigned int update_media_clock(chanend ptp_svr,
 								int clock_index,
 								const media_clock_t *mclock,
@@ -136,8 +254,21 @@ unsigned int update_media_clock(chanend ptp_svr,
 			return local_wordlen_to_external_wordlen(clock_info->wordlen);
 		}
 
+		if (servo_changed(&mclock->info.servo, &clock_info->servo)) {
+			clock_info->servo = mclock->info.servo;
+			clock_info->stage = SERVO_ACQUIRE;
+			clock_info->stage_count = 0;
+			clock_info->first = 1;
+			clock_info->ierror = 0;
+		}
+
+		if (clock_info->servo.type == MEDIA_CLOCK_SERVO_ACQUIRE_TRACK) {
+			update_acquire_track(clock_info, &clock_info->servo);
+			clock_info->stream_info1 = clock_info->stream_info2;
+			clock_info->stream_info2.valid = 0;
+
 		// If the stream is unlocked, return the default clock rate
-		if (!clock_info->stream_info2.locked) {
+		} else if (!clock_info->stream_info2.locked) {
 			clock_info->wordlen = calculate_wordlen(clock_info->rate);
 			clock_info->stream_info1 = clock_info->stream_info2;
 			clock_info->stream_info2.valid = 0;
@@ -181,3 +312,68 @@ unsigned int update_media_clock(chanend ptp_svr,
 	return local_wordlen_to_external_wordlen(clock_info->wordlen);
 }
 
+#if (AVB_NUM_MEDIA_OUTPUTS != 0)
+media_clock_buf_action_t media_clock_manage_buffer(buf_info_t *b,
+                                                   unsigned int word_length,
+                                                   int rate,
+                                                   int diff,
+                                                   int fifo_locked,
+                                                   int fill,
+                                                   int fifo_size,
+                                                   int *sample_diff)
+{
+	media_clock_buf_action_t action = MEDIA_CLOCK_BUF_NONE;
+	int d;
+	int format = avb1722_format_from_rate(rate);
+	int base_rate = format < 0 ? rate : avb1722_formats[format].base_rate;
+
+	// clock not locked yet
+	if (word_length == 0 || rate == 0)
+		return MEDIA_CLOCK_BUF_NONE;
+
+	// The word length is per sample at the base rate, the FIFO's are per
+	// sample at the stream rate
+	d = ((long long) diff * rate) /
+	    ((long long) ((word_length*10) >> WC_FRACTIONAL_BITS) * base_rate);
+	*sample_diff = d;
+
+	if (fifo_locked && b->lock_count < LOCK_COUNT_THRESHOLD) {
+		b->lock_count++;
+	}
+
+	if (d < ACCEPTABLE_FILL_ADJUST &&
+	    d > -ACCEPTABLE_FILL_ADJUST &&
+	    (d - b->prev_diff <= 1 &&
+	     d - b->prev_diff >= -1)) {
+		b->stability_count++;
+	} else {
+		b->stability_count = 0;
+	}
+
+	if (!fifo_locked && (b->stability_count > STABLE_THRESHOLD)) {
+		int max_adjust = fifo_size - MAX_SAMPLES_PER_1722_PACKET;
+		if (fill - d > max_adjust ||
+		    fill - d < -max_adjust) {
+			action = MEDIA_CLOCK_BUF_ADJUST_TOO_LARGE;
+		} else {
+			b->lock_count = 0;
+			action = MEDIA_CLOCK_BUF_LOCK;
+		}
+	} else if (fifo_locked &&
+	           b->lock_count == LOCK_COUNT_THRESHOLD &&
+	           (d > LOST_LOCK_THRESHOLD ||
+	            d < -LOST_LOCK_THRESHOLD ||
+	            fill < MIN_FILL_LEVEL)) {
+		action = MEDIA_CLOCK_BUF_LOST_LOCK;
+	}
+#if UNLOCK_ON_LARGE_DIFF_CHANGE
+	else if (fifo_locked &&
+	         (d > LOST_LOCK_THRESHOLD_LARGE || d < -LOST_LOCK_THRESHOLD_LARGE)) {
+		action = MEDIA_CLOCK_BUF_LOST_LOCK_LARGE;
+	}
+#endif
+
+	b->prev_diff = d;
+	return action;
+}
+#endif
@@ -0,0 +1,75 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include <string.h>
+#include "gptp_capture.h"
+
+#if PTP_CAPTURE_RECORDS
+
+void ptp_capture_init(ptp_capture_t *c)
+{
+  memset(c, 0, sizeof(*c));
+}
+
+static ptp_capture_record_t *next_record(ptp_capture_t *c, int type,
+                                         int port, unsigned seq_id)
+{
+  ptp_capture_record_t *r = &c->records[c->count % PTP_CAPTURE_RECORDS];
+
+  memset(r, 0, sizeof(*r));
+  r->index = c->count++;
+  r->type = type;
+  r->port = port;
+  r->seq_id = seq_id;
+  return r;
+}
+
+void ptp_capture_sync(ptp_capture_t *c,
+                      int port, unsigned seq_id,
+                      unsigned local_ingress_ts,
+                      const ptp_timestamp *master_egress_ts,
+                      int discarded, int ptp_adjust, unsigned pdelay)
+{
+  ptp_capture_record_t *r = next_record(c, PTP_CAPTURE_SYNC, port, seq_id);
+
+  r->local_ts[0] = local_ingress_ts;
+  r->master_ts[0] = *master_egress_ts;
+  r->discarded = discarded;
+  r->ptp_adjust = ptp_adjust;
+  r->pdelay = pdelay;
+}
+
+void ptp_capture_pdelay(ptp_capture_t *c,
+                        int port, unsigned seq_id,
+                        unsigned local_egress_ts,
+                        unsigned local_ingress_ts,
+                        const ptp_timestamp *master_ingress_ts,
+                        const ptp_timestamp *master_egress_ts,
+                        int discarded, int ptp_adjust, unsigned pdelay)
+{
+  ptp_capture_record_t *r = next_record(c, PTP_CAPTURE_PDELAY, port, seq_id);
+
+  r->local_ts[0] = local_egress_ts;
+  r->local_ts[1] = local_ingress_ts;
+  r->master_ts[0] = *master_ingress_ts;
+  r->master_ts[1] = *master_egress_ts;
+  r->discarded = discarded;
+  r->ptp_adjust = ptp_adjust;
+  r->pdelay = pdelay;
+}
+
+unsigned ptp_capture_first(const ptp_capture_t *c, unsigned next, unsigned *n)
+{
+  unsigned oldest = c->count > PTP_CAPTURE_RECORDS ? c->count - PTP_CAPTURE_RECORDS : 0;
+  unsigned available;
+
+  // Start from the oldest if next has been overwritten or is not yet
+  // captured, as after the server restarts
+  if (next - oldest > c->count - oldest)
+    next = oldest;
+  available = c->count - next;
+  if (*n > available)
+    *n = available;
+  return next;
+}
+
+#endif
@@ -0,0 +1,58 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file gptp_capture.h
+ * \brief A ring of the PTP server's last Sync and Pdelay exchanges
+ *
+ * Every Sync/Follow_Up pair and every completed Pdelay exchange is
+ * recorded with its raw timestamps and the adjust and path delay that
+ * resulted, at the cost of a copy per message rather than the timing
+ * disturbance of printing. Clients read the ring with ptp_get_capture(),
+ * or it can be dumped from a debugger as the ptp_capture variable, and
+ * tests/gptp_servo replays either kind of dump through the servo.
+ */
+#ifndef __gptp_capture_h__
+#define __gptp_capture_h__
+
+#include <xccompat.h>
+#include "default_avb_conf.h"
+#include "gptp.h"
+
+/** The number of records the PTP server keeps, 0 to capture nothing */
+#ifndef PTP_CAPTURE_RECORDS
+#define PTP_CAPTURE_RECORDS 32
+#endif
+
+#if PTP_CAPTURE_RECORDS
+
+typedef struct ptp_capture_t {
+  unsigned int count;  ///< Records captured, the next goes in count % PTP_CAPTURE_RECORDS
+  ptp_capture_record_t records[PTP_CAPTURE_RECORDS];
+} ptp_capture_t;
+
+void ptp_capture_init(REFERENCE_PARAM(ptp_capture_t, c));
+
+/** Record a Sync/Follow_Up pair */
+void ptp_capture_sync(REFERENCE_PARAM(ptp_capture_t, c),
+                      int port, unsigned seq_id,
+                      unsigned local_ingress_ts,
+                      REFERENCE_PARAM(const ptp_timestamp, master_egress_ts),
+                      int discarded, int ptp_adjust, unsigned pdelay);
+
+/** Record a Pdelay exchange */
+void ptp_capture_pdelay(REFERENCE_PARAM(ptp_capture_t, c),
+                        int port, unsigned seq_id,
+                        unsigned local_egress_ts,
+                        unsigned local_ingress_ts,
+                        REFERENCE_PARAM(const ptp_timestamp, master_ingress_ts),
+                        REFERENCE_PARAM(const ptp_timestamp, master_egress_ts),
+                        int discarded, int ptp_adjust, unsigned pdelay);
+
+/** The number of the oldest record at or after next that is still in the
+ *  ring, and in n how many records from it are available up to n */
+unsigned ptp_capture_first(REFERENCE_PARAM(const ptp_capture_t, c),
+                           unsigned next,
+                           REFERENCE_PARAM(unsigned, n));
+
+#endif
+
+#endif // __gptp_capture_h__
@@ -48,13 +48,6 @@
 
 #define RECV_ANNOUNCE_TIMEOUT (PTP_ANNOUNCE_RECEIPT_TIMEOUT_MULTIPLE * ANNOUNCE_PERIOD)
 
-#define PTP_SYNC_LOCK_ACCEPTABLE_VARIATION 0x100000
-#define PTP_SYNC_LOCK_STABILITY_COUNT 5
-
-#ifndef PTP_THROW_AWAY_SYNC_OUTLIERS
-#define PTP_THROW_AWAY_SYNC_OUTLIERS 0
-#endif
-
 #define PTP_ALLOWED_LOST_RESPONSES 3
 
 #define PTP_NEIGHBOR_PROP_DELAY_THRESH_NS 800
@@ -11,7 +11,8 @@ enum ptp_cmd_t {
   PTP_GET_TIME_INFO_MOD64,
   PTP_GET_GRANDMASTER,
   PTP_GET_STATE,
-  PTP_GET_PDELAY
+  PTP_GET_PDELAY,
+  PTP_GET_CAPTURE
 };
 
 typedef enum ptp_port_role_t {
@@ -29,6 +30,13 @@ typedef struct ptp_path_delay_t {
   unsigned int multiple_resp_count;
   unsigned int last_multiple_resp_seq_id;
   n80_t rcvd_source_identity;
+  unsigned int outliers;
+  int outlier_run;
+  int neighbor_rate_ratio;      // The peer's clock rate over ours less 1, to PTP_ADJUST_PREC
+  int neighbor_rate_ratio_valid;
+  int prev_resp_valid;
+  unsigned int prev_resp_ingress_ts;
+  ptp_timestamp prev_resp_egress_ts;
 } ptp_path_delay_t;
 
 typedef struct ptp_port_info_t {
@@ -117,6 +125,10 @@ void ptp_periodic(CLIENT_INTERFACE(ethernet_tx_if, i_eth), unsigned);
 
 void ptp_get_local_time_info_mod64(REFERENCE_PARAM(ptp_time_info_mod64,info));
 
+/** Publish the server's time information for ptp_get_time_snapshot_mod64().
+ *  Only the PTP server may call this. */
+void ptp_time_snapshot_publish(REFERENCE_PARAM(ptp_time_info_mod64, info));
+
 void ptp_output_test_clock(chanend ptp_link,
                            port test_clock_port,
                            int period);
@@ -0,0 +1,34 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include <limits.h>
+#include "gptp_relay.h"
+#include "gptp_time.h"
+
+int ptp_relay_rate_offset(int upstream_rate_offset, int neighbor_rate_ratio)
+{
+  // (1 + upstream) * (1 + neighbor) - 1 at 2^41
+  long long offset = (long long) upstream_rate_offset +
+                     ((long long) neighbor_rate_ratio << (PTP_RATE_OFFSET_PREC - PTP_ADJUST_PREC)) +
+                     (((long long) upstream_rate_offset * neighbor_rate_ratio) >> PTP_ADJUST_PREC);
+
+  // An Integer32 holds offsets of up to about 1000 ppm
+  if (offset > INT_MAX)
+    return INT_MAX;
+  if (offset < INT_MIN)
+    return INT_MIN;
+  return (int) offset;
+}
+
+long long ptp_relay_correction(long long upstream_correction,
+                               int rate_offset,
+                               unsigned pdelay,
+                               unsigned ingress_ts,
+                               unsigned egress_ts)
+{
+  long long residence = (long long) (int) (egress_ts - ingress_ts) * PTP_NANOSECONDS_PER_LOCAL_TICK;
+
+  // Residence time in grandmaster ns, kept to 2^-16 ns
+  residence = (residence << 16) + ((residence * rate_offset) >> (PTP_RATE_OFFSET_PREC - 16));
+
+  return upstream_correction + residence + ((long long) pdelay << 16);
+}
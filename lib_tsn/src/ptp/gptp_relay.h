@@ -0,0 +1,57 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file gptp_relay.h
+ * \brief Forwarding of Sync and Follow_Up by a time-aware relay
+ *
+ * When one port is a slave, Syncs received on it are sent on every master
+ * port straight away and their Follow_Ups carry the grandmaster's
+ * preciseOriginTimestamp unchanged. The correctionField accumulates the
+ * upstream link delay and the time the Sync spent in this relay, both in
+ * grandmaster time, so that each hop adds only its timestamp noise rather
+ * than the error of its own estimate of the grandmaster's time.
+ *
+ * Residence time is converted with the cumulative rate ratio of the
+ * grandmaster's clock to this relay's: the upstream cumulativeScaledRateOffset
+ * times the neighbor rate ratio of the slave port's link (802.1AS 10.2.2).
+ *
+ * This module has no xCORE dependencies so that it can be built and tested
+ * on a host.
+ */
+#ifndef __gptp_relay_h__
+#define __gptp_relay_h__
+
+#include <xccompat.h>
+#include "default_avb_conf.h"
+
+/** Forward Syncs received on a slave port to the master ports rather than
+ *  sending Syncs from this device's own estimate of the grandmaster's time */
+#ifndef PTP_RELAY_SYNC
+#define PTP_RELAY_SYNC 1
+#endif
+
+/** The scale of cumulativeScaledRateOffset, (rate ratio - 1) * 2^41 */
+#define PTP_RATE_OFFSET_PREC 41
+
+/** The cumulativeScaledRateOffset to send downstream
+ *
+ *  \param upstream_rate_offset the cumulativeScaledRateOffset received
+ *  \param neighbor_rate_ratio  the slave port's peer clock rate over ours
+ *                              less 1, to PTP_ADJUST_PREC fractional bits
+ */
+int ptp_relay_rate_offset(int upstream_rate_offset, int neighbor_rate_ratio);
+
+/** The correctionField to send downstream, in ns * 2^16
+ *
+ *  \param upstream_correction the correctionField received
+ *  \param rate_offset         the cumulativeScaledRateOffset being sent
+ *  \param pdelay              the slave port's path delay in ns
+ *  \param ingress_ts          the local time the Sync was received
+ *  \param egress_ts           the local time it was sent on
+ */
+long long ptp_relay_correction(long long upstream_correction,
+                               int rate_offset,
+                               unsigned pdelay,
+                               unsigned ingress_ts,
+                               unsigned egress_ts);
+
+#endif // __gptp_relay_h__
@@ -0,0 +1,447 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include "debug_print.h"
+#include "gptp_servo.h"
+#include "gptp_time.h"
+
+#define DEBUG_PRINT_PDELAY_CLAMP 0
+
+/* Assume very conservatively that the worst case is that
+   the sync messages a .5sec apart. That is 5*10^9ns which can
+   be stored in 29 bits. So we have 35 fractional bits to calculate
+   with */
+#define ADJUST_CALC_PREC 35
+
+/* The least squares x deviations are scaled to fit in this many bits, which
+   keeps the sums and the rate division within 64 bits */
+#define FIT_X_BITS 12
+
+// Syncs closer together than this many ticks do not give a rate
+#define FIT_MIN_SPREAD (1 << 20)
+
+// Syncs further than this from the base start a new fit
+#define FIT_MAX_TICKS (1 << 30)
+#define FIT_MAX_RESIDUAL_NS (1 << 30)
+
+void ptp_servo_reset(ptp_servo_t *s)
+{
+  s->adjust = 0;
+  s->inv_adjust = 0;
+  s->adjust_valid = 0;
+  s->locked = 0;
+  s->prev_valid = 0;
+  s->sync_count = 0;
+  s->count = 0;
+  s->next = 0;
+  s->outlier_run = 0;
+  s->step_run = 0;
+}
+
+void ptp_servo_init(ptp_servo_t *s, enum ptp_servo_type_t type)
+{
+  s->type = type;
+  s->outliers = 0;
+  ptp_servo_reset(s);
+}
+
+static int average_sync(ptp_servo_t *s, unsigned int local_ts,
+                        const ptp_timestamp *master_ts)
+{
+  if (s->prev_valid) {
+    signed long long adjust, inv_adjust, master_diff, local_diff;
+
+    /* Calculated the difference between two sync message on
+       the master port and the local port */
+    master_diff = ptp_timestamp_diff(master_ts, &s->prev_master_ts);
+    local_diff = (signed) local_ts - (signed) s->prev_local_ts;
+
+    /* The local timestamps are based on 100Mhz. So
+       convert to nanoseconds */
+    local_diff *= PTP_NANOSECONDS_PER_LOCAL_TICK;
+
+    /* Work at the new adjust value in 64 bits */
+    adjust = master_diff - local_diff;
+    inv_adjust = local_diff - master_diff;
+
+    // Detect and ignore outliers
+#if PTP_THROW_AWAY_SYNC_OUTLIERS
+    if (master_diff > 150000000 || master_diff < 100000000) {
+      s->prev_valid = 0;
+      s->outliers++;
+      debug_printf("PTP threw away Sync outlier (master_diff %d)\n", master_diff);
+      return 1;
+    }
+#endif
+
+    adjust <<= ADJUST_CALC_PREC;
+    inv_adjust <<= ADJUST_CALC_PREC;
+
+    if (master_diff == 0 || local_diff == 0) {
+      s->prev_valid = 0;
+      return 1;
+    }
+
+    adjust = adjust / master_diff;
+    inv_adjust = inv_adjust / local_diff;
+
+    /* Reduce it down to PTP_ADJUST_PREC */
+    adjust >>= (ADJUST_CALC_PREC - PTP_ADJUST_PREC);
+    inv_adjust >>= (ADJUST_CALC_PREC - PTP_ADJUST_PREC);
+
+    /* Re-average the adjust with a given weighting.
+       This method loses a few bits of precision */
+    if (s->adjust_valid) {
+
+      long long diff = adjust - (long long) s->adjust;
+
+      if (diff < 0)
+        diff = -diff;
+
+      if (!s->locked) {
+        if (diff < PTP_SYNC_LOCK_ACCEPTABLE_VARIATION) {
+          s->sync_count++;
+          if (s->sync_count > PTP_SYNC_LOCK_STABILITY_COUNT) {
+            debug_printf("PTP sync locked\n");
+            s->locked = 1;
+            s->sync_count = 0;
+          }
+        }
+        else
+          s->sync_count = 0;
+      }
+      else {
+        if (diff > PTP_SYNC_LOCK_ACCEPTABLE_VARIATION) {
+          s->sync_count++;
+          if (s->sync_count > PTP_SYNC_LOCK_STABILITY_COUNT) {
+            debug_printf("PTP sync lock lost\n");
+            s->locked = 0;
+            s->sync_count = 0;
+            s->prev_valid = 0;
+            return 1;
+          }
+        }
+        else
+          s->sync_count = 0;
+      }
+
+      adjust = (((long long) s->adjust) * (PTP_ADJUST_WEIGHT - 1) + adjust) / PTP_ADJUST_WEIGHT;
+
+      s->adjust = (int) adjust;
+
+      inv_adjust = (((long long) s->inv_adjust) * (PTP_ADJUST_WEIGHT - 1) + inv_adjust) / PTP_ADJUST_WEIGHT;
+
+      s->inv_adjust = (int) inv_adjust;
+    }
+    else {
+      s->adjust = (int) adjust;
+      s->inv_adjust = (int) inv_adjust;
+      s->adjust_valid = 1;
+    }
+  }
+
+  s->prev_local_ts = local_ts;
+  s->prev_master_ts = *master_ts;
+  s->prev_valid = 1;
+
+  return 0;
+}
+
+// Start a new fit from one Sync
+static void fit_restart(ptp_servo_t *s, unsigned int local_ts,
+                        const ptp_timestamp *master_ts)
+{
+  s->base_local_ts = local_ts;
+  s->base_master_ts = *master_ts;
+  s->x[0] = 0;
+  s->r[0] = 0;
+  s->count = 1;
+  s->next = 1 % PTP_SERVO_WINDOW;
+  s->outlier_run = 0;
+  s->step_run = 0;
+  s->fit_x = 0;
+  s->fit_r = 0;
+}
+
+// The fitted residual at x, from the mean along the fitted rate
+static long long fit_residual(const ptp_servo_t *s, int x)
+{
+  long long ns = (long long) (x - s->fit_x) * PTP_NANOSECONDS_PER_LOCAL_TICK;
+
+  return s->fit_r + ((ns * s->adjust) >> PTP_ADJUST_PREC);
+}
+
+// num * 2^shift / den without overflow, for |num % den| < 2^(63 - shift)
+static long long scaled_divide(long long num, long long den, int shift)
+{
+  return ((num / den) << shift) + (((num % den) << shift) / den);
+}
+
+/* Fit r = a + c * x over the window. The slope c is the grandmaster's rate
+   less one, which is the adjust, and the fitted r at the latest Sync is its
+   offset with the measurement noise averaged out. */
+static void fit(ptp_servo_t *s)
+{
+  long long sum_x = 0, sum_r = 0, sxx = 0, sxr = 0;
+  long long max_dx = 0;
+  int shift = 0;
+
+  for (int i = 0; i < s->count; i++) {
+    sum_x += s->x[i];
+    sum_r += s->r[i];
+  }
+  s->fit_x = sum_x / s->count;
+  s->fit_r = sum_r / s->count;
+
+  for (int i = 0; i < s->count; i++) {
+    long long dx = s->x[i] - s->fit_x;
+    if (dx < 0)
+      dx = -dx;
+    if (dx > max_dx)
+      max_dx = dx;
+  }
+
+  // Until the Syncs are far enough apart the previous rate is kept
+  if (max_dx < FIT_MIN_SPREAD)
+    return;
+
+  while ((max_dx >> shift) >= (1 << FIT_X_BITS))
+    shift++;
+
+  for (int i = 0; i < s->count; i++) {
+    long long dx = (s->x[i] - s->fit_x) >> shift;
+    sxx += dx * dx;
+    sxr += dx * (s->r[i] - s->fit_r);
+  }
+
+  // c per ns = sxr / (sxx * 2^shift * 10), the adjust is c * 2^PTP_ADJUST_PREC
+  s->adjust = (int) scaled_divide(sxr, sxx * PTP_NANOSECONDS_PER_LOCAL_TICK,
+                                  PTP_ADJUST_PREC - shift);
+  s->inv_adjust = (int) (-((long long) s->adjust << PTP_ADJUST_PREC) /
+                         ((1LL << PTP_ADJUST_PREC) + s->adjust));
+  s->adjust_valid = 1;
+}
+
+// Move the base to the oldest Sync in a full window so that x and r stay small
+static void fit_rebase(ptp_servo_t *s)
+{
+  int oldest = s->next;
+  int x0 = s->x[oldest];
+  int r0 = s->r[oldest];
+
+  s->base_local_ts += x0;
+  ptp_timestamp_offset64(&s->base_master_ts, &s->base_master_ts,
+                         (long long) x0 * PTP_NANOSECONDS_PER_LOCAL_TICK + r0);
+  for (int i = 0; i < PTP_SERVO_WINDOW; i++) {
+    s->x[i] -= x0;
+    s->r[i] -= r0;
+  }
+}
+
+/* Outliers in a row off the fit by the same amount are the grandmaster's
+   time having stepped. The step leaves the rate as it was, so rather than
+   start again move the window's Syncs by it and carry on. */
+static void fit_step(ptp_servo_t *s, long long step)
+{
+  debug_printf("PTP servo followed a step of %d ns\n", (int) step);
+  for (int i = 0; i < s->count; i++)
+    s->r[i] += (int) step;
+  s->fit_r += step;
+}
+
+static int least_squares_sync(ptp_servo_t *s, unsigned int local_ts,
+                              const ptp_timestamp *master_ts)
+{
+  int latest, x;
+  long long r;
+
+  if (s->count == 0) {
+    fit_restart(s, local_ts, master_ts);
+    return 0;
+  }
+
+  latest = (s->next + PTP_SERVO_WINDOW - 1) % PTP_SERVO_WINDOW;
+  x = (int) (local_ts - s->base_local_ts);
+  if (x <= s->x[latest])
+    return 1;
+
+  r = ptp_timestamp_diff(master_ts, &s->base_master_ts) - (long long) x * PTP_NANOSECONDS_PER_LOCAL_TICK;
+
+  if (x > FIT_MAX_TICKS || r > FIT_MAX_RESIDUAL_NS || r < -FIT_MAX_RESIDUAL_NS) {
+    // Syncs have been missing for a long time or the grandmaster has
+    // stepped a long way. Keep the rate until there is a new one.
+    fit_restart(s, local_ts, master_ts);
+    return 0;
+  }
+
+  if (s->count >= PTP_SERVO_MIN_FIT) {
+    long long error = r - fit_residual(s, x);
+
+    if (error > PTP_SERVO_OUTLIER_NS || error < -PTP_SERVO_OUTLIER_NS) {
+      long long change = error - s->outlier_error;
+
+      s->outliers++;
+      if (s->outlier_run > 0 &&
+          change <= PTP_SERVO_STEP_TOLERANCE_NS && change >= -PTP_SERVO_STEP_TOLERANCE_NS)
+        s->step_run++;
+      else
+        s->step_run = 1;
+      s->outlier_error = error;
+
+      if (s->step_run >= PTP_SERVO_STEP_OUTLIERS) {
+        fit_step(s, error);
+      } else {
+        if (++s->outlier_run <= PTP_SERVO_MAX_OUTLIER_RUN)
+          return 1;
+        debug_printf("PTP servo restarted after %d outliers\n", s->outlier_run);
+        s->locked = 0;
+        fit_restart(s, local_ts, master_ts);
+        return 0;
+      }
+    }
+  }
+  s->outlier_run = 0;
+  s->step_run = 0;
+
+  if (s->count == PTP_SERVO_WINDOW) {
+    fit_rebase(s);
+    x = (int) (local_ts - s->base_local_ts);
+    r = ptp_timestamp_diff(master_ts, &s->base_master_ts) - (long long) x * PTP_NANOSECONDS_PER_LOCAL_TICK;
+  }
+  s->x[s->next] = x;
+  s->r[s->next] = (int) r;
+  s->next = (s->next + 1) % PTP_SERVO_WINDOW;
+  if (s->count < PTP_SERVO_WINDOW)
+    s->count++;
+
+  fit(s);
+
+  if (!s->locked && s->count == PTP_SERVO_WINDOW) {
+    debug_printf("PTP sync locked\n");
+    s->locked = 1;
+  }
+  return 0;
+}
+
+int ptp_servo_sync(ptp_servo_t *s,
+                   unsigned int local_ts,
+                   const ptp_timestamp *master_egress_ts,
+                   int pdelay)
+{
+  long long offset;
+
+  if (s->type == PTP_SERVO_AVERAGE) {
+    if (average_sync(s, local_ts, master_egress_ts))
+      return 1;
+    s->ref_local_ts = local_ts;
+    ptp_timestamp_offset64(&s->ref_ptp_ts, master_egress_ts, pdelay);
+    return 0;
+  }
+
+  if (least_squares_sync(s, local_ts, master_egress_ts))
+    return 1;
+
+  // The grandmaster's time at this Sync on the fitted line
+  offset = (long long) (int) (local_ts - s->base_local_ts) * PTP_NANOSECONDS_PER_LOCAL_TICK;
+  if (s->count > 1)
+    offset += fit_residual(s, (int) (local_ts - s->base_local_ts));
+  s->ref_local_ts = local_ts;
+  ptp_timestamp_offset64(&s->ref_ptp_ts, &s->base_master_ts, offset + pdelay);
+  return 0;
+}
+
+long long ptp_servo_measure_path_delay(unsigned local_egress_ts,
+                                       const ptp_timestamp *master_ingress_ts,
+                                       const ptp_timestamp *master_egress_ts,
+                                       unsigned local_ingress_ts,
+                                       int ptp_adjust)
+{
+  long long master_diff;
+  long long local_diff;
+  long long delay;
+
+  /* The sequence of events is:
+
+     local egress   (ptp req sent from our local port)
+     master ingress (ptp req recv on master port)
+     master egress  (ptp resp sent from master port)
+     local ingress  (ptp resp recv on our local port)
+
+     So transit time (assuming a symetrical link) is:
+
+     ((local_ingress_ts - local_egress_ts) - (master_egress_ts - master_ingress_ts) ) / 2
+
+  */
+
+  master_diff = ptp_timestamp_diff(master_egress_ts, master_ingress_ts);
+
+  local_diff = ptp_local_ticks_to_ns((int) (local_ingress_ts - local_egress_ts), ptp_adjust);
+
+  delay = (local_diff - master_diff) / 2;
+
+  if (delay < 0) {
+#if DEBUG_PRINT_PDELAY_CLAMP
+    debug_printf("Clamp negative pdelay %d\n", (int) delay);
+#endif
+    delay = 0;
+  }
+  return delay;
+}
+
+// Pdelay_Resps further apart than this many ticks do not give a rate
+#define NEIGHBOR_RATE_RATIO_MAX_TICKS (1 << 30)
+
+void ptp_servo_neighbor_rate_ratio(ptp_path_delay_t *d,
+                                   const ptp_timestamp *master_egress_ts,
+                                   unsigned local_ingress_ts,
+                                   int discarded)
+{
+  if (discarded)
+    return;
+
+  if (d->prev_resp_valid) {
+    int ticks = (int) (local_ingress_ts - d->prev_resp_ingress_ts);
+    long long master_diff = ptp_timestamp_diff(master_egress_ts, &d->prev_resp_egress_ts);
+    long long local_diff = (long long) ticks * PTP_NANOSECONDS_PER_LOCAL_TICK;
+
+    if (ticks > 0 && ticks < NEIGHBOR_RATE_RATIO_MAX_TICKS && master_diff > 0) {
+      int ratio = (int) (((master_diff - local_diff) << PTP_ADJUST_PREC) / local_diff);
+
+      if (d->neighbor_rate_ratio_valid)
+        d->neighbor_rate_ratio += (ratio - d->neighbor_rate_ratio) / PTP_NEIGHBOR_RATE_RATIO_WEIGHT;
+      else
+        d->neighbor_rate_ratio = ratio;
+      d->neighbor_rate_ratio_valid = 1;
+    }
+  }
+  d->prev_resp_ingress_ts = local_ingress_ts;
+  d->prev_resp_egress_ts = *master_egress_ts;
+  d->prev_resp_valid = 1;
+}
+
+int ptp_servo_path_delay(ptp_path_delay_t *d, long long delay)
+{
+  if (d->valid) {
+    long long error = delay - (long long) d->pdelay;
+
+    if (error > PTP_PATH_DELAY_OUTLIER_NS || error < -PTP_PATH_DELAY_OUTLIER_NS) {
+      d->outliers++;
+      if (++d->outlier_run <= PTP_SERVO_MAX_OUTLIER_RUN)
+        return 1;
+      // The path has changed, start again from this measurement
+      d->pdelay = delay;
+      d->outlier_run = 0;
+      return 0;
+    }
+    d->outlier_run = 0;
+
+    /* Re-average the adjust with a given weighting.
+       This method loses a few bits of precision */
+    d->pdelay = ((d->pdelay * (PTP_PATH_DELAY_WEIGHT - 1)) + (int) delay) / PTP_PATH_DELAY_WEIGHT;
+  }
+  else {
+    d->pdelay = delay;
+    d->outlier_run = 0;
+    d->valid = 1;
+  }
+  return 0;
+}
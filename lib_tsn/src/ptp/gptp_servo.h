@@ -0,0 +1,177 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file gptp_servo.h
+ * \brief The gPTP clock servo: the estimate of the grandmaster's time and
+ *        rate from Sync/Follow_Up pairs, and the filter of path delay
+ *        measurements
+ *
+ * Two servos are available. PTP_SERVO_AVERAGE takes the rate from each
+ * pair of consecutive Syncs and averages it with a weight of
+ * 1/PTP_ADJUST_WEIGHT. PTP_SERVO_LEAST_SQUARES fits a line of offset
+ * against local time to the last PTP_SERVO_WINDOW Syncs, which gives both
+ * the rate and a filtered offset, and rejects Syncs that are far from the
+ * fit instead of restarting. It is more accurate in steady state but takes
+ * PTP_SERVO_STEP_OUTLIERS Syncs to follow a step in the grandmaster's time,
+ * where the averaging servo takes one, so PTP_SERVO_AVERAGE is the
+ * default.
+ *
+ * Like gptp_time.h this module can be built on a host, where
+ * tests/gptp_servo replays recorded or generated Sync traces through it.
+ */
+#ifndef __gptp_servo_h__
+#define __gptp_servo_h__
+
+#include <xccompat.h>
+#include "default_avb_conf.h"
+#include "gptp.h"
+#include "gptp_internal.h"
+
+enum ptp_servo_type_t {
+  PTP_SERVO_AVERAGE,
+  PTP_SERVO_LEAST_SQUARES
+};
+
+/** The servo the PTP server runs, a ptp_servo_type_t */
+#ifndef PTP_SERVO
+#define PTP_SERVO PTP_SERVO_AVERAGE
+#endif
+
+// PTP_SERVO_AVERAGE parameters
+#define PTP_ADJUST_WEIGHT 32
+#define PTP_SYNC_LOCK_ACCEPTABLE_VARIATION 0x100000
+#define PTP_SYNC_LOCK_STABILITY_COUNT 5
+
+#ifndef PTP_THROW_AWAY_SYNC_OUTLIERS
+#define PTP_THROW_AWAY_SYNC_OUTLIERS 0
+#endif
+
+// PTP_SERVO_LEAST_SQUARES parameters
+
+/** The number of Syncs fitted, at most 32 */
+#ifndef PTP_SERVO_WINDOW
+#define PTP_SERVO_WINDOW 16
+#endif
+
+/** The number of Syncs before outliers are looked for */
+#ifndef PTP_SERVO_MIN_FIT
+#define PTP_SERVO_MIN_FIT 4
+#endif
+
+/** A Sync this far in ns from the fitted line is an outlier */
+#ifndef PTP_SERVO_OUTLIER_NS
+#define PTP_SERVO_OUTLIER_NS 5000
+#endif
+
+/** After this many outliers in a row the grandmaster's time is taken to
+ *  have stepped and the fit starts again */
+#ifndef PTP_SERVO_MAX_OUTLIER_RUN
+#define PTP_SERVO_MAX_OUTLIER_RUN 4
+#endif
+
+/** This many outliers in a row whose offsets from the fitted line agree to
+ *  within PTP_SERVO_STEP_TOLERANCE_NS are a step in the grandmaster's time,
+ *  which the fit follows keeping its rate. Two would follow a step a Sync
+ *  sooner but also follow pairs of equally delayed Syncs. */
+#ifndef PTP_SERVO_STEP_OUTLIERS
+#define PTP_SERVO_STEP_OUTLIERS 3
+#endif
+
+#ifndef PTP_SERVO_STEP_TOLERANCE_NS
+#define PTP_SERVO_STEP_TOLERANCE_NS 1000
+#endif
+
+#if PTP_SERVO_STEP_OUTLIERS < 2 || PTP_SERVO_STEP_OUTLIERS > PTP_SERVO_MAX_OUTLIER_RUN + 1
+#error PTP_SERVO_STEP_OUTLIERS must be from 2 to PTP_SERVO_MAX_OUTLIER_RUN + 1
+#endif
+
+#if PTP_SERVO_WINDOW < 2 || PTP_SERVO_WINDOW > 32
+#error PTP_SERVO_WINDOW must be from 2 to 32
+#endif
+
+// Path delay filter parameters
+#define PTP_PATH_DELAY_WEIGHT 32
+#define PTP_NEIGHBOR_RATE_RATIO_WEIGHT 8
+
+/** A path delay measurement this far in ns from the average is an outlier,
+ *  up to PTP_SERVO_MAX_OUTLIER_RUN in a row */
+#ifndef PTP_PATH_DELAY_OUTLIER_NS
+#define PTP_PATH_DELAY_OUTLIER_NS 1000
+#endif
+
+typedef struct ptp_servo_t {
+  enum ptp_servo_type_t type;
+
+  // Results, valid once ptp_servo_sync() has returned 0
+  int adjust;                   ///< As ptp_time_info.ptp_adjust
+  int inv_adjust;               ///< As ptp_time_info.inv_ptp_adjust
+  unsigned int ref_local_ts;    ///< A local time ...
+  ptp_timestamp ref_ptp_ts;     ///< ... and the grandmaster time at it
+  int adjust_valid;             ///< 0 until a rate has been measured
+  int locked;                   ///< 1 while the rate is stable
+  unsigned int outliers;        ///< Syncs rejected since the servo was initialised
+
+  // PTP_SERVO_AVERAGE state
+  int prev_valid;
+  unsigned int prev_local_ts;
+  ptp_timestamp prev_master_ts;
+  int sync_count;
+
+  // PTP_SERVO_LEAST_SQUARES state, Syncs relative to the first in the fit
+  unsigned int base_local_ts;
+  ptp_timestamp base_master_ts;
+  int count;                    ///< Syncs in the window
+  int next;                     ///< The window entry to fill next
+  int outlier_run;
+  int step_run;                 ///< Outliers in a row that agree on a step
+  long long outlier_error;      ///< The last outlier's offset from the fit
+  int x[PTP_SERVO_WINDOW];      ///< Local ticks since the base
+  int r[PTP_SERVO_WINDOW];      ///< Master ns less local ns since the base
+  long long fit_x, fit_r;       ///< The means of x and r, the fitted line's centre
+} ptp_servo_t;
+
+/** Initialise a servo of the given type */
+void ptp_servo_init(REFERENCE_PARAM(ptp_servo_t, s), enum ptp_servo_type_t type);
+
+/** Forget all Syncs, as when the port becomes a slave */
+void ptp_servo_reset(REFERENCE_PARAM(ptp_servo_t, s));
+
+/** Feed a servo one Sync/Follow_Up pair.
+ *
+ *  \param s               the servo
+ *  \param local_ts        the local time the Sync was received
+ *  \param master_egress_ts the grandmaster time it was sent, corrected
+ *  \param pdelay          the current path delay in ns
+ *
+ *  \returns 0 if the servo's results have been updated, 1 if the Sync was
+ *           discarded
+ */
+int ptp_servo_sync(REFERENCE_PARAM(ptp_servo_t, s),
+                   unsigned int local_ts,
+                   REFERENCE_PARAM(const ptp_timestamp, master_egress_ts),
+                   int pdelay);
+
+/** The path delay in ns measured by a Pdelay exchange, from the local
+ *  egress time of the request, the peer's ingress time of the request and
+ *  egress time of the response and the local ingress time of the response */
+long long ptp_servo_measure_path_delay(unsigned local_egress_ts,
+                                       REFERENCE_PARAM(const ptp_timestamp, master_ingress_ts),
+                                       REFERENCE_PARAM(const ptp_timestamp, master_egress_ts),
+                                       unsigned local_ingress_ts,
+                                       int ptp_adjust);
+
+/** Update the ratio of the peer's clock rate to ours from the egress time
+ *  of a Pdelay_Resp and its local ingress time. Exchanges whose path delay
+ *  was discarded are skipped. */
+void ptp_servo_neighbor_rate_ratio(REFERENCE_PARAM(ptp_path_delay_t, d),
+                                   REFERENCE_PARAM(const ptp_timestamp, master_egress_ts),
+                                   unsigned local_ingress_ts,
+                                   int discarded);
+
+/** Filter a new path delay measurement into a port's path delay
+ *
+ *  \returns 0 if the path delay has been updated, 1 if the measurement was
+ *           discarded
+ */
+int ptp_servo_path_delay(REFERENCE_PARAM(ptp_path_delay_t, d), long long delay);
+
+#endif // __gptp_servo_h__
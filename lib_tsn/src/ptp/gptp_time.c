@@ -0,0 +1,111 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include "gptp_time.h"
+
+long long ptp_ns_to_local_ticks(long long ns, int inv_ptp_adjust)
+{
+  ns = ns + ((ns * inv_ptp_adjust) >> PTP_ADJUST_PREC);
+  return ns / PTP_NANOSECONDS_PER_LOCAL_TICK;
+}
+
+void ptp_timestamp_offset64(ptp_timestamp *dst,
+                            const ptp_timestamp *ts,
+                            long long offset)
+{
+  unsigned long long sec = ts->seconds[0] |
+                           ((unsigned long long) ts->seconds[1] << 32);
+  long long nanosec = (long long) ts->nanoseconds + offset;
+  long long carry = nanosec / PTP_NANOSECONDS_PER_SECOND;
+
+  // Negative offsets borrow from the seconds
+  nanosec -= carry * PTP_NANOSECONDS_PER_SECOND;
+  if (nanosec < 0) {
+    nanosec += PTP_NANOSECONDS_PER_SECOND;
+    carry--;
+  }
+  sec += carry;
+
+  dst->seconds[1] = (unsigned) (sec >> 32);
+  dst->seconds[0] = (unsigned) sec;
+  dst->nanoseconds = (unsigned) nanosec;
+}
+
+long long ptp_timestamp_diff(const ptp_timestamp *a,
+                             const ptp_timestamp *b)
+{
+  unsigned long long sec_a = a->seconds[0] |
+                             ((unsigned long long) a->seconds[1] << 32);
+  unsigned long long sec_b = b->seconds[0] |
+                             ((unsigned long long) b->seconds[1] << 32);
+  long long sec_diff = sec_a - sec_b;
+  long long nanosec_diff = (long long) a->nanoseconds - (long long) b->nanoseconds;
+
+  return nanosec_diff + sec_diff * PTP_NANOSECONDS_PER_SECOND;
+}
+
+void ptp_timestamp_to_mod64(const ptp_timestamp *ts,
+                            unsigned *hi,
+                            unsigned *lo)
+{
+  unsigned long long t = ts->seconds[0] |
+                         ((unsigned long long) ts->seconds[1] << 32);
+
+  t = t * PTP_NANOSECONDS_PER_SECOND + ts->nanoseconds;
+  *hi = (unsigned) (t >> 32);
+  *lo = (unsigned) t;
+}
+
+// The xCORE build of this is the dual issue one in gptp.xc
+#if !defined(__XS1B__) && !defined(__XS2A__)
+unsigned local_timestamp_to_ptp_mod32(unsigned local_ts,
+                                      ptp_time_info_mod64 *info)
+{
+  int ticks = (int) (local_ts - info->local_ts);
+
+  return info->ptp_ts_lo + (unsigned) ptp_local_ticks_to_ns(ticks, info->ptp_adjust);
+}
+#endif
+
+void local_timestamp_to_ptp_mod64(unsigned local_ts,
+                                  ptp_time_info_mod64 *info,
+                                  unsigned *hi,
+                                  unsigned *lo)
+{
+  int ticks = (int) (local_ts - info->local_ts);
+  unsigned long long ptp_mod64 = ((unsigned long long) info->ptp_ts_hi << 32) + info->ptp_ts_lo;
+
+  ptp_mod64 += ptp_local_ticks_to_ns(ticks, info->ptp_adjust);
+
+  *hi = (unsigned) (ptp_mod64 >> 32);
+  *lo = (unsigned) ptp_mod64;
+}
+
+void local_timestamp_to_ptp(ptp_timestamp *ptp_ts,
+                            unsigned local_ts,
+                            ptp_time_info *info)
+{
+  int ticks = (int) (local_ts - info->local_ts);
+
+  ptp_timestamp_offset64(ptp_ts, &info->ptp_ts,
+                         ptp_local_ticks_to_ns(ticks, info->ptp_adjust));
+}
+
+unsigned ptp_timestamp_to_local(ptp_timestamp *ts,
+                                ptp_time_info *info)
+{
+  long long ns = ptp_timestamp_diff(ts, &info->ptp_ts);
+
+  return info->local_ts + (unsigned) ptp_ns_to_local_ticks(ns, info->inv_ptp_adjust);
+}
+
+unsigned ptp_mod32_timestamp_to_local(unsigned ts, ptp_time_info_mod64 *info)
+{
+  int ns = (int) (ts - info->ptp_ts_lo);
+
+  return info->local_ts + (unsigned) ptp_ns_to_local_ticks(ns, info->inv_ptp_adjust);
+}
+
+void ptp_timestamp_offset(ptp_timestamp *ts, int offset)
+{
+  ptp_timestamp_offset64(ts, ts, offset);
+}
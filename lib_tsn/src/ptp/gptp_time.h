@@ -0,0 +1,64 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/**
+ * \file gptp_time.h
+ * \brief Conversions between local xCORE timer ticks and PTP time
+ *
+ * Local timestamps are 32 bit counts of the 100MHz reference clock and
+ * wrap, so differences between them are taken as signed 32 bit values.
+ * Local time runs at (1 + ptp_adjust / 2^PTP_ADJUST_PREC) times the rate
+ * of PTP time, and PTP time at (1 + inv_ptp_adjust / 2^PTP_ADJUST_PREC)
+ * times the rate of local time.
+ *
+ * This module has no xCORE dependencies so that it can be built and tested
+ * on a host. On xCORE, local_timestamp_to_ptp_mod32(), which the talkers
+ * call per packet, is built from gptp.xc instead so that it can keep its
+ * [[dual_issue]] attribute.
+ */
+#ifndef __gptp_time_h__
+#define __gptp_time_h__
+
+#include <xccompat.h>
+#include "gptp.h"
+#include "gptp_internal.h"
+
+#define PTP_NANOSECONDS_PER_SECOND (1000000000)
+#define PTP_NANOSECONDS_PER_LOCAL_TICK (10)
+
+/** The PTP time in nanoseconds of a difference of local ticks */
+static inline long long ptp_local_ticks_to_ns(int ticks, int ptp_adjust)
+{
+  long long ns = (long long) ticks * PTP_NANOSECONDS_PER_LOCAL_TICK;
+
+  return ns + ((ns * ptp_adjust) >> PTP_ADJUST_PREC);
+}
+
+/** The local ticks in a difference of PTP time, rounded towards zero */
+long long ptp_ns_to_local_ticks(long long ns, int inv_ptp_adjust);
+
+/** dst = ts + offset nanoseconds. dst and ts may be the same timestamp. */
+#ifdef __XC__
+void ptp_timestamp_offset64(ptp_timestamp &alias dst,
+                            const ptp_timestamp &alias ts,
+                            long long offset);
+#else
+void ptp_timestamp_offset64(ptp_timestamp *dst,
+                            const ptp_timestamp *ts,
+                            long long offset);
+#endif
+
+/** a - b in nanoseconds */
+long long ptp_timestamp_diff(REFERENCE_PARAM(const ptp_timestamp, a),
+                             REFERENCE_PARAM(const ptp_timestamp, b));
+
+/** The least significant 64 bits of a timestamp in nanoseconds */
+void ptp_timestamp_to_mod64(REFERENCE_PARAM(const ptp_timestamp, ts),
+                            REFERENCE_PARAM(unsigned, hi),
+                            REFERENCE_PARAM(unsigned, lo));
+
+/** Convert a local timestamp to the least significant 64 bits of PTP time */
+void local_timestamp_to_ptp_mod64(unsigned local_ts,
+                                  REFERENCE_PARAM(ptp_time_info_mod64, info),
+                                  REFERENCE_PARAM(unsigned, hi),
+                                  REFERENCE_PARAM(unsigned, lo));
+
+#endif // __gptp_time_h__
@@ -0,0 +1,69 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <xccompat.h>
+#include "gptp.h"
+#include "gptp_internal.h"
+
+/* The PTP server's latest time information, shared with clients on its own
+ * tile. Tiles do not share memory, so on any other tile nothing is ever
+ * published here and clients fall back to asking over their channel.
+ *
+ * seq counts half publishes: it is odd while the server is writing and
+ * seq >> 1 is the number of completed publishes, the latest of which is in
+ * info[(seq >> 1) & 1]. The server writes the other entry, so a reader only
+ * has to retry if two publishes started while it was copying.
+ */
+// xCORE threads on a tile see each other's stores in program order, hosts
+// that the snapshot is tested on need fences
+#if defined(__XS1B__) || defined(__XS2A__)
+#define SNAPSHOT_FENCE()
+#else
+#define SNAPSHOT_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+typedef struct ptp_time_snapshot_t {
+  unsigned int seq;
+  ptp_time_info_mod64 info[2];
+} ptp_time_snapshot_t;
+
+static volatile ptp_time_snapshot_t snapshot;
+
+void ptp_time_snapshot_publish(ptp_time_info_mod64 *info)
+{
+  unsigned int seq = snapshot.seq;
+  volatile ptp_time_info_mod64 *next = &snapshot.info[((seq >> 1) + 1) & 1];
+
+  snapshot.seq = seq + 1;
+  SNAPSHOT_FENCE();
+  next->local_ts = info->local_ts;
+  next->ptp_ts_hi = info->ptp_ts_hi;
+  next->ptp_ts_lo = info->ptp_ts_lo;
+  next->ptp_adjust = info->ptp_adjust;
+  next->inv_ptp_adjust = info->inv_ptp_adjust;
+  SNAPSHOT_FENCE();
+  snapshot.seq = seq + 2;
+}
+
+int ptp_get_time_snapshot_mod64(ptp_time_info_mod64 *info)
+{
+  unsigned int seq, start;
+
+  do {
+    volatile ptp_time_info_mod64 *latest;
+
+    start = snapshot.seq & ~1;
+    if (start == 0)
+      return 0;
+
+    SNAPSHOT_FENCE();
+    latest = &snapshot.info[(start >> 1) & 1];
+    info->local_ts = latest->local_ts;
+    info->ptp_ts_hi = latest->ptp_ts_hi;
+    info->ptp_ts_lo = latest->ptp_ts_lo;
+    info->ptp_adjust = latest->ptp_adjust;
+    info->inv_ptp_adjust = latest->inv_ptp_adjust;
+    SNAPSHOT_FENCE();
+    seq = snapshot.seq;
+  } while (seq - start > 2);
+
+  return 1;
+}
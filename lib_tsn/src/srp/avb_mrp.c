@@ -13,17 +13,19 @@
 #include <print.h>
 #include "debug_print.h"
 #include "avb_mrp_debug_strings.h"
+#include "avb_mrp_index.h"
 
 
 /** \file avb_mrp.c
  *  \brief the core of the MRP protocols
  */
 
-#define MAX_MRP_MSG_SIZE (sizeof(mrp_msg_header) + sizeof(srp_talker_first_value) + 1 /* for event vector */ + sizeof(mrp_msg_footer))
+#define MAX_MRP_MSG_SIZE (sizeof(mrp_msg_header) + sizeof(mrp_vector_header) + sizeof(srp_talker_failed_first_value) + 2 /* for event vectors */ + sizeof(mrp_msg_footer))
 
-// The size of the send buffer
+// The size of the send buffer, a full MTU MRPDU by default so that each
+// join period needs as few frames as possible
 #ifndef MRP_SEND_BUFFER_SIZE
-#define MRP_SEND_BUFFER_SIZE (500)
+#define MRP_SEND_BUFFER_SIZE (sizeof(mrp_ethernet_hdr) + 1500)
 #endif
 
 //! Lengths of the first values for each attribute type
@@ -42,9 +44,26 @@ static char send_buf[MRP_SEND_BUFFER_SIZE];
 //! Array of attribute control structures
 static mrp_attribute_state attrs[MRP_MAX_ATTRS];
 
-//! when sorting the attributes, this points to the head of the list.  attributes
-//! need to be sorted so that they can be merged into vectors in the MRP messages
-static mrp_attribute_state *first_attr = &attrs[0];
+//! The attributes sorted for matching received values to
+static mrp_attr_index_t attr_index;
+
+//! The heads of the lists of attributes in use, one per type.  attributes
+//! need to be sorted so that they can be merged into vectors in the MRP messages,
+//! so each list is kept in order as attributes are added to it, and as SRP
+//! changes their values (see mrp_attribute_value_changed()).  Talker Advertise
+//! and Talker Failed attributes share the Talker Advertise list as an attribute
+//! can change between the two
+static mrp_attribute_state *first_attr[MRP_NUM_ATTRIBUTE_TYPES];
+
+//! The unused attributes, linked through their next pointers
+static mrp_attribute_state *free_attrs;
+
+//!@{
+//! \name Attribute pool counters, see mrp_get_attr_counters()
+static unsigned attrs_in_use;
+static unsigned attrs_high_water;
+static unsigned attr_exhausted;
+//!@}
 
 //! The end of the under-construction MRP packet
 static char *send_ptr= &send_buf[0] + sizeof(mrp_ethernet_hdr) + sizeof(mrp_header);
@@ -181,8 +200,9 @@ static void force_send(CLIENT_INTERFACE(ethernet_if, i_eth), int ifnum)
 // to it.
 static void send(CLIENT_INTERFACE(ethernet_if, i_eth), int ifnum)
 {
-  // Send only when the buffer is full
-  if (send_buf + MRP_SEND_BUFFER_SIZE < send_ptr + MAX_MRP_MSG_SIZE + sizeof(mrp_footer)) {
+  // Send only when the buffer is full, leaving room for the four bytes
+  // that force_send() ends the PDU with
+  if (send_buf + MRP_SEND_BUFFER_SIZE < send_ptr + MAX_MRP_MSG_SIZE + 4) {
     force_send(i_eth, ifnum);
   }
 }
@@ -313,6 +333,21 @@ static int has_fourpacked_events(mrp_attribute_type attr) {
   return (attr == MSRP_LISTENER) ? 1 : 0;
 }
 
+int mrp_get_num_values(char *buf)
+{
+  mrp_vector_header *vector_hdr = (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
+  return ((vector_hdr->LeaveAllEventNumberOfValuesHigh & 0x1f) << 8) +
+         vector_hdr->NumberOfValuesLow;
+}
+
+void mrp_set_num_values(char *buf, int num_values)
+{
+  mrp_vector_header *vector_hdr = (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
+  vector_hdr->LeaveAllEventNumberOfValuesHigh =
+    (vector_hdr->LeaveAllEventNumberOfValuesHigh & 0xe0) | ((num_values >> 8) & 0x1f);
+  vector_hdr->NumberOfValuesLow = num_values & 0xff;
+}
+
 static int encode_three_packed(int event, int i, int vector)
 {
 
@@ -326,8 +361,7 @@ void mrp_encode_three_packed_event(char *buf,
                                    mrp_attribute_type attr)
 {
   mrp_msg_header *hdr = (mrp_msg_header *) buf;
-  mrp_vector_header *vector_hdr = (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
-  int num_values = vector_hdr->NumberOfValuesLow;
+  int num_values = mrp_get_num_values(buf);
   int first_value_length =  first_value_lengths[attr];
   char *vector = buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header) + first_value_length + num_values/3;
   int shift_required = (num_values % 3 == 0);
@@ -365,8 +399,7 @@ void mrp_encode_four_packed_event(char *buf,
                                   mrp_attribute_type attr)
 {
   mrp_msg_header *hdr = (mrp_msg_header *) buf;
-  mrp_vector_header *vector_hdr = (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
-  int num_values = vector_hdr->NumberOfValuesLow;
+  int num_values = mrp_get_num_values(buf);
   int first_value_length =  first_value_lengths[attr];
   char *vector = buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header) + first_value_length + (num_values+3)/3 + num_values/4 ;
   int shift_required = (num_values % 4 == 0);
@@ -444,6 +477,9 @@ static void doTx(mrp_attribute_state *st,
   char *msg = &send_buf[0]+sizeof(mrp_ethernet_hdr)+sizeof(mrp_header);
   char *end = send_ptr;
 
+  // Each encoder only adds the value to a vector whose run of values it
+  // continues, checked against the values themselves rather than the order
+  // of the attribute lists
   while (!merged &&
          msg < end &&
          (*msg != 0 || *(msg+1) != 0)) {
@@ -793,17 +829,101 @@ void mrp_attribute_init(mrp_attribute_state *st,
                         unsigned int here,
                         void *info)
 {
-  memset(st, sizeof(mrp_attribute_state), 0);
+  // A recycled attribute must not keep the state of its last use.  It stays
+  // MRP_DISABLED, as mrp_get_attr() left it, until mrp_mad_begin()
+  memset(st, 0, sizeof(*st));
+  st->applicant_state = MRP_DISABLED;
   st->attribute_type = t;
   st->attribute_info = info;
   st->port_num = port_num;
   st->propagated = 0;
   st->here = here;
+  attr_index.stale = 1;
   return;
 }
 
+static int attr_list(mrp_attribute_type t)
+{
+  return (t == MSRP_TALKER_FAILED) ? MSRP_TALKER_ADVERTISE : t;
+}
+
+static int compare_attr(mrp_attribute_state *a,
+                        mrp_attribute_state *b)
+{
+  switch (attr_list(a->attribute_type))
+    {
+    case MSRP_TALKER_ADVERTISE:
+      return avb_srp_compare_talker_attributes(a,b);
+      break;
+    case MSRP_LISTENER:
+      return avb_srp_compare_listener_attributes(a,b);
+      break;
+    case MVRP_VID_VECTOR:
+      return avb_mvrp_compare_vid_attributes(a,b);
+      break;
+    default:
+      break;
+    }
+  return (a<b);
+}
+
+// Returns whether the attribute was in its type's list
+static int remove_attr(mrp_attribute_state *st)
+{
+  mrp_attribute_state **p = &first_attr[attr_list(st->attribute_type)];
+
+  while (*p != NULL) {
+    if (*p == st) {
+      *p = st->next;
+      return 1;
+    }
+    p = &(*p)->next;
+  }
+  return 0;
+}
+
+// Insert after any equal attributes so that their order is kept
+static void insert_attr(mrp_attribute_state *st)
+{
+  mrp_attribute_state **p = &first_attr[attr_list(st->attribute_type)];
+
+  while (*p != NULL && !compare_attr(st, *p))
+    p = &(*p)->next;
+  st->next = *p;
+  *p = st;
+}
+
+void mrp_attribute_value_changed(mrp_attribute_state *st)
+{
+  // Attributes that have not begun, or are unused, are in no list
+  if (remove_attr(st))
+    insert_attr(st);
+  attr_index.stale = 1;
+}
+
+void mrp_attribute_info_changed(void *info)
+{
+  for (int i=0;i<MRP_MAX_ATTRS;i++) {
+    if (attrs[i].attribute_info == info)
+      mrp_attribute_value_changed(&attrs[i]);
+  }
+}
+
+void mrp_attribute_unused(mrp_attribute_state *st)
+{
+  remove_attr(st);
+  st->next = free_attrs;
+  free_attrs = st;
+  attrs_in_use--;
+  attr_index.stale = 1;
+}
+
 void mrp_mad_begin(mrp_attribute_state *st)
 {
+  // The attribute's value is known by now, (re)place it in its type's order
+  remove_attr(st);
+  insert_attr(st);
+
 #ifdef MRP_FULL_PARTICIPANT
   init_avb_timer(&st->leaveTimer, 1);
 #endif
@@ -852,14 +972,20 @@ void mrp_init(char *macaddr)
     hdr->src_addr[i] = macaddr[i];
   }
 
-  for (int i=0;i<MRP_MAX_ATTRS;i++) {
+  // Hand out the attributes in array order, as the search for an unused one did
+  free_attrs = NULL;
+  for (int i=MRP_MAX_ATTRS-1;i>=0;i--) {
     attrs[i].applicant_state = MRP_UNUSED;
-    if (i != MRP_MAX_ATTRS-1)
-      attrs[i].next = &attrs[i+1];
-    else
-      attrs[i].next = NULL;
+    attrs[i].next = free_attrs;
+    free_attrs = &attrs[i];
+  }
+  for (int i=0;i<MRP_NUM_ATTRIBUTE_TYPES;i++) {
+    first_attr[i] = NULL;
   }
-  first_attr = &attrs[0];
+  attrs_in_use = 0;
+  attrs_high_water = 0;
+  attr_exhausted = 0;
+  mrp_attr_index_init(&attr_index, attrs, MRP_MAX_ATTRS);
 
   for (int i=0; i < MRP_NUM_PORTS; i++)
   {
@@ -882,138 +1008,62 @@ void mrp_init(char *macaddr)
 
 }
 
-static int compare_attr(mrp_attribute_state *a,
-                        mrp_attribute_state *b)
+mrp_attribute_state *mrp_get_attr(void)
 {
-  if (a->applicant_state == MRP_UNUSED) {
-    if (b->applicant_state == MRP_UNUSED)
-      return (a < b);
-    else
-      return 0;
-  }
-  else if (b->applicant_state == MRP_UNUSED) {
-    return 1;
-  }
-
+  mrp_attribute_state *st = free_attrs;
 
-  if (a->applicant_state == MRP_DISABLED) {
-    if (b->applicant_state == MRP_DISABLED)
-      return (a < b);
-    else
-      return 0;
-  }
-  else if (b->applicant_state == MRP_DISABLED) {
-    return 1;
+  if (st == NULL) {
+    attr_exhausted++;
+    return NULL;
   }
 
+  free_attrs = st->next;
+  st->next = NULL;
+  st->applicant_state = MRP_DISABLED;
+  attr_index.stale = 1;
 
-  if (a->attribute_type != b->attribute_type)
-    return (a->attribute_type < b->attribute_type);
-
-  switch (a->attribute_type)
-    {
-    case MSRP_TALKER_ADVERTISE:
-      return avb_srp_compare_talker_attributes(a,b);
-      break;
-    case MSRP_LISTENER:
-      return avb_srp_compare_listener_attributes(a,b);
-      break;
-    default:
-      break;
-    }
-  return (a<b);
+  attrs_in_use++;
+  if (attrs_in_use > attrs_high_water)
+    attrs_high_water = attrs_in_use;
+  return st;
 }
 
-mrp_attribute_state *mrp_get_attr(void)
+void mrp_get_attr_counters(struct avb_debug_counters *counters)
 {
-  for (int i=0;i<MRP_MAX_ATTRS;i++) {
-    if (attrs[i].applicant_state == MRP_UNUSED) {
-      attrs[i].applicant_state = MRP_DISABLED;
-      return &attrs[i];
-    }
-  }
-  return NULL;
+  counters->mrp_attrs_in_use = attrs_in_use;
+  counters->mrp_attrs_high_water = attrs_high_water;
+  counters->mrp_attr_exhausted = attr_exhausted;
 }
 
-static void sort_attrs()
-{
-  mrp_attribute_state *to_insert=NULL;
-  mrp_attribute_state *attr=NULL;
-  mrp_attribute_state *prev=NULL;
-
-  // This sorting algorithm is designed to work best for lists
-  // we already expect to be sorted (which is generally the case here)
+static void global_event(mrp_event e, unsigned int port_num) {
+  for (int t=0;t<MRP_NUM_ATTRIBUTE_TYPES;t++) {
+    mrp_attribute_state *attr = first_attr[t];
 
-  // Get items to insert back in
-  attr = first_attr;
-  while (attr != NULL) {
-    mrp_attribute_state *next = attr->next;
-    if (next != NULL) {
-      if (!compare_attr(attr, next)) {
-        if (prev)
-          prev->next = next;
-        else
-          first_attr = next;
+    while (attr != NULL) {
+      // The attribute may leave the list as it is updated
+      mrp_attribute_state *next = attr->next;
 
-        attr->next = to_insert;
-        to_insert = attr;
-      }
-      else
-        prev = attr;
-    }
-    attr = next;
-  }
+      if (attr->applicant_state != MRP_DISABLED &&
+          attr->applicant_state != MRP_UNUSED &&
+          attr->port_num == port_num) {
 
-  // Inser them back in
-  attr = to_insert;
-  while (attr != NULL) {
-    mrp_attribute_state *next = attr->next;
-    mrp_attribute_state *ins = first_attr;
-
-    if (compare_attr(attr, ins)) {
-      attr->next = ins;
-      first_attr = attr;
-    }
-    else {
-      while (ins != NULL) {
-        mrp_attribute_state *ins_next = ins->next;
-        if (ins_next == NULL ||
-            (compare_attr(ins, attr) && compare_attr(attr, ins_next))) {
-          attr->next = ins->next;
-          ins->next = attr;
-          ins_next = NULL;
+        if (e != MRP_EVENT_PERIODIC || attr->attribute_type == MVRP_VID_VECTOR)
+        {
+          mrp_update_state(e, attr, 0, port_num);
         }
-        ins = ins_next;
-      }
-    }
-    attr = next;
-  }
-
-
-}
-
-static void global_event(mrp_event e, unsigned int port_num) {
-  mrp_attribute_state *attr = first_attr;
-
-  while (attr != NULL) {
-    if (attr->applicant_state != MRP_DISABLED &&
-        attr->applicant_state != MRP_UNUSED &&
-        attr->port_num == port_num) {
-
-      if (e != MRP_EVENT_PERIODIC || attr->attribute_type == MVRP_VID_VECTOR)
-      {
-        mrp_update_state(e, attr, 0, port_num);
       }
+      attr = next;
     }
-    attr = attr->next;
   }
-
 }
 
 static void attribute_type_event(mrp_attribute_type atype, mrp_event e, unsigned int port_num) {
-  mrp_attribute_state *attr = first_attr;
+  mrp_attribute_state *attr = first_attr[attr_list(atype)];
 
   while (attr != NULL) {
+    // The attribute may leave the list as it is updated
+    mrp_attribute_state *next = attr->next;
+
     if (attr->applicant_state != MRP_DISABLED &&
         attr->applicant_state != MRP_UNUSED &&
         attr->attribute_type == atype &&
@@ -1021,7 +1071,7 @@ static void attribute_type_event(mrp_attribute_type atype, mrp_event e, unsigned
 
           mrp_update_state(e, attr, 0, port_num);
         }
-    attr = attr->next;
+    attr = next;
   }
 }
 
@@ -1106,7 +1156,6 @@ void mrp_periodic(CLIENT_INTERFACE(avb_interface, avb))
     if (avb_timer_expired(&joinTimer[i]))
     {
       start_avb_timer(&joinTimer[i], MRP_JOINTIMER_PERIOD_CENTISECONDS);
-      sort_attrs();
 
       mrp_event tx_event = mvrp_leaveall_active[i] ? MRP_EVENT_TX_LEAVE_ALL : MRP_EVENT_TX;
       configure_send_buffer(mvrp_dest_mac, AVB_MVRP_ETHERTYPE);
@@ -1419,6 +1468,9 @@ void avb_mrp_process_packet(unsigned char *buf, int etype, int len, unsigned int
   mrp_header *hdr = (mrp_header *)&buf[0];
   unsigned char protocol_version = hdr->ProtocolVersion;
 
+  // The streams and VLANs of the attributes may have changed since the last MRPDU
+  attr_index.stale = 1;
+
   while (msg < end && (msg[0]!=0 || msg[1]!=0))
   {
     mrp_msg_header *hdr = (mrp_msg_header *) &msg[0];
@@ -1451,6 +1503,7 @@ void avb_mrp_process_packet(unsigned char *buf, int etype, int len, unsigned int
       int threepacked_len = (numvalues+2)/3;
       int fourpacked_len = has_fourpacked_events(attr_type)?(numvalues+3)/4:0;
       int len = sizeof(mrp_vector_header) + first_value_len + threepacked_len + fourpacked_len;
+      enum mrp_index_class index_class = mrp_attr_index_class(attr_type);
 
       if ((etype == AVB_SRP_ETHERTYPE) && (len+sizeof(mrp_msg_footer) > attribute_list_length(hdr))) {
         return;
@@ -1470,13 +1523,13 @@ void avb_mrp_process_packet(unsigned char *buf, int etype, int len, unsigned int
       {
         int matched_attribute = 0;
         // Get the three packed data out of the vector
-        int vector = *(first_value + first_value_len + i/3);
+        int vector = *(unsigned char *) (first_value + first_value_len + i/3);
         if (vector > 0xD7) break; // Unused range of the threepacked vector should be rejected before decoding
         int three_packed_event = decode_threepacked(vector, i%3);
 
         // Get the four packed data out of the vector
         int four_packed_event = has_fourpacked_events(attr_type) ?
-          decode_fourpacked(*(first_value + first_value_len + threepacked_len + i/4),i%4) : 0;
+          decode_fourpacked(*(unsigned char *) (first_value + first_value_len + threepacked_len + i/4),i%4) : 0;
 
         if (MRP_DEBUG_ATTR_INGRESS)
         {
@@ -1484,13 +1537,32 @@ void avb_mrp_process_packet(unsigned char *buf, int etype, int len, unsigned int
         }
 
         // This allows the application state machines to respond to the message
-        for (int j=0;j<MRP_MAX_ATTRS;j++)
+        if (index_class != MRP_INDEX_NONE)
+        {
+          // Only the attributes with this value can match it
+          unsigned long long value = mrp_attr_index_value(attr_type, first_value, i);
+          for (int pos = mrp_attr_index_find(&attr_index, index_class, port_num, value);
+               mrp_attr_index_match(&attr_index, pos, index_class, port_num, value);
+               pos++)
+          {
+            mrp_attribute_state *st = attr_index.entries[pos].attr;
+            if (match_attribute_of_same_type(attr_type, st, first_value, i, three_packed_event, four_packed_event, port_num, leave_all))
+            {
+              matched_attribute = 1;
+              mrp_in(three_packed_event, four_packed_event, st, port_num);
+            }
+          }
+        }
+        else
         {
-          // Attempt to match to this endpoint's attributes
-          if (match_attribute_of_same_type(attr_type, &attrs[j], first_value, i, three_packed_event, four_packed_event, port_num, leave_all))
+          for (int j=0;j<MRP_MAX_ATTRS;j++)
           {
-            matched_attribute = 1;
-            mrp_in(three_packed_event, four_packed_event, &attrs[j], port_num);
+            // Attempt to match to this endpoint's attributes
+            if (match_attribute_of_same_type(attr_type, &attrs[j], first_value, i, three_packed_event, four_packed_event, port_num, leave_all))
+            {
+              matched_attribute = 1;
+              mrp_in(three_packed_event, four_packed_event, &attrs[j], port_num);
+            }
           }
         }
 
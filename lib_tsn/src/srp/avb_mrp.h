@@ -25,14 +25,25 @@
 #define MRP_NUM_PORTS (NUM_ETHERNET_MASTER_PORTS)
 
 
+/** The number of attributes to allow for, on top of those needed for the
+ *  local sources and sinks, for other devices' streams. A bridge sees a
+ *  Talker and Listener attribute for each stream passing through it, on
+ *  each port, which can far outnumber its own. Registrations received when
+ *  every attribute is in use are dropped and counted in the
+ *  mrp_attr_exhausted debug counter.
+ */
+#ifndef MRP_EXTRA_ATTRS
+#define MRP_EXTRA_ATTRS 0
+#endif
+
 #ifndef MRP_MAX_ATTRS
 #if MRP_NUM_PORTS == 1
 // There are 3 attributes per stream (talker_advertise, talker_failed
 // and listener). Therefore the number of attributes needed is:
 // (nTalkers * 3) + (nListeners * 3) + (nDomains=1) + AVB_MAX_NUM_VLAN + AVB_MAX_MMRP_GROUPS
-#define MRP_MAX_ATTRS ((3*(AVB_NUM_SOURCES)) + (3*(AVB_NUM_SINKS)) + 1 + (AVB_MAX_NUM_VLAN))
+#define MRP_MAX_ATTRS ((3*(AVB_NUM_SOURCES)) + (3*(AVB_NUM_SINKS)) + 1 + (AVB_MAX_NUM_VLAN) + (MRP_EXTRA_ATTRS))
 #else
-#define MRP_MAX_ATTRS (12*4+4)
+#define MRP_MAX_ATTRS (12*4+4 + (MRP_EXTRA_ATTRS))
 #endif
 #endif
 
@@ -50,7 +61,9 @@
 #define mrp_change_applicant_state(st, event, new) \
        do { \
           if (new == MRP_UNUSED) { \
+            int was_unused = ((st)->applicant_state == MRP_UNUSED); \
             if (srp_cleanup_reservation_entry((event), (st))) { \
+              if (!was_unused) mrp_attribute_unused((st)); \
               if (MRP_DEBUG_STATE_CHANGE) debug_print_applicant_state_change((st), (event), (new)); \
             } \
           } \
@@ -175,12 +188,65 @@ void mrp_encode_four_packed_event(char *buf,
                                   int event,
                                   mrp_attribute_type attr);
 
+/** The largest NumberOfValues of a vector, a 13 bit field */
+#define MRP_MAX_VECTOR_VALUES 0x1fff
+
+/** Function: mrp_get_num_values
+
+   \returns the NumberOfValues of the vector of the message at buf
+*/
+int mrp_get_num_values(char *buf);
+
+/** Function: mrp_set_num_values
+
+   Set the NumberOfValues of the vector of the message at buf, leaving its
+   LeaveAllEvent unchanged.
+*/
+void mrp_set_num_values(char *buf, int num_values);
+
+/** Function: mrp_get_attr
+
+   Take an attribute from the free list, in the MRP_DISABLED state.
+
+   \returns the attribute, or NULL if all MRP_MAX_ATTRS are in use
+*/
 mrp_attribute_state *mrp_get_attr(void);
 
+/** Function: mrp_attribute_value_changed
+
+   Move an attribute back into the order of its type's list after its value,
+   such as the Stream ID of its attribute_info, has been changed in place.
+   Does nothing to the lists for an attribute that is not in one.
+*/
+void mrp_attribute_value_changed(mrp_attribute_state *st);
+
+/** Function: mrp_attribute_info_changed
+
+   Call mrp_attribute_value_changed() for every attribute whose
+   attribute_info is info, as after a stream table entry has been rewritten.
+*/
+void mrp_attribute_info_changed(void *info);
+
+/** Function: mrp_attribute_unused
+
+   Remove an attribute that has become unused from the lists that are walked
+   to transmit attributes and return it to the free list. Called by
+   mrp_change_applicant_state().
+*/
+void mrp_attribute_unused(mrp_attribute_state *st);
+
 #endif
 #ifdef __XC__
 extern "C" {
 #endif
+/** Function: mrp_get_attr_counters
+
+   Fill in the attribute pool counters of an avb_debug_counters structure:
+   the attributes in use, the most that have been in use at once and the
+   number of times that none was free.
+*/
+void mrp_get_attr_counters(REFERENCE_PARAM(struct avb_debug_counters, counters));
+
 void avb_mrp_process_packet(unsigned char *buf, int etype, int len, unsigned int port_num);
 #ifdef __XC__
 }
@@ -0,0 +1,159 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "avb_mrp_index.h"
+#include "avb_srp_pdu.h"
+#include "avb_mvrp_pdu.h"
+
+#define GROUP(port_num, cls) (((port_num) << 2) | (cls))
+
+enum mrp_index_class mrp_attr_index_class(int attr_type)
+{
+  switch (attr_type) {
+  case MSRP_TALKER_ADVERTISE:
+  case MSRP_TALKER_FAILED:
+    return MRP_INDEX_TALKER;
+  case MSRP_LISTENER:
+    return MRP_INDEX_LISTENER;
+  case MVRP_VID_VECTOR:
+    return MRP_INDEX_VID;
+  default:
+    return MRP_INDEX_NONE;
+  }
+}
+
+// The value the SRP and MVRP match functions compare an attribute by
+static enum mrp_index_class attr_value(mrp_attribute_state *st,
+                                       unsigned long long *value)
+{
+  enum mrp_index_class cls;
+
+  if (st->applicant_state == MRP_UNUSED ||
+      st->applicant_state == MRP_DISABLED ||
+      st->attribute_info == NULL)
+    return MRP_INDEX_NONE;
+
+  cls = mrp_attr_index_class(st->attribute_type);
+  switch (cls) {
+  case MRP_INDEX_TALKER: {
+    avb_source_info_t *source_info = (avb_source_info_t *) st->attribute_info;
+    *value = ((unsigned long long) source_info->reservation.stream_id[0] << 32) +
+             source_info->reservation.stream_id[1];
+    break;
+  }
+  case MRP_INDEX_LISTENER: {
+    avb_sink_info_t *sink_info = (avb_sink_info_t *) st->attribute_info;
+    *value = ((unsigned long long) sink_info->reservation.stream_id[0] << 32) +
+             sink_info->reservation.stream_id[1];
+    break;
+  }
+  case MRP_INDEX_VID:
+    *value = (unsigned) *((int *) st->attribute_info);
+    break;
+  default:
+    break;
+  }
+  return cls;
+}
+
+unsigned long long mrp_attr_index_value(int attr_type, char *fv, int i)
+{
+  unsigned long long value = 0;
+
+  switch (mrp_attr_index_class(attr_type)) {
+  case MRP_INDEX_TALKER:
+  case MRP_INDEX_LISTENER: {
+    srp_listener_first_value *first_value = (srp_listener_first_value *) fv;
+    for (int j=0;j<8;j++) {
+      value = (value << 8) + first_value->StreamId[j];
+    }
+    return value + i;
+  }
+  case MRP_INDEX_VID: {
+    mvrp_vid_vector_first_value *first_value = (mvrp_vid_vector_first_value *) fv;
+    return (unsigned) ((first_value->vlan[0] << 8) + first_value->vlan[1] + i);
+  }
+  default:
+    return 0;
+  }
+}
+
+static int entry_before(mrp_attr_index_entry_t *a, mrp_attr_index_entry_t *b)
+{
+  if (a->group != b->group)
+    return a->group < b->group;
+  if (a->value != b->value)
+    return a->value < b->value;
+  return a->attr < b->attr;
+}
+
+void mrp_attr_index_init(mrp_attr_index_t *ix, mrp_attribute_state attrs[], int n)
+{
+  for (int i=0;i<n;i++) {
+    ix->entries[i].attr = &attrs[i];
+    ix->entries[i].group = GROUP(0, MRP_INDEX_NONE);
+    ix->entries[i].value = 0;
+  }
+  ix->num_entries = n;
+  ix->stale = 1;
+}
+
+void mrp_attr_index_refresh(mrp_attr_index_t *ix)
+{
+  for (int i=0;i<ix->num_entries;i++) {
+    mrp_attr_index_entry_t *e = &ix->entries[i];
+    unsigned long long value = 0;
+    enum mrp_index_class cls = attr_value(e->attr, &value);
+
+    // Unindexed attributes sort after every port's
+    if (cls == MRP_INDEX_NONE)
+      e->group = ~0u;
+    else
+      e->group = GROUP(e->attr->port_num, cls);
+    e->value = value;
+  }
+
+  // An insertion sort, as the order rarely changes between refreshes
+  for (int i=1;i<ix->num_entries;i++) {
+    mrp_attr_index_entry_t e = ix->entries[i];
+    int j = i;
+    while (j > 0 && entry_before(&e, &ix->entries[j-1])) {
+      ix->entries[j] = ix->entries[j-1];
+      j--;
+    }
+    ix->entries[j] = e;
+  }
+  ix->stale = 0;
+}
+
+int mrp_attr_index_find(mrp_attr_index_t *ix,
+                        enum mrp_index_class cls,
+                        unsigned int port_num,
+                        unsigned long long value)
+{
+  unsigned int group = GROUP(port_num, cls);
+  int lo = 0, hi;
+
+  if (ix->stale)
+    mrp_attr_index_refresh(ix);
+
+  hi = ix->num_entries;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    mrp_attr_index_entry_t *e = &ix->entries[mid];
+    if (e->group < group || (e->group == group && e->value < value))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+int mrp_attr_index_match(mrp_attr_index_t *ix,
+                         int pos,
+                         enum mrp_index_class cls,
+                         unsigned int port_num,
+                         unsigned long long value)
+{
+  return pos < ix->num_entries &&
+         ix->entries[pos].group == GROUP(port_num, cls) &&
+         ix->entries[pos].value == value;
+}
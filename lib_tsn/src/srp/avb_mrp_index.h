@@ -0,0 +1,72 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __avb_mrp_index_h__
+#define __avb_mrp_index_h__
+
+#include "avb_mrp.h"
+#include "avb_mvrp.h"
+
+/** \file avb_mrp_index.h
+ *  \brief An index of MRP attributes by port, type and value
+ *
+ *  Each value in a received MRPDU is matched against the attributes of
+ *  its type on the port it arrived on. Rather than offering it to every
+ *  attribute, the attributes are kept sorted by port, type and their
+ *  Stream ID or VID so that the few that can match are found by a binary
+ *  search.
+ *
+ *  Attribute values are held by the SRP and MVRP code and can change
+ *  without MRP being told, so the index is refreshed before each MRPDU is
+ *  processed. The attributes rarely move between refreshes, which makes
+ *  this a single pass.
+ */
+
+/** The attribute types that are indexed. Talker Advertise and Talker
+ *  Failed attributes are matched as one type. */
+enum mrp_index_class {
+  MRP_INDEX_TALKER,
+  MRP_INDEX_LISTENER,
+  MRP_INDEX_VID,
+  MRP_INDEX_NONE      ///< Not indexed, or not in use
+};
+
+typedef struct mrp_attr_index_entry_t {
+  unsigned int group;        ///< Port and mrp_index_class, the primary sort key
+  unsigned long long value;  ///< Stream ID or VID
+  mrp_attribute_state *attr;
+} mrp_attr_index_entry_t;
+
+typedef struct mrp_attr_index_t {
+  int stale;                 ///< Refresh before the next lookup
+  int num_entries;
+  mrp_attr_index_entry_t entries[MRP_MAX_ATTRS];
+} mrp_attr_index_t;
+
+/** Index the attributes attrs[0..n-1], at most MRP_MAX_ATTRS */
+void mrp_attr_index_init(mrp_attr_index_t *ix, mrp_attribute_state attrs[], int n);
+
+/** Reread the port, type and value of every attribute and re-sort */
+void mrp_attr_index_refresh(mrp_attr_index_t *ix);
+
+/** The index class of a received attribute type */
+enum mrp_index_class mrp_attr_index_class(int attr_type);
+
+/** The value of the i'th value of a vector with first value fv */
+unsigned long long mrp_attr_index_value(int attr_type, char *fv, int i);
+
+/** The position of the first attribute of class cls on port_num with the
+ *  given value, refreshing the index first if it is stale. Matching
+ *  attributes follow it in attrs[] order while mrp_attr_index_match() is
+ *  true. */
+int mrp_attr_index_find(mrp_attr_index_t *ix,
+                        enum mrp_index_class cls,
+                        unsigned int port_num,
+                        unsigned long long value);
+
+/** Whether the attribute at pos is of class cls on port_num with value */
+int mrp_attr_index_match(mrp_attr_index_t *ix,
+                         int pos,
+                         enum mrp_index_class cls,
+                         unsigned int port_num,
+                         unsigned long long value);
+
+#endif // __avb_mrp_index_h__
@@ -97,7 +97,7 @@ typedef struct mrp_attribute_state {
   //! then the parameter is stored here
   short four_vector_parameter;
 
-  //! While sorting the attributes, this contains a linked list of sorted attributes
+  //! The next attribute in the sorted list of attributes of the same type
   struct mrp_attribute_state *next;
 
   //! Attribute originated on this participant
@@ -87,35 +87,42 @@ int avb_mvrp_merge_message(char *buf,
                           int vector)
 {
    mrp_msg_header *mrp_hdr = (mrp_msg_header *) buf;
-  mrp_vector_header *hdr =
-    (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
+  mvrp_vid_vector_first_value *first_value =
+    (mvrp_vid_vector_first_value *) (buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header));
+  int *vlan = (int*) st->attribute_info;
   int merge = 0;
   int num_values;
   if (mrp_hdr->AttributeType != AVB_MVRP_VID_VECTOR_ATTRIBUTE_TYPE)
     return 0;
 
-  num_values = hdr->NumberOfValuesLow;
+  num_values = mrp_get_num_values(buf);
 
   if (num_values == 0)
     merge = 1;
+  else if (num_values < MRP_MAX_VECTOR_VALUES)
+    merge = (*vlan == (first_value->vlan[0] << 8) + first_value->vlan[1] + num_values);
 
   if (merge) {
-    mvrp_vid_vector_first_value *first_value =
-      (mvrp_vid_vector_first_value *) (buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header));
-    int *vlan = (int*) st->attribute_info;
-
-    first_value->vlan[0] = (*vlan >> 8) & 0xff;
-    first_value->vlan[1] = (*vlan) & 0xff;
+    if (num_values == 0) {
+      first_value->vlan[0] = (*vlan >> 8) & 0xff;
+      first_value->vlan[1] = (*vlan) & 0xff;
+    }
 
     mrp_encode_three_packed_event(buf, vector, st->attribute_type);
 
-    hdr->NumberOfValuesLow = num_values+1;
+    mrp_set_num_values(buf, num_values+1);
 
   }
 
   return merge;
 }
 
+int avb_mvrp_compare_vid_attributes(mrp_attribute_state *a,
+                                    mrp_attribute_state *b)
+{
+  return (*(int *) a->attribute_info < *(int *) b->attribute_info);
+}
+
 
 
 int avb_mvrp_match_vid_vector(mrp_attribute_state *attr,
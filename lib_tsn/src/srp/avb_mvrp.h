@@ -59,6 +59,10 @@ int avb_mvrp_merge_message(char *buf,
                           mrp_attribute_state *st,
                            int vector);
 
+//! Callback because MRP is keeping the VID attributes in VID order
+int avb_mvrp_compare_vid_attributes(mrp_attribute_state *a,
+                                    mrp_attribute_state *b);
+
 //! Callback when the MRP module is checking whether an atribute matches something that we are looking for
 int avb_mvrp_match_vid_vector(mrp_attribute_state *attr,
                    char *msg,
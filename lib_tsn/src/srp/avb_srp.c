@@ -122,14 +122,23 @@ static int srp_match_reservation_entry_by_id(unsigned stream_id[2]) {
   return empty_index;
 }
 
+static int srp_stream_id_is(avb_stream_entry *entry, unsigned stream_id[2]) {
+  return entry->reservation.stream_id[0] == stream_id[0] &&
+         entry->reservation.stream_id[1] == stream_id[1];
+}
+
+// An entry's attributes are kept in the order of its Stream ID, so they are
+// told when a free entry is taken for another stream or one is removed
 avb_stream_entry *srp_add_reservation_entry_stream_id_only(unsigned int stream_id[2]) {
   int entry = srp_match_reservation_entry_by_id(stream_id);
 
   if (entry >= 0) {
+    int changed = !srp_stream_id_is(&stream_table[entry], stream_id);
     if (!stream_table[entry].talker_present) memset(&stream_table[entry].reservation, 0, sizeof(avb_srp_info_t));
     stream_table[entry].reservation.stream_id[0] = stream_id[0];
     stream_table[entry].reservation.stream_id[1] = stream_id[1];
     stream_table[entry].listener_present = 1;
+    if (changed) mrp_attribute_info_changed(&stream_table[entry]);
     debug_printf("Added stream:\n ID: %x%x\n", stream_id[0], stream_id[1]);
   } else {
     debug_printf("Assert: Out of stream entries\n");
@@ -144,7 +153,9 @@ avb_stream_entry *srp_add_reservation_entry(avb_srp_info_t *reservation) {
 
   if (entry >= 0) {
     const int reservation_size_minus_failure_info = sizeof(avb_srp_info_t)-(sizeof(avb_srp_info_t)-offsetof(avb_srp_info_t, failure_bridge_id));
+    int changed = !srp_stream_id_is(&stream_table[entry], reservation->stream_id);
     memcpy(&stream_table[entry].reservation, reservation, reservation_size_minus_failure_info);
+    if (changed) mrp_attribute_info_changed(&stream_table[entry]);
     debug_printf("Added stream:\n ID: %x%x\n DA:", reservation->stream_id[0], reservation->stream_id[1]);
     for (int i=0; i < 6; i++) {
       printhex(stream_table[entry].reservation.dest_mac_addr[i]); printchar(':');
@@ -168,6 +179,7 @@ void srp_remove_reservation_entry(avb_srp_info_t *reservation) {
   if (entry >= 0) {
     debug_printf("Removed stream:\n ID: %x%x\n", reservation->stream_id[0], reservation->stream_id[1]);
     memset(&stream_table[entry], 0x00, sizeof(avb_stream_entry));
+    mrp_attribute_info_changed(&stream_table[entry]);
   } else {
     debug_printf("Assert: Tried to remove a reservation that isn't stored: %x%d", reservation->stream_id[0], reservation->stream_id[1]);
     __builtin_trap();
@@ -212,6 +224,10 @@ int srp_cleanup_reservation_entry(mrp_event event, mrp_attribute_state *st) {
 static void create_propagated_attribute_and_join(mrp_attribute_state *attr, int new) {
   mrp_attribute_state *st = mrp_get_attr();
   avb_srp_info_t *stream_data = attr->attribute_info;
+  if (st == NULL) {
+    // Counted by mrp_get_attr() as the attribute pool being exhausted
+    return;
+  }
   mrp_attribute_init(st, attr->attribute_type, !attr->port_num, 0, stream_data);
 #if 0
   debug_printf("JOIN mrp_attribute_init: %d, %d, STREAM_ID[0]: %x\n", attr->attribute_type, !attr->port_num, stream_data->stream_id[0]);
@@ -583,9 +599,11 @@ short avb_srp_create_and_join_talker_advertise_attrs(avb_srp_info_t *reservation
       mrp_attribute_state *matched_talker = mrp_match_type_non_prop_attribute(MSRP_TALKER_ADVERTISE, reservation->stream_id, i);
       if (!matched_talker) matched_talker = mrp_match_type_non_prop_attribute(MSRP_TALKER_FAILED, reservation->stream_id, i);
 
-      if (reservation->vlan_id == 0) {
+      if (reservation->vlan_id == 0 &&
+          stream_ptr->reservation.vlan_id != current_vlan_id_from_domain) {
         // A VID of 0 indicates that we should join the VID from the domain
         stream_ptr->reservation.vlan_id = current_vlan_id_from_domain;
+        mrp_attribute_info_changed(stream_ptr);
       }
 
       avb_join_vlan(stream_ptr->reservation.vlan_id, i);
@@ -805,8 +823,9 @@ mrp_attribute_state* avb_srp_process_new_attribute_from_packet(int mrp_attribute
 
   if (stream_ptr) {
     mrp_attribute_state *st = mrp_get_attr();
-    mrp_attribute_init(st, mrp_attribute_type, port_num, 0, stream_ptr);
-
+    if (st) {
+      mrp_attribute_init(st, mrp_attribute_type, port_num, 0, stream_ptr);
+    }
     return st;
   }
   else {
@@ -861,12 +880,14 @@ void avb_srp_talker_leave_ind(mrp_attribute_state *attr)
 static int check_listener_firstvalue_merge(char *buf,
                                 avb_sink_info_t *sink_info)
 {
-  mrp_vector_header *hdr = (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
-  int num_values = hdr->NumberOfValuesLow;
+  int num_values = mrp_get_num_values(buf);
   unsigned long long stream_id=0, my_stream_id=0;
   srp_listener_first_value *first_value =
     (srp_listener_first_value *) (buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header));
 
+  if (num_values >= MRP_MAX_VECTOR_VALUES)
+    return 0;
+
   // check if we can merge
   my_stream_id = sink_info->reservation.stream_id[0];
   my_stream_id = (my_stream_id << 32) + sink_info->reservation.stream_id[1];
@@ -891,8 +912,6 @@ static int encode_listener_message(char *buf,
                                   int vector)
 {
   mrp_msg_header *mrp_hdr = (mrp_msg_header *) buf;
-  mrp_vector_header *hdr =
-    (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
   int merge = 0;
   avb_sink_info_t *sink_info = st->attribute_info;
 
@@ -901,7 +920,7 @@ static int encode_listener_message(char *buf,
   if (mrp_hdr->AttributeType != AVB_SRP_ATTRIBUTE_TYPE_LISTENER)
     return 0;
 
-  num_values = hdr->NumberOfValuesLow;
+  num_values = mrp_get_num_values(buf);
 
   if (num_values == 0)
     merge = 1;
@@ -937,7 +956,7 @@ static int encode_listener_message(char *buf,
       mrp_encode_four_packed_event(buf, AVB_SRP_FOUR_PACKED_EVENT_ASKING_FAILED, st->attribute_type);
     }
 
-    hdr->NumberOfValuesLow = num_values+1;
+    mrp_set_num_values(buf, num_values+1);
 
   }
 
@@ -986,8 +1005,6 @@ static int encode_domain_message(char *buf,
                                 int vector)
 {
   mrp_msg_header *mrp_hdr = (mrp_msg_header *) buf;
-  mrp_vector_header *hdr =
-    (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
   int merge = 0;
   int num_values;
 
@@ -996,7 +1013,7 @@ static int encode_domain_message(char *buf,
     return 0;
 
 
-  num_values = hdr->NumberOfValuesLow;
+  num_values = mrp_get_num_values(buf);
 
   if (num_values == 0)
     merge = 1;
@@ -1014,66 +1031,91 @@ static int encode_domain_message(char *buf,
 
     mrp_encode_three_packed_event(buf, vector, st->attribute_type);
 
-    hdr->NumberOfValuesLow = num_values+1;
+    mrp_set_num_values(buf, num_values+1);
   }
 
   return merge;
 }
 
 
+static void encode_talker_first_value(char *fv,
+                                      mrp_attribute_state *st,
+                                      avb_srp_info_t *attribute_info)
+{
+  srp_talker_first_value *first_value = (srp_talker_first_value *) fv;
+  unsigned int streamid;
+
+  for (int i=0;i<6;i++) {
+    first_value->DestMacAddr[i] = attribute_info->dest_mac_addr[i];
+  }
+
+  streamid = byterev(attribute_info->stream_id[0]);
+  memcpy(&first_value->StreamId[0], &streamid, 4);
+  streamid = byterev(attribute_info->stream_id[1]);
+  memcpy(&first_value->StreamId[4], &streamid, 4);
+
+  if (attribute_info->vlan_id) {
+    hton_16(first_value->VlanID, attribute_info->vlan_id);
+  }
+  else {
+    hton_16(first_value->VlanID, current_vlan_id_from_domain);
+  }
+  first_value->TSpec = attribute_info->tspec;
+  hton_16(first_value->TSpecMaxFrameSize, attribute_info->tspec_max_frame_size);
+  hton_16(first_value->TSpecMaxIntervalFrames,
+             attribute_info->tspec_max_interval);
+  hton_32(first_value->AccumulatedLatency,
+             attribute_info->accumulated_latency);
+
+  if (st->attribute_type == MSRP_TALKER_FAILED) {
+    srp_talker_failed_first_value *first_value =
+      (srp_talker_failed_first_value *) fv;
+
+    first_value->FailureCode = attribute_info->failure_code;
+    for (int i=0; i < 8; i++) {
+      first_value->FailureBridgeId[i] = attribute_info->failure_bridge_id[i];
+    }
+  }
+}
+
+// A Talker value follows the vector's last if its Stream ID and destination
+// MAC address are each one more, and everything else is the same
 static int check_talker_firstvalue_merge(char *buf,
-                              avb_source_info_t *source_info)
+                                         mrp_attribute_state *st,
+                                         avb_srp_info_t *attribute_info)
 {
-  mrp_vector_header *hdr = (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
-  int num_values = hdr->NumberOfValuesLow;
+  int num_values = mrp_get_num_values(buf);
+  int first_value_length = ((mrp_msg_header *) buf)->AttributeLength;
   unsigned long long stream_id=0, my_stream_id=0;
   unsigned long long dest_addr=0, my_dest_addr=0;
-  int framesize=0, my_framesize=0;
-  int vlan, my_vlan;
+  srp_talker_failed_first_value my_first_value;
   srp_talker_first_value *first_value =
     (srp_talker_first_value *) (buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header));
 
-  // check if we can merge
-
-  for (int i=0;i<6;i++) {
-    my_dest_addr = (my_dest_addr << 8) + source_info->reservation.dest_mac_addr[i];
-    dest_addr = (dest_addr << 8) + first_value->DestMacAddr[i];
-  }
-
-  dest_addr += num_values;
-
-  if (dest_addr != my_dest_addr)
+  if (num_values >= MRP_MAX_VECTOR_VALUES)
     return 0;
 
   // check if we can merge
-  my_stream_id = source_info->reservation.stream_id[0];
-  my_stream_id = (my_stream_id << 32) + source_info->reservation.stream_id[1];
+  encode_talker_first_value((char *) &my_first_value, st, attribute_info);
 
   for (int i=0;i<8;i++) {
+    my_stream_id = (my_stream_id << 8) + my_first_value.StreamId[i];
     stream_id = (stream_id << 8) + first_value->StreamId[i];
   }
 
-  stream_id += num_values;
-
-  if (my_stream_id != stream_id)
+  if (my_stream_id != stream_id + num_values)
     return 0;
 
+  for (int i=0;i<6;i++) {
+    my_dest_addr = (my_dest_addr << 8) + my_first_value.DestMacAddr[i];
+    dest_addr = (dest_addr << 8) + first_value->DestMacAddr[i];
+  }
 
-  vlan = ntoh_16(first_value->VlanID);
-  my_vlan = source_info->reservation.vlan_id;
-
-  if (vlan != my_vlan)
-    return 0;
-
-  my_framesize = source_info->reservation.tspec_max_frame_size;
-  framesize = ntoh_16(first_value->TSpecMaxFrameSize);
-
-  if (framesize != my_framesize)
+  if (my_dest_addr != ((dest_addr + num_values) & 0xffffffffffffULL))
     return 0;
 
-
-  return 1;
-
+  return memcmp(&my_first_value.VlanID, first_value->VlanID,
+                first_value_length - offsetof(srp_talker_first_value, VlanID)) == 0;
 }
 
 static int encode_talker_message(char *buf,
@@ -1081,11 +1123,8 @@ static int encode_talker_message(char *buf,
                                 int vector)
 {
   mrp_msg_header *mrp_hdr = (mrp_msg_header *) buf;
-  mrp_vector_header *hdr =
-    (mrp_vector_header *) (buf + sizeof(mrp_msg_header));
   int merge = 0;
-  avb_source_info_t *source_info = st->attribute_info;
-  avb_srp_info_t *attribute_info;
+  avb_srp_info_t *attribute_info = st->attribute_info;
   int num_values;
 
   if ((st->attribute_type == MSRP_TALKER_ADVERTISE) && (mrp_hdr->AttributeType != AVB_SRP_ATTRIBUTE_TYPE_TALKER_ADVERTISE)) {
@@ -1096,71 +1135,29 @@ static int encode_talker_message(char *buf,
     return 0;
   }
 
-  if (st->here)
-    attribute_info = &source_info->reservation;
-  else
-    attribute_info = st->attribute_info;
-
-  num_values = hdr->NumberOfValuesLow;
+  num_values = mrp_get_num_values(buf);
 
   if (num_values == 0)
     merge = 1;
   else
-    merge = check_talker_firstvalue_merge(buf, source_info);
+    merge = check_talker_firstvalue_merge(buf, st, attribute_info);
 
 
 
   if (merge) {
-    srp_talker_first_value *first_value =
-      (srp_talker_first_value *) (buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header));
-
-    // The SRP layer
-
     if (num_values == 0) {
-      unsigned int streamid;
-      for (int i=0;i<6;i++) {
-        first_value->DestMacAddr[i] = attribute_info->dest_mac_addr[i];
-      }
-
-      streamid = byterev(attribute_info->stream_id[0]);
-      memcpy(&first_value->StreamId[0], &streamid, 4);
-      streamid = byterev(attribute_info->stream_id[1]);
-      memcpy(&first_value->StreamId[4], &streamid, 4);
+      encode_talker_first_value(buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header),
+                                st, attribute_info);
 
       if (MRP_DEBUG_ATTR_EGRESS)
       {
         debug_printf("TX: MSRP_TALKER_ADVERTISE, stream %x:%x\n", attribute_info->stream_id[0], attribute_info->stream_id[1]);
       }
-
-      if (attribute_info->vlan_id) {
-        hton_16(first_value->VlanID, attribute_info->vlan_id);
-      }
-      else {
-        hton_16(first_value->VlanID, current_vlan_id_from_domain);
-      }
-      first_value->TSpec = attribute_info->tspec;
-      hton_16(first_value->TSpecMaxFrameSize, attribute_info->tspec_max_frame_size);
-      hton_16(first_value->TSpecMaxIntervalFrames,
-                 attribute_info->tspec_max_interval);
-      hton_32(first_value->AccumulatedLatency,
-                 attribute_info->accumulated_latency);
-
-      if (st->attribute_type == MSRP_TALKER_FAILED) {
-        srp_talker_failed_first_value *first_value =
-          (srp_talker_failed_first_value *) (buf + sizeof(mrp_msg_header) + sizeof(mrp_vector_header));
-
-        first_value->FailureCode = attribute_info->failure_code;
-        for (int i=0; i < 8; i++) {
-          first_value->FailureBridgeId[i] = attribute_info->failure_bridge_id[i];
-        }
-
-      }
-
     }
 
     mrp_encode_three_packed_event(buf, vector, st->attribute_type);
 
-    hdr->NumberOfValuesLow = num_values+1;
+    mrp_set_num_values(buf, num_values+1);
 
   }
 
@@ -1199,9 +1196,18 @@ int avb_srp_encode_message(char *buf,
 int avb_srp_compare_talker_attributes(mrp_attribute_state *a,
                                       mrp_attribute_state *b)
 {
-  avb_stream_info_t *source_info_a = (avb_stream_info_t *) a->attribute_info;
-  avb_stream_info_t *source_info_b = (avb_stream_info_t *) b->attribute_info;
-  return (source_info_a->local_id < source_info_b->local_id);
+  // Local sources and received streams both start with their reservation
+  avb_srp_info_t *reservation_a = (avb_srp_info_t *) a->attribute_info;
+  avb_srp_info_t *reservation_b = (avb_srp_info_t *) b->attribute_info;
+  unsigned int *sA = reservation_a->stream_id;
+  unsigned int *sB = reservation_b->stream_id;
+  for (int i=0;i<2;i++) {
+    if (sA[i] < sB[i])
+      return 1;
+    if (sB[i] < sA[i])
+      return 0;
+  }
+  return 0;
 }
 
 int avb_srp_compare_listener_attributes(mrp_attribute_state *a,
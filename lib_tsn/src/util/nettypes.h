@@ -56,6 +56,13 @@ inline n32_t hton32(u32_t x) {
   return ret;
 }
 
+inline n64_t hton64(u64_t x) {
+  n64_t ret;
+  for (int i=0;i<8;i++)
+    ret.data[i] = (x >> (56 - i*8)) & 0xff;
+  return ret;
+}
+
 inline n80_t hton80(u80_t x) {
   n80_t ret;
   for (int i=0;i<10;i++)
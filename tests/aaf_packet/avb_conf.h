@@ -0,0 +1,11 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __avb_conf_h__
+#define __avb_conf_h__
+
+#define AVB_1722_FORMAT_AAF 1
+
+// Not a multiple of the 8kHz packet rate, so AAF packets at this rate round
+// up to 23 samples
+#define AVB_MAX_AUDIO_SAMPLE_RATE 176400
+
+#endif
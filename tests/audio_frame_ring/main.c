@@ -0,0 +1,175 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "audio_frame_ring.h"
+
+/* Host stress test and benchmark of the audio input frame ring. A producer
+ * thread fills and publishes numbered frames, as the audio hardware
+ * interface does, and a consumer thread takes them in batches, as the 1722
+ * talker does. Frames must arrive whole and in order, and every frame must
+ * be either received or counted as an overrun.
+ */
+
+#define NUM_FRAMES 1000000u
+
+static audio_frame_ring_t ring;
+static int producer_done;
+static int wait_for_space;
+
+static void fill_frame(audio_frame_t *frame, unsigned int n)
+{
+  frame->timestamp = n;
+  for (int i = 0; i < AVB_NUM_MEDIA_INPUTS; i++) {
+    frame->samples[i] = n * AVB_NUM_MEDIA_INPUTS + i;
+  }
+}
+
+static void *producer(void *arg)
+{
+  audio_frame_t *frame = audio_frame_ring_first_frame(&ring);
+
+  for (unsigned int n = 1; n <= NUM_FRAMES; n++) {
+    unsigned int overruns = ring.overruns;
+
+    fill_frame(frame, n);
+    frame = audio_frame_ring_publish(&ring);
+    if (wait_for_space) {
+      // Retry the dropped frame until the consumer has made room
+      while (ring.overruns != overruns) {
+        overruns = ring.overruns;
+        sched_yield();
+        frame = audio_frame_ring_publish(&ring);
+      }
+      ring.overruns = 0;
+    }
+  }
+
+  __atomic_store_n(&producer_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  unsigned int *received = arg;
+  unsigned int last = 0;
+
+  for (;;) {
+    unsigned int n = audio_frame_ring_available(&ring);
+    audio_frame_t *frames = audio_frame_ring_read_ptr(&ring);
+
+    if (n == 0) {
+      if (__atomic_load_n(&producer_done, __ATOMIC_ACQUIRE) &&
+          audio_frame_ring_available(&ring) == 0)
+        break;
+      sched_yield();
+      continue;
+    }
+
+    for (unsigned int f = 0; f < n; f++) {
+      unsigned int ts = frames[f].timestamp;
+      if (ts <= last) {
+        printf("FAIL: frame %u after %u\n", ts, last);
+        exit(1);
+      }
+      for (int i = 0; i < AVB_NUM_MEDIA_INPUTS; i++) {
+        if (frames[f].samples[i] != ts * AVB_NUM_MEDIA_INPUTS + i) {
+          printf("FAIL: frame %u is torn\n", ts);
+          exit(1);
+        }
+      }
+      last = ts;
+    }
+    *received += n;
+    audio_frame_ring_release(&ring, n);
+  }
+  return NULL;
+}
+
+static int run(int wait)
+{
+  pthread_t p, c;
+  unsigned int received = 0;
+
+  audio_frame_ring_init(&ring);
+  producer_done = 0;
+  wait_for_space = wait;
+
+  pthread_create(&c, NULL, consumer, &received);
+  pthread_create(&p, NULL, producer, NULL);
+  pthread_join(p, NULL);
+  pthread_join(c, NULL);
+
+  if (received + ring.overruns != NUM_FRAMES) {
+    printf("FAIL: %u received, %u overruns\n", received, ring.overruns);
+    return 1;
+  }
+  if (wait && received != NUM_FRAMES) {
+    printf("FAIL: %u received\n", received);
+    return 1;
+  }
+  return 0;
+}
+
+static double seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Single threaded cost of passing frames through the ring in batches of
+// the given size, in nanoseconds per frame
+static double benchmark(unsigned int batch)
+{
+  volatile unsigned int sink = 0;
+  audio_frame_t *frame;
+  double start;
+
+  audio_frame_ring_init(&ring);
+  frame = audio_frame_ring_first_frame(&ring);
+  start = seconds();
+  for (unsigned int n = 0; n < NUM_FRAMES * 10; n += batch) {
+    for (unsigned int f = 0; f < batch; f++) {
+      frame->timestamp = n + f;
+      frame = audio_frame_ring_publish(&ring);
+    }
+    while (audio_frame_ring_available(&ring)) {
+      unsigned int k = audio_frame_ring_available(&ring);
+      audio_frame_t *frames = audio_frame_ring_read_ptr(&ring);
+      for (unsigned int f = 0; f < k; f++) {
+        sink += frames[f].timestamp;
+      }
+      audio_frame_ring_release(&ring, k);
+    }
+  }
+  return (seconds() - start) * 1e9 / (NUM_FRAMES * 10);
+}
+
+int main(int argc, char *argv[])
+{
+  if (((char *) &ring.rd_seq - (char *) &ring.wr_seq) < AUDIO_OUTPUT_FIFO_RING_LINE_WORDS * 4) {
+    printf("FAIL: sequence numbers share a cache line\n");
+    return 1;
+  }
+  printf("PASS\n");
+
+  if (run(1) != 0)
+    return 1;
+  printf("PASS\n");
+
+  if (run(0) != 0)
+    return 1;
+  printf("PASS\n");
+
+  if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+    for (unsigned int batch = 1; batch < AUDIO_INPUT_FRAME_RING_DEPTH; batch *= 2) {
+      printf("batch %u: %.2f ns/frame\n", batch, benchmark(batch));
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,180 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "audio_output_fifo_ring.h"
+
+/* Host stress test of the media output FIFO ring: a producer thread writes
+ * a rising sequence in bursts and a consumer thread reads it back one word
+ * at a time, as the 1722 listener and audio threads do. Every word must come
+ * out in order and every word must either be read or counted as dropped.
+ * Then the ring's storage is resized between bursts, as a FIFO is enabled
+ * again for another stream.
+ */
+
+#define RING_SIZE 128
+#define RING_MASK (RING_SIZE - 1)
+#define MAX_BURST 8
+#define NUM_WORDS 2000000u
+
+static audio_output_fifo_ring_t ring;
+static unsigned int buf[RING_SIZE];
+static int producer_done;
+static int wait_for_space;
+
+static void *producer(void *arg)
+{
+  unsigned int seed = 1;
+  unsigned int v = 1;
+
+  while (v < NUM_WORDS) {
+    unsigned int n = 1 + rand_r(&seed) % MAX_BURST;
+    unsigned int space, wr;
+
+    if (wait_for_space) {
+      while (audio_output_fifo_ring_space(&ring, RING_MASK) < n)
+        sched_yield();
+    }
+
+    space = audio_output_fifo_ring_space(&ring, RING_MASK);
+    if (n > space) {
+      ring.overflow_count += n - space;
+      v += n - space;
+      n = space;
+    }
+
+    wr = ring.wr;
+    for (unsigned int i = 0; i < n; i++) {
+      buf[(wr + i) & RING_MASK] = v++;
+    }
+    audio_output_fifo_ring_commit(&ring, n);
+  }
+
+  __atomic_store_n(&producer_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  unsigned int *received = arg;
+  unsigned int last = 0;
+
+  for (;;) {
+    int rd = audio_output_fifo_ring_peek(&ring, RING_MASK);
+
+    if (rd < 0) {
+      if (__atomic_load_n(&producer_done, __ATOMIC_ACQUIRE) &&
+          audio_output_fifo_ring_fill(&ring, RING_MASK) == 0)
+        break;
+      ring.underflow_count++;
+      sched_yield();
+      continue;
+    }
+
+    if (buf[rd] <= last) {
+      printf("FAIL: read %u after %u\n", buf[rd], last);
+      exit(1);
+    }
+    last = buf[rd];
+    (*received)++;
+    audio_output_fifo_ring_consume(&ring);
+  }
+  return NULL;
+}
+
+static int run(int wait)
+{
+  pthread_t p, c;
+  unsigned int received = 0;
+
+  audio_output_fifo_ring_init(&ring);
+  producer_done = 0;
+  wait_for_space = wait;
+
+  pthread_create(&c, NULL, consumer, &received);
+  pthread_create(&p, NULL, producer, NULL);
+  pthread_join(p, NULL);
+  pthread_join(c, NULL);
+
+  if (received + ring.overflow_count < NUM_WORDS - 1 ||
+      received + ring.overflow_count > NUM_WORDS - 1 + MAX_BURST) {
+    printf("FAIL: %u received, %u dropped\n", received, ring.overflow_count);
+    return 1;
+  }
+  if (wait && ring.overflow_count != 0) {
+    printf("FAIL: %u dropped\n", ring.overflow_count);
+    return 1;
+  }
+  return 0;
+}
+
+/* The listener empties a FIFO and gives it storage of another size while
+ * the audio thread's read index runs on from where it was. Words written
+ * into the new storage must come out in order, across the wrap of the
+ * indices themselves too.
+ */
+static int resize(void)
+{
+  unsigned int mask = RING_MASK;
+  unsigned int v = 1, last = 0;
+
+  audio_output_fifo_ring_init(&ring);
+  ring.rd = ring.wr = 0xffffff00u;
+
+  for (int round = 0; round < 16; round++) {
+    unsigned int n = mask - round;
+    int rd;
+
+    for (unsigned int i = 0; i < n; i++)
+      buf[(ring.wr + i) & mask] = v++;
+    audio_output_fifo_ring_commit(&ring, n);
+    if (audio_output_fifo_ring_fill(&ring, mask) != n) {
+      printf("FAIL: fill %u after writing %u\n", audio_output_fifo_ring_fill(&ring, mask), n);
+      return 1;
+    }
+
+    // Read most of it, then empty the rest as release_fifo() does
+    for (unsigned int i = 0; i < n / 2 && (rd = audio_output_fifo_ring_peek(&ring, mask)) >= 0; i++) {
+      if (buf[rd] != last + 1) {
+        printf("FAIL: read %u after %u\n", buf[rd], last);
+        return 1;
+      }
+      last = buf[rd];
+      audio_output_fifo_ring_consume(&ring);
+    }
+    audio_output_fifo_ring_commit(&ring, ring.rd - ring.wr);
+    if (audio_output_fifo_ring_peek(&ring, mask) >= 0) {
+      printf("FAIL: not empty after release\n");
+      return 1;
+    }
+    last = v - 1;
+
+    mask = (round & 1) ? RING_MASK : RING_MASK >> 2;
+  }
+  return 0;
+}
+
+int main(void)
+{
+  if (sizeof(ring) % (AUDIO_OUTPUT_FIFO_RING_LINE_WORDS * 4) != 0 ||
+      ((char *) &ring.wr - (char *) &ring.rd) < AUDIO_OUTPUT_FIFO_RING_LINE_WORDS * 4) {
+    printf("FAIL: indices share a cache line\n");
+    return 1;
+  }
+  printf("PASS\n");
+
+  if (run(1) != 0)
+    return 1;
+  printf("PASS\n");
+
+  if (run(0) != 0)
+    return 1;
+  printf("PASS\n");
+
+  if (resize() != 0)
+    return 1;
+  printf("PASS\n");
+
+  return 0;
+}
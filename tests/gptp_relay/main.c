@@ -0,0 +1,217 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gptp_relay.h"
+#include "gptp_servo.h"
+#include "gptp_time.h"
+
+/* Host tests of the time-aware relay arithmetic (gptp_relay.c) and of the
+ * neighbor rate ratio measurement (gptp_servo.c) that feeds it.
+ *
+ * After unit checks of the rate offset and correctionField arithmetic, a
+ * chain of relays between a grandmaster and an end station is simulated,
+ * each with its own crystal offset and 10ns timestamps, measuring its
+ * neighbor rate ratio from Pdelay exchanges and holding each Sync for a
+ * random residence time before forwarding it. The end station's estimate
+ * of the grandmaster's time at Sync ingress is compared with the truth,
+ * with and without the residence time scaled by the cumulative rate ratio.
+ */
+
+#define NS_PER_S 1000000000LL
+#define MAX_HOPS 7
+#define NUM_SYNCS 2000
+
+// Pdelay exchanges before the first Sync, at PDELAY_REQ_PERIOD
+#define PDELAY_EXCHANGES 16
+#define PDELAY_INTERVAL_NS 1000000000.0
+
+#define LINK_DELAY_NS 480.0
+#define MAX_RESIDENCE_NS 1000000.0
+
+static int failures;
+
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    if (failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } \
+  } \
+} while (0)
+
+// Repeatable on every host, unlike rand()
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static double rand_uniform(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void test_rate_offset(void)
+{
+  static const double ppms[] = {0, 1, -1, 100, -100, 250, -250};
+  int n = sizeof(ppms) / sizeof(ppms[0]);
+
+  for (int i=0; i < n; i++) {
+    for (int j=0; j < n; j++) {
+      int upstream = (int) llround(ppms[i] * 1e-6 * (1LL << PTP_RATE_OFFSET_PREC));
+      int neighbor = (int) llround(ppms[j] * 1e-6 * (1LL << PTP_ADJUST_PREC));
+      double expect = ((1 + upstream / (double) (1LL << PTP_RATE_OFFSET_PREC)) *
+                       (1 + neighbor / (double) (1LL << PTP_ADJUST_PREC)) - 1) *
+                      (1LL << PTP_RATE_OFFSET_PREC);
+      int got = ptp_relay_rate_offset(upstream, neighbor);
+
+      CHECK(fabs(got - expect) <= 2, "rate offset %g ppm * %g ppm = %d, expected %.1f",
+            ppms[i], ppms[j], got, expect);
+    }
+  }
+
+  CHECK(ptp_relay_rate_offset(0x7ff00000, 1 << 24) == 0x7fffffff, "rate offset saturates");
+  CHECK(ptp_relay_rate_offset(-0x7ff00000, -(1 << 24)) == (int) 0x80000000, "rate offset saturates");
+}
+
+static void test_correction(void)
+{
+  int rate_offset = (int) llround(100e-6 * (1LL << PTP_RATE_OFFSET_PREC));
+  long long c;
+
+  // No residence time adds just the link delay
+  c = ptp_relay_correction(0, rate_offset, 500, 1000, 1000);
+  CHECK(c == 500LL << 16, "correction with no residence %lld", c);
+
+  // 1ms of residence at +100ppm is 1000.1us of grandmaster time
+  c = ptp_relay_correction(3LL << 16, rate_offset, 500, 0xffffff00u, 0xffffff00u + 100000);
+  CHECK(llabs(c - ((3 + 500 + 1000100LL) << 16)) <= 1,
+        "correction across local timer wrap %lld", c >> 16);
+
+  // The upstream correction is passed on including its sub-nanoseconds
+  c = ptp_relay_correction(-12345, 0, 0, 0, 10);
+  CHECK(c == -12345 + (100LL << 16), "correction %lld", c);
+}
+
+typedef struct device_t {
+  double ppm;       ///< Crystal offset from the grandmaster
+  double phase;     ///< Local time at grandmaster time 0, ns
+  ptp_path_delay_t delay_info;  ///< Of the port towards the grandmaster
+} device_t;
+
+static double local_ns(const device_t *d, double t)
+{
+  return d->phase + t * (1 + d->ppm * 1e-6);
+}
+
+// The local timer at grandmaster time t
+static unsigned local_ticks(const device_t *d, double t)
+{
+  return (unsigned) (unsigned long long) floor(local_ns(d, t) / PTP_NANOSECONDS_PER_LOCAL_TICK);
+}
+
+// The grandmaster time at which the local timer reads ns
+static double gm_time(const device_t *d, double ns)
+{
+  return (ns - d->phase) / (1 + d->ppm * 1e-6);
+}
+
+// A Pdelay_Resp egress timestamp, which the responder takes from its
+// free running local time
+static void local_to_timestamp(const device_t *d, double t, ptp_timestamp *ts)
+{
+  long long ns = (long long) floor(local_ns(d, t) / PTP_NANOSECONDS_PER_LOCAL_TICK) *
+                 PTP_NANOSECONDS_PER_LOCAL_TICK;
+
+  ts->seconds[1] = 0;
+  ts->seconds[0] = (unsigned) (ns / NS_PER_S);
+  ts->nanoseconds = (unsigned) (ns % NS_PER_S);
+}
+
+static void measure_neighbor_rate_ratios(device_t dev[], int hops)
+{
+  for (int k=1; k <= hops; k++) {
+    memset(&dev[k].delay_info, 0, sizeof(dev[k].delay_info));
+    for (int i=0; i < PDELAY_EXCHANGES; i++) {
+      double t = i * PDELAY_INTERVAL_NS + rand_uniform() * 1000.0;
+      ptp_timestamp resp_egress_ts;
+
+      local_to_timestamp(&dev[k-1], t, &resp_egress_ts);
+      ptp_servo_neighbor_rate_ratio(&dev[k].delay_info, &resp_egress_ts,
+                                    local_ticks(&dev[k], t + LINK_DELAY_NS), 0);
+    }
+  }
+}
+
+/* Pass NUM_SYNCS Syncs along a chain of hops relays and return the worst
+   error of the end station's estimate of the grandmaster's time, in ns */
+static double run_chain(int hops, int rate_correct)
+{
+  device_t dev[MAX_HOPS + 2];
+  double worst = 0;
+
+  // dev[0] is the grandmaster and dev[hops+1] the end station
+  for (int k=0; k < hops + 2; k++) {
+    dev[k].ppm = k ? (rand_uniform() * 2 - 1) * 100 : 0;
+    dev[k].phase = k ? rand_uniform() * 1e12 : 0;
+  }
+  measure_neighbor_rate_ratios(dev, hops + 1);
+
+  for (int i=0; i < NUM_SYNCS; i++) {
+    // The grandmaster sends from 20s, after the Pdelay exchanges
+    double t = 20.0 * NS_PER_S + i * 125e6 + rand_uniform() * 1000.0;
+    long long origin = (long long) floor(t / PTP_NANOSECONDS_PER_LOCAL_TICK) *
+                       PTP_NANOSECONDS_PER_LOCAL_TICK;
+    long long correction = 0;
+    int rate_offset = 0;
+    double estimate, error;
+
+    t = origin;
+    for (int k=1; k <= hops; k++) {
+      double t_in = t + LINK_DELAY_NS;
+      double residence = rand_uniform() * MAX_RESIDENCE_NS;
+      double t_out = gm_time(&dev[k], local_ns(&dev[k], t_in) + residence);
+
+      rate_offset = ptp_relay_rate_offset(rate_offset, dev[k].delay_info.neighbor_rate_ratio);
+      correction = ptp_relay_correction(correction, rate_correct ? rate_offset : 0,
+                                        (unsigned) LINK_DELAY_NS,
+                                        local_ticks(&dev[k], t_in),
+                                        local_ticks(&dev[k], t_out));
+      t = t_out;
+    }
+
+    // The end station adds its own link delay to the corrected origin
+    estimate = origin + correction / 65536.0 + LINK_DELAY_NS;
+    error = fabs(estimate - (t + LINK_DELAY_NS));
+    if (error > worst)
+      worst = error;
+  }
+  return worst;
+}
+
+static void test_chain(void)
+{
+  printf("hops  worst error  without rate ratio\n");
+  for (int hops=1; hops <= MAX_HOPS; hops++) {
+    double relay = run_chain(hops, 1);
+    double uncorrected = run_chain(hops, 0);
+
+    printf("%4d  %8.1f ns  %11.1f ns\n", hops, relay, uncorrected);
+
+    // Each hop adds up to a tick at each of its two timestamps
+    CHECK(relay <= 2 * PTP_NANOSECONDS_PER_LOCAL_TICK * hops + 1,
+          "%d hops: worst error %.1f ns", hops, relay);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  test_rate_offset();
+  test_correction();
+  test_chain();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,522 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gptp_servo.h"
+#include "gptp_time.h"
+#include "gptp_capture.h"
+
+/* Replays a trace of Sync/Follow_Up pairs and path delay measurements
+ * through the gPTP servo (gptp_servo.c) and reports how well it predicts
+ * the grandmaster's time.
+ *
+ * A trace is text, one event per line:
+ *
+ *   sync <local_ts> <master_s> <master_ns> <pdelay> [<noise_ns>]
+ *   pdelay <delay_ns>
+ *   pdelay <t1> <t2_s> <t2_ns> <t3_s> <t3_ns> <t4>
+ *
+ * local_ts is the local timer at Sync ingress, master_s/master_ns the
+ * corrected precise origin timestamp and pdelay the path delay in ns that
+ * was in use. Once a trace has pdelay lines they are filtered by the path
+ * delay filter and its result is used instead; a pdelay line is either a
+ * measured delay or the four timestamps of the exchange to measure it from.
+ * noise_ns, if known, is the true grandmaster time at ingress less
+ * master + pdelay, which generated traces record so that the error against
+ * the truth can be reported as well as the error against the measurement.
+ *
+ * With -c the input is instead a binary capture from a PTP server
+ * (gptp_capture.h): either records read with ptp_get_capture() and written
+ * one after another, or the whole ptp_capture ring dumped from a debugger
+ * with e.g. "dump binary value capture.bin ptp_capture". The results the
+ * server recorded are compared with the replay's, so with the same servo
+ * the replay should reproduce them from the first Sync after a reset.
+ *
+ * With -g a trace is generated from a model of a local crystal, network
+ * jitter and outliers instead of being read, -w writes it out and -C
+ * writes the replay of it as a capture.
+ */
+
+#define NS_PER_S 1000000000LL
+
+// The sync interval of PTP_LOG_SYNC_INTERVAL, 125ms
+#define SYNC_INTERVAL_NS 125000000LL
+
+// The generated peer's Pdelay_Resp turnaround time
+#define TURNAROUND_NS 20000
+
+// Syncs before errors are counted, while any servo is still settling
+#define WARMUP_SYNCS 64
+
+typedef struct event_t {
+  int is_sync;
+  unsigned local_ts[2];         ///< As ptp_capture_record_t
+  ptp_timestamp master_ts[2];
+  int has_timestamps;           ///< A pdelay is measured from its timestamps
+  long long pdelay;             ///< The path delay in use, or measured
+  int has_noise;
+  long long noise;
+  int captured;                 ///< record holds a PTP server's results
+  ptp_capture_record_t record;
+} event_t;
+
+typedef struct gen_params_t {
+  double ppm;           ///< Local crystal offset from the grandmaster
+  double wander;        ///< Random walk of the offset per Sync in ppm
+  double jitter;        ///< Standard deviation of the timestamp noise in ns
+  double outlier_prob;  ///< Probability a Sync or Pdelay is delayed
+  double outlier_ns;    ///< How long an outlier is delayed by
+  long long step_ns;    ///< A step of the grandmaster's time...
+  int step_at;          ///< ... at this Sync, or none if 0
+  int count;
+  long long pdelay;
+} gen_params_t;
+
+// Repeatable on every host, unlike rand()
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static double rand_uniform(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rand_normal(void)
+{
+  double u = rand_uniform(), v = rand_uniform();
+  if (u < 1e-300)
+    u = 1e-300;
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void ns_to_timestamp(ptp_timestamp *ts, long long ns)
+{
+  ts->seconds[1] = 0;
+  ts->seconds[0] = (unsigned) (ns / NS_PER_S);
+  ts->nanoseconds = (unsigned) (ns % NS_PER_S);
+}
+
+static unsigned long long timestamp_seconds(const ptp_timestamp *ts)
+{
+  return ts->seconds[0] | ((unsigned long long) ts->seconds[1] << 32);
+}
+
+static event_t *generate(const gen_params_t *p, int *num_events)
+{
+  event_t *events = calloc(2 * p->count, sizeof(event_t));
+  double ppm = p->ppm;
+  // The grandmaster's time and the local time in ticks, as doubles
+  double master = 1000.0 * NS_PER_S, local = 12345678.0;
+  long long step = 0;
+  int n = 0;
+
+  for (int i = 0; i < p->count; i++) {
+    double delay = p->jitter * rand_normal();
+    double rate = 1 + ppm * 1e-6, arrival;
+    double forward = p->pdelay + p->jitter * rand_normal();
+    double back = p->pdelay + p->jitter * rand_normal();
+    event_t *e;
+
+    if (rand_uniform() < p->outlier_prob)
+      delay += p->outlier_ns;
+    if (rand_uniform() < p->outlier_prob)
+      back += p->outlier_ns;
+
+    if (p->step_at && i == p->step_at)
+      step = p->step_ns;
+
+    // A Pdelay exchange half way between Syncs
+    e = &events[n++];
+    e->has_timestamps = 1;
+    e->local_ts[0] = (unsigned) llrint(local + SYNC_INTERVAL_NS / 2 * rate / 10);
+    ns_to_timestamp(&e->master_ts[0], llrint(master + SYNC_INTERVAL_NS / 2 + forward) + step);
+    ns_to_timestamp(&e->master_ts[1], llrint(master + SYNC_INTERVAL_NS / 2 + forward + TURNAROUND_NS) + step);
+    e->local_ts[1] = (unsigned) llrint(local + (SYNC_INTERVAL_NS / 2 + forward + TURNAROUND_NS + back) * rate / 10);
+
+    // The Sync arrives pdelay + delay after it was sent, the local timer
+    // is read to the nearest tick
+    arrival = local + (p->pdelay + delay) * rate / 10;
+    e = &events[n++];
+    e->is_sync = 1;
+    e->local_ts[0] = (unsigned) llrint(arrival);
+    ns_to_timestamp(&e->master_ts[0], llrint(master) + step);
+    e->pdelay = p->pdelay;
+    e->has_noise = 1;
+    e->noise = llrint(delay + (llrint(arrival) - arrival) * 10 / rate);
+
+    master += SYNC_INTERVAL_NS;
+    local += SYNC_INTERVAL_NS * rate / 10;
+    ppm += p->wander * rand_normal();
+  }
+  *num_events = n;
+  return events;
+}
+
+static event_t *add_event(event_t *events, int *n, int *size)
+{
+  if (*n == *size) {
+    *size *= 2;
+    events = realloc(events, *size * sizeof(event_t));
+  }
+  memset(&events[*n], 0, sizeof(event_t));
+  return events;
+}
+
+static event_t *read_trace(FILE *f, int *num_events)
+{
+  int size = 1024, n = 0;
+  event_t *events = malloc(size * sizeof(event_t));
+  char line[256];
+
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long long s[2];
+    long long pdelay, noise;
+    unsigned local_ts[2], ns[2];
+    int fields;
+    event_t *e;
+
+    events = add_event(events, &n, &size);
+    e = &events[n];
+    if (sscanf(line, "pdelay %u %llu %u %llu %u %u", &local_ts[0], &s[0], &ns[0],
+               &s[1], &ns[1], &local_ts[1]) == 6) {
+      e->has_timestamps = 1;
+      for (int i = 0; i < 2; i++) {
+        e->local_ts[i] = local_ts[i];
+        e->master_ts[i].seconds[0] = (unsigned) s[i];
+        e->master_ts[i].seconds[1] = (unsigned) (s[i] >> 32);
+        e->master_ts[i].nanoseconds = ns[i];
+      }
+    }
+    else if (sscanf(line, "pdelay %lld", &pdelay) == 1) {
+      e->pdelay = pdelay;
+    }
+    else if ((fields = sscanf(line, "sync %u %llu %u %lld %lld", &local_ts[0], &s[0], &ns[0], &pdelay, &noise)) >= 4) {
+      e->is_sync = 1;
+      e->local_ts[0] = local_ts[0];
+      e->master_ts[0].seconds[0] = (unsigned) s[0];
+      e->master_ts[0].seconds[1] = (unsigned) (s[0] >> 32);
+      e->master_ts[0].nanoseconds = ns[0];
+      e->pdelay = pdelay;
+      e->has_noise = fields == 5;
+      e->noise = e->has_noise ? noise : 0;
+    }
+    else
+      continue;
+    n++;
+  }
+  *num_events = n;
+  return events;
+}
+
+static int compare_index(const void *a, const void *b)
+{
+  const ptp_capture_record_t *ra = a, *rb = b;
+  return ra->index < rb->index ? -1 : ra->index > rb->index;
+}
+
+static event_t *read_capture(FILE *f, int *num_events)
+{
+  ptp_capture_record_t *records;
+  long size;
+  int n, count, skip = 0;
+  event_t *events;
+
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  // A dump of the ring starts with its count, records read by a client do
+  // not
+  if (size % sizeof(ptp_capture_record_t) == sizeof(unsigned)) {
+    unsigned captured;
+    if (fread(&captured, sizeof(captured), 1, f) != 1)
+      return NULL;
+    n = size / sizeof(ptp_capture_record_t);
+    skip = captured < (unsigned) n ? n - captured : 0;
+  }
+  else if (size % sizeof(ptp_capture_record_t) == 0)
+    n = size / sizeof(ptp_capture_record_t);
+  else {
+    fprintf(stderr, "capture size %ld is not a whole number of records\n", size);
+    return NULL;
+  }
+
+  records = malloc((n + 1) * sizeof(ptp_capture_record_t));
+  if (fread(records, sizeof(ptp_capture_record_t), n, f) != (size_t) n)
+    return NULL;
+
+  // The unused entries of a ring that has not filled are at its end
+  count = n - skip;
+  qsort(records, count, sizeof(ptp_capture_record_t), compare_index);
+
+  events = calloc(count + 1, sizeof(event_t));
+  for (int i = 0; i < count; i++) {
+    const ptp_capture_record_t *r = &records[i];
+    event_t *e = &events[i];
+
+    e->is_sync = r->type == PTP_CAPTURE_SYNC;
+    e->has_timestamps = !e->is_sync;
+    memcpy(e->local_ts, r->local_ts, sizeof(e->local_ts));
+    memcpy(e->master_ts, r->master_ts, sizeof(e->master_ts));
+    e->pdelay = r->pdelay;
+    e->captured = 1;
+    e->record = *r;
+    if (i && r->index != records[i - 1].index + 1)
+      printf("records %u to %u are missing\n", records[i - 1].index + 1, r->index - 1);
+  }
+  free(records);
+  *num_events = count;
+  return events;
+}
+
+static void write_trace(FILE *f, const event_t *events, int num_events)
+{
+  for (int i = 0; i < num_events; i++) {
+    const event_t *e = &events[i];
+    if (!e->is_sync && e->has_timestamps)
+      fprintf(f, "pdelay %u %llu %u %llu %u %u\n", e->local_ts[0],
+              timestamp_seconds(&e->master_ts[0]), e->master_ts[0].nanoseconds,
+              timestamp_seconds(&e->master_ts[1]), e->master_ts[1].nanoseconds,
+              e->local_ts[1]);
+    else if (!e->is_sync)
+      fprintf(f, "pdelay %lld\n", e->pdelay);
+    else {
+      fprintf(f, "sync %u %llu %u %lld", e->local_ts[0],
+              timestamp_seconds(&e->master_ts[0]), e->master_ts[0].nanoseconds, e->pdelay);
+      if (e->has_noise)
+        fprintf(f, " %lld", e->noise);
+      fprintf(f, "\n");
+    }
+  }
+}
+
+typedef struct stats_t {
+  int n;
+  double sum_sq;
+  long long max;
+} stats_t;
+
+static void stats_add(stats_t *st, long long error)
+{
+  st->n++;
+  st->sum_sq += (double) error * error;
+  if (llabs(error) > st->max)
+    st->max = llabs(error);
+}
+
+static double ppm(int adjust)
+{
+  return adjust * 1e6 / (1 << PTP_ADJUST_PREC);
+}
+
+/* Replay events through a servo, writing what it does as a capture to
+ * capture_out if that is not NULL. Returns the number of captured events
+ * whose results the replay did not reproduce. */
+static int replay(const event_t *events, int num_events,
+                  enum ptp_servo_type_t type, int verbose, FILE *capture_out)
+{
+  ptp_servo_t servo;
+  ptp_path_delay_t delay_info;
+  ptp_time_info info;
+  ptp_capture_t capture;
+  int have_info = 0, filter_pdelay = 0, syncs = 0, discarded = 0;
+  int captured = 0, mismatches = 0;
+  stats_t measured = {0}, truth = {0};
+
+  ptp_servo_init(&servo, type);
+  ptp_capture_init(&capture);
+  memset(&delay_info, 0, sizeof(delay_info));
+
+  for (int i = 0; i < num_events; i++) {
+    const event_t *e = &events[i];
+    int pdelay = 0, result;
+
+    if (!e->is_sync) {
+      long long delay = e->pdelay;
+
+      if (e->has_timestamps)
+        delay = ptp_servo_measure_path_delay(e->local_ts[0], &e->master_ts[0], &e->master_ts[1],
+                                             e->local_ts[1], servo.adjust);
+      result = ptp_servo_path_delay(&delay_info, delay);
+      filter_pdelay = 1;
+      ptp_capture_pdelay(&capture, 0, i, e->local_ts[0], e->local_ts[1],
+                         &e->master_ts[0], &e->master_ts[1],
+                         result, servo.adjust, delay_info.pdelay);
+    }
+    else {
+      pdelay = filter_pdelay ? (int) delay_info.pdelay : (int) e->pdelay;
+
+      // How far the time the PTP server would have given for this Sync's
+      // ingress is from the measurement and from the truth
+      if (have_info && syncs >= WARMUP_SYNCS) {
+        ptp_timestamp predicted, measurement;
+        long long error, true_error = 0;
+
+        local_timestamp_to_ptp(&predicted, e->local_ts[0], &info);
+        ptp_timestamp_offset64(&measurement, &e->master_ts[0], pdelay);
+        error = ptp_timestamp_diff(&predicted, &measurement);
+        stats_add(&measured, error);
+        if (e->has_noise) {
+          // The generator's pdelay is the true one
+          true_error = error + pdelay - e->pdelay - e->noise;
+          stats_add(&truth, true_error);
+        }
+        if (verbose && !e->captured)
+          printf("%d %lld %lld %.3f\n", syncs, error, true_error, ppm(servo.adjust));
+      }
+      syncs++;
+
+      result = ptp_servo_sync(&servo, e->local_ts[0], &e->master_ts[0], pdelay);
+      if (result)
+        discarded++;
+      else {
+        info.local_ts = servo.ref_local_ts;
+        info.ptp_ts = servo.ref_ptp_ts;
+        info.ptp_adjust = servo.adjust;
+        info.inv_ptp_adjust = servo.inv_adjust;
+        have_info = 1;
+      }
+      ptp_capture_sync(&capture, 0, i, e->local_ts[0], &e->master_ts[0],
+                       result, servo.adjust, pdelay);
+    }
+
+    if (capture_out)
+      fwrite(&capture.records[(capture.count - 1) % PTP_CAPTURE_RECORDS],
+             sizeof(ptp_capture_record_t), 1, capture_out);
+
+    if (e->captured) {
+      const ptp_capture_record_t *r = &e->record;
+      int match = r->discarded == result && r->ptp_adjust == servo.adjust &&
+                  r->pdelay == delay_info.pdelay;
+
+      // Sync records hold the path delay the server used, which a replay
+      // of a capture without its Pdelays cannot know
+      if (e->is_sync && !filter_pdelay)
+        match = r->discarded == result && r->ptp_adjust == servo.adjust;
+      captured++;
+      if (!match)
+        mismatches++;
+      if (verbose || (!match && mismatches <= 10))
+        printf("%s %u port %d seq %u: server %s adjust %.3f pdelay %u, replay %s adjust %.3f pdelay %u\n",
+               e->is_sync ? "sync  " : "pdelay", r->index, r->port, r->seq_id,
+               r->discarded ? "discarded" : "used", ppm(r->ptp_adjust), r->pdelay,
+               result ? "discarded" : "used", ppm(servo.adjust),
+               e->is_sync && !filter_pdelay ? (unsigned) pdelay : delay_info.pdelay);
+    }
+  }
+
+  printf("%-4s syncs %d discarded %d outliers %u pdelay outliers %u adjust %.3f ppm%s\n",
+         type == PTP_SERVO_AVERAGE ? "avg" : "ls", syncs, discarded,
+         servo.outliers, delay_info.outliers,
+         ppm(servo.adjust), servo.locked ? " locked" : "");
+  if (measured.n)
+    printf("     error vs measured rms %.1f max %lld ns\n",
+           sqrt(measured.sum_sq / measured.n), measured.max);
+  if (truth.n)
+    printf("     error vs true     rms %.1f max %lld ns\n",
+           sqrt(truth.sum_sq / truth.n), truth.max);
+  if (captured)
+    printf("     reproduced the server's results for %d of %d records\n",
+           captured - mismatches, captured);
+  return mismatches;
+}
+
+static void usage(void)
+{
+  printf("usage: gptp_servo [options] [trace]\n"
+         "  -m avg|ls|both  servo to replay through (both)\n"
+         "  -c              the input is a binary capture\n"
+         "  -e              fail unless a capture is reproduced exactly\n"
+         "  -g              generate a trace instead of reading one\n"
+         "  -n count        generated Syncs (4000)\n"
+         "  -l ppm          local crystal offset (50)\n"
+         "  -d ppm          wander of the offset per Sync (0)\n"
+         "  -j ns           timestamp jitter (40)\n"
+         "  -o prob:ns      outlier probability and delay (0:0)\n"
+         "  -s sync:ns      grandmaster time step (none)\n"
+         "  -w file         write the trace\n"
+         "  -C file         write the first replay as a capture\n"
+         "  -v              print each Sync's error, or each captured record\n");
+  exit(1);
+}
+
+static FILE *open_file(const char *name, const char *mode)
+{
+  FILE *f = fopen(name, mode);
+  if (!f) {
+    perror(name);
+    exit(1);
+  }
+  return f;
+}
+
+int main(int argc, char *argv[])
+{
+  gen_params_t p = { 50, 0, 40, 0, 0, 0, 0, 4000, 600 };
+  const char *mode = "both", *out = NULL, *in = NULL, *capture_name = NULL;
+  int gen = 0, capture = 0, exact = 0, verbose = 0, num_events, mismatches = 0;
+  FILE *capture_out = NULL;
+  event_t *events;
+
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (!strcmp(a, "-g")) { gen = 1; continue; }
+    if (!strcmp(a, "-c")) { capture = 1; continue; }
+    if (!strcmp(a, "-e")) { exact = 1; continue; }
+    if (!strcmp(a, "-v")) { verbose = 1; continue; }
+    if (a[0] != '-') { in = a; continue; }
+    if (!v)
+      usage();
+    i++;
+    if (!strcmp(a, "-m")) mode = v;
+    else if (!strcmp(a, "-n")) p.count = atoi(v);
+    else if (!strcmp(a, "-l")) p.ppm = atof(v);
+    else if (!strcmp(a, "-d")) p.wander = atof(v);
+    else if (!strcmp(a, "-j")) p.jitter = atof(v);
+    else if (!strcmp(a, "-o")) { if (sscanf(v, "%lf:%lf", &p.outlier_prob, &p.outlier_ns) != 2) usage(); }
+    else if (!strcmp(a, "-s")) { if (sscanf(v, "%d:%lld", &p.step_at, &p.step_ns) != 2) usage(); }
+    else if (!strcmp(a, "-w")) out = v;
+    else if (!strcmp(a, "-C")) capture_name = v;
+    else usage();
+  }
+
+  if (gen)
+    events = generate(&p, &num_events);
+  else {
+    FILE *f = in ? open_file(in, capture ? "rb" : "r") : stdin;
+    events = capture ? read_capture(f, &num_events) : read_trace(f, &num_events);
+    if (!events)
+      return 1;
+    if (f != stdin)
+      fclose(f);
+  }
+
+  if (out) {
+    FILE *f = open_file(out, "w");
+    write_trace(f, events, num_events);
+    fclose(f);
+  }
+
+  if (capture_name)
+    capture_out = open_file(capture_name, "wb");
+
+  if (strcmp(mode, "ls")) {
+    mismatches += replay(events, num_events, PTP_SERVO_AVERAGE, verbose, capture_out);
+    if (capture_out) {
+      fclose(capture_out);
+      capture_out = NULL;
+    }
+  }
+  if (strcmp(mode, "avg"))
+    mismatches += replay(events, num_events, PTP_SERVO_LEAST_SQUARES, verbose, capture_out);
+  if (capture_out)
+    fclose(capture_out);
+
+  free(events);
+  return exact && mismatches ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "gptp_time.h"
+
+/* Host tests and benchmark of the local to PTP time conversions
+ * (gptp_time.c). Results are checked against 128 bit integer references
+ * around local timer wrap, PTP nanosecond wrap and seconds rollover, over
+ * the range of adjusts a crystal can need.
+ */
+
+typedef __int128 i128;
+
+#define NS_PER_S 1000000000LL
+#define NUM_RANDOM 2000000
+
+static int failures;
+
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    if (failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } \
+  } \
+} while (0)
+
+// Repeatable on every host, unlike rand()
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned long long rand64(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// Adjusts of up to +/-1000 ppm
+static int rand_adjust(void)
+{
+  return (int) (rand64() % 2147483) - 1073741;
+}
+
+static int edge_ticks[] = {
+  0, 1, -1, 2, -2, 9, -9, 10, -10, 99999999, -99999999, 100000000, -100000000,
+  INT_MAX, INT_MIN, INT_MAX - 1, INT_MIN + 1
+};
+#define NUM_EDGE_TICKS (sizeof edge_ticks / sizeof edge_ticks[0])
+
+static i128 ref_ticks_to_ns(int ticks, int adjust)
+{
+  i128 ns = (i128) ticks * 10;
+  return ns + ((ns * adjust) >> PTP_ADJUST_PREC);
+}
+
+static i128 ts_to_i128(const ptp_timestamp *ts)
+{
+  unsigned long long sec = ts->seconds[0] | ((unsigned long long) ts->seconds[1] << 32);
+  return (i128) sec * NS_PER_S + ts->nanoseconds;
+}
+
+static int ts_is(const ptp_timestamp *ts, i128 ns)
+{
+  unsigned long long sec;
+
+  if (ns < 0)
+    ns += (i128) NS_PER_S << 64;   // seconds wrap modulo 2^64
+  sec = (unsigned long long) (ns / NS_PER_S);
+  return ts->nanoseconds < NS_PER_S &&
+         ts->nanoseconds == (unsigned) (ns % NS_PER_S) &&
+         ts->seconds[0] == (unsigned) sec &&
+         ts->seconds[1] == (unsigned) (sec >> 32);
+}
+
+static void make_ts(ptp_timestamp *ts, unsigned long long sec, unsigned ns)
+{
+  ts->seconds[0] = (unsigned) sec;
+  ts->seconds[1] = (unsigned) (sec >> 32);
+  ts->nanoseconds = ns;
+}
+
+// Local timestamps either side of the reference and of the 32 bit wrap
+static void test_local_to_ptp(void)
+{
+  unsigned refs[] = { 0, 1, 0x7fffffff, 0x80000000, 0xfffffff0, 0xffffffff };
+
+  for (unsigned r = 0; r < sizeof refs / sizeof refs[0]; r++) {
+    for (unsigned e = 0; e < NUM_EDGE_TICKS; e++) {
+      for (int a = 0; a < 3; a++) {
+        int adjust = a == 0 ? 0 : a == 1 ? 1073741 : -1073741;
+        ptp_time_info_mod64 info = { refs[r], 0x12345678, 0xfffffff0, adjust, 0 };
+        ptp_time_info full = { refs[r], { { 5, 0 }, 999999990 }, adjust, 0 };
+        unsigned local_ts = refs[r] + (unsigned) edge_ticks[e];
+        i128 ns = ref_ticks_to_ns(edge_ticks[e], adjust);
+        unsigned long long mod64 = ((unsigned long long) info.ptp_ts_hi << 32) + info.ptp_ts_lo;
+        unsigned hi, lo;
+        ptp_timestamp ts;
+
+        CHECK(local_timestamp_to_ptp_mod32(local_ts, &info) == (unsigned) (info.ptp_ts_lo + ns),
+              "mod32 ref %u ticks %d adjust %d", refs[r], edge_ticks[e], adjust);
+
+        local_timestamp_to_ptp_mod64(local_ts, &info, &hi, &lo);
+        mod64 += (unsigned long long) ns;
+        CHECK(hi == (unsigned) (mod64 >> 32) && lo == (unsigned) mod64,
+              "mod64 ref %u ticks %d adjust %d", refs[r], edge_ticks[e], adjust);
+
+        local_timestamp_to_ptp(&ts, local_ts, &full);
+        CHECK(ts_is(&ts, ts_to_i128(&full.ptp_ts) + ns),
+              "timestamp ref %u ticks %d adjust %d", refs[r], edge_ticks[e], adjust);
+      }
+    }
+  }
+}
+
+static void test_random_local_to_ptp(void)
+{
+  for (int i = 0; i < NUM_RANDOM; i++) {
+    ptp_time_info_mod64 info = { (unsigned) rand64(), (unsigned) rand64(), (unsigned) rand64(),
+                                 rand_adjust(), 0 };
+    unsigned local_ts = (unsigned) rand64();
+    int ticks = (int) (local_ts - info.local_ts);
+    i128 ns = ref_ticks_to_ns(ticks, info.ptp_adjust);
+
+    CHECK(local_timestamp_to_ptp_mod32(local_ts, &info) == (unsigned) (info.ptp_ts_lo + ns),
+          "random mod32 ticks %d adjust %d", ticks, info.ptp_adjust);
+  }
+}
+
+// Offsets across nanosecond and seconds rollover both ways, including the
+// 32 bit seconds word carrying into and borrowing from the upper word
+static void test_offset(void)
+{
+  unsigned long long secs[] = { 0, 1, 2, 0xffffffffULL, 0x100000000ULL, 0x1234567812345678ULL };
+  unsigned nss[] = { 0, 1, 500000000, 999999998, 999999999 };
+  long long offsets[] = {
+    0, 1, -1, 2, -2, 999999999, -999999999, 1000000000, -1000000000, 1000000001,
+    -1000000001, 2999999999LL, -2999999999LL, INT_MAX, INT_MIN, 5000000000LL,
+    -5000000000LL, 0x7fffffffffLL, -0x7fffffffffLL
+  };
+
+  for (unsigned s = 0; s < sizeof secs / sizeof secs[0]; s++) {
+    for (unsigned n = 0; n < sizeof nss / sizeof nss[0]; n++) {
+      for (unsigned o = 0; o < sizeof offsets / sizeof offsets[0]; o++) {
+        ptp_timestamp ts, dst;
+        i128 expect;
+
+        make_ts(&ts, secs[s], nss[n]);
+        expect = ts_to_i128(&ts) + offsets[o];
+
+        ptp_timestamp_offset64(&dst, &ts, offsets[o]);
+        CHECK(ts_is(&dst, expect), "offset64 %llu.%09u %+lld", secs[s], nss[n], offsets[o]);
+        CHECK(ptp_timestamp_diff(&dst, &ts) == offsets[o],
+              "diff %llu.%09u %+lld", secs[s], nss[n], offsets[o]);
+
+        // In place, as ptp_timestamp_offset() does
+        dst = ts;
+        ptp_timestamp_offset64(&dst, &dst, offsets[o]);
+        CHECK(ts_is(&dst, expect), "offset64 in place %llu.%09u %+lld", secs[s], nss[n], offsets[o]);
+
+        if (offsets[o] >= INT_MIN && offsets[o] <= INT_MAX) {
+          dst = ts;
+          ptp_timestamp_offset(&dst, (int) offsets[o]);
+          CHECK(ts_is(&dst, expect), "offset %llu.%09u %+lld", secs[s], nss[n], offsets[o]);
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < NUM_RANDOM; i++) {
+    ptp_timestamp ts, a;
+    int offset = (int) rand64();
+
+    make_ts(&ts, rand64() >> 1, (unsigned) (rand64() % NS_PER_S));
+    a = ts;
+    ptp_timestamp_offset(&a, offset);
+    CHECK(ts_is(&a, ts_to_i128(&ts) + offset), "random offset %d", offset);
+  }
+}
+
+static void test_mod64(void)
+{
+  unsigned long long secs[] = { 0, 4, 5, 0xffffffffULL, 18446744073ULL, 0x1234567812345678ULL };
+
+  for (unsigned s = 0; s < sizeof secs / sizeof secs[0]; s++) {
+    ptp_timestamp ts;
+    unsigned hi, lo;
+    unsigned long long expect;
+
+    make_ts(&ts, secs[s], 999999999);
+    ptp_timestamp_to_mod64(&ts, &hi, &lo);
+    expect = (unsigned long long) ts_to_i128(&ts);
+    CHECK(hi == (unsigned) (expect >> 32) && lo == (unsigned) expect, "mod64 %llu s", secs[s]);
+  }
+}
+
+// PTP back to local time
+static void test_ptp_to_local(void)
+{
+  for (int i = 0; i < NUM_RANDOM; i++) {
+    int adjust = rand_adjust();
+    // The inverse adjust of a rate r is -r / (1 + r)
+    int inv_adjust = (int) (-((long long) adjust << PTP_ADJUST_PREC) / ((1LL << PTP_ADJUST_PREC) + adjust));
+    ptp_time_info_mod64 info = { (unsigned) rand64(), (unsigned) rand64(), (unsigned) rand64(),
+                                 adjust, inv_adjust };
+    ptp_time_info full = { info.local_ts, { { 7, 0 }, 999999000 }, adjust, inv_adjust };
+    // Up to about 2^31 ns either way, so that the mod32 difference is exact
+    int ticks = (int) (rand64() % 420000000) - 210000000;
+    unsigned local_ts = info.local_ts + (unsigned) ticks;
+    unsigned ts = local_timestamp_to_ptp_mod32(local_ts, &info);
+    ptp_timestamp full_ts;
+    unsigned exact;
+    int d;
+
+    exact = ptp_mod32_timestamp_to_local(ts, &info);
+    d = (int) (exact - local_ts);
+    CHECK(d >= -1 && d <= 1, "round trip ticks %d adjust %d is %d out", ticks, adjust, d);
+
+
+    local_timestamp_to_ptp(&full_ts, local_ts, &full);
+    d = (int) (ptp_timestamp_to_local(&full_ts, &full) - local_ts);
+    CHECK(d >= -1 && d <= 1, "timestamp round trip ticks %d adjust %d is %d out", ticks, adjust, d);
+  }
+}
+
+static double seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CYCLES() __builtin_ia32_rdtsc()
+#else
+#define CYCLES() 0ULL
+#endif
+
+#define BENCH_N 20000000
+
+#define BENCH(name, expr) do { \
+  volatile unsigned sink = 0; \
+  double start = seconds(); \
+  unsigned long long c0 = CYCLES(); \
+  for (unsigned i = 0; i < BENCH_N; i++) { sink += (expr); } \
+  unsigned long long c1 = CYCLES(); \
+  printf("%-32s %6.2f ns %6.2f cycles\n", name, (seconds() - start) * 1e9 / BENCH_N, \
+         (double) (c1 - c0) / BENCH_N); \
+} while (0)
+
+static void benchmark(void)
+{
+  ptp_time_info_mod64 info = { 1000, 2000, 3000, 12345, -12345 };
+  ptp_timestamp ts;
+
+  make_ts(&ts, 1500000000, 0);
+
+  BENCH("local_timestamp_to_ptp_mod32", local_timestamp_to_ptp_mod32(i * 2500, &info));
+  BENCH("ptp_mod32_timestamp_to_local", ptp_mod32_timestamp_to_local(i * 2500, &info));
+  BENCH("ptp_timestamp_offset", (ptp_timestamp_offset(&ts, 125000), ts.nanoseconds));
+}
+
+int main(int argc, char *argv[])
+{
+  test_local_to_ptp();
+  test_random_local_to_ptp();
+  test_offset();
+  test_mod64();
+  test_ptp_to_local();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+
+  if (argc > 1 && strcmp(argv[1], "-b") == 0)
+    benchmark();
+
+  return 0;
+}
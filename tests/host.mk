@@ -0,0 +1,19 @@
+# Shared rules of the tests that are built with the host C compiler rather
+# than the xCORE tools. A test's Makefile sets TARGET, SRCS, the headers in
+# DEPS that should trigger a rebuild, its HOST_CFLAGS and LDLIBS, and then
+# includes this file before any targets of its own. Headers from the xCORE
+# tools are stood in for by host/.
+
+CC ?= cc
+LIB = ../../lib_tsn
+HOST_STUBS = ../host
+CFLAGS = -O2 -Wall $(HOST_CFLAGS)
+
+bin/$(TARGET): $(SRCS) $(DEPS)
+	mkdir -p bin
+	$(CC) $(CFLAGS) -o $@ $(SRCS) $(LDLIBS)
+
+clean:
+	rm -rf bin
+
+.PHONY: clean
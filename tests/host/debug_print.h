@@ -0,0 +1,6 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the lib_logging header
+#ifndef __DEBUG_PRINT_H__
+#define __DEBUG_PRINT_H__
+#define debug_printf(...)
+#endif
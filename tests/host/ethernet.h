@@ -0,0 +1,6 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the lib_ethernet header
+#ifndef __ETHERNET_H__
+#define __ETHERNET_H__
+#define ETHERNET_ALL_INTERFACES (-1)
+#endif
@@ -0,0 +1,9 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the xCORE tools header, the simulation is single threaded
+#ifndef __HWLOCK_H__
+#define __HWLOCK_H__
+typedef unsigned hwlock_t;
+static inline hwlock_t hwlock_alloc(void) { return 1; }
+static inline void hwlock_acquire(hwlock_t lock) { (void) lock; }
+static inline void hwlock_release(hwlock_t lock) { (void) lock; }
+#endif
@@ -0,0 +1,2 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in, nothing from this header is used by the simulated code
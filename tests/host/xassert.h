@@ -0,0 +1,8 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the lib_xassert header
+#ifndef __XASSERT_H__
+#define __XASSERT_H__
+#include <stdio.h>
+#include <stdlib.h>
+#define fail(msg) do { fprintf(stderr, "%s\n", msg); abort(); } while (0)
+#endif
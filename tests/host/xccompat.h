@@ -0,0 +1,16 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the xCORE tools header, C declarations only
+#ifndef __XCCOMPAT_H__
+#define __XCCOMPAT_H__
+#define REFERENCE_PARAM(type, name) type *name
+#define NULLABLE_REFERENCE_PARAM(type, name) type *name
+#define NULLABLE_RESOURCE(type, name) type name
+#define ARRAY_OF_SIZE(type, name, size) type *name
+#define NULLABLE_ARRAY_OF_SIZE(type, name, size) type *name
+#define CLIENT_INTERFACE(type, name) unsigned name
+#define SERVER_INTERFACE(type, name) unsigned name
+#define NULLABLE_CLIENT_INTERFACE(type, name) unsigned name
+typedef unsigned chanend;
+typedef unsigned timer;
+typedef unsigned port;
+#endif
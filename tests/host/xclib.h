@@ -0,0 +1,6 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the xCORE tools header
+#ifndef __XCLIB_H__
+#define __XCLIB_H__
+static inline unsigned byterev(unsigned x) { return __builtin_bswap32(x); }
+#endif
@@ -0,0 +1,427 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "audio_output_fifo.h"
+#include "avb_1722_def.h"
+#include "avb_1722_format.h"
+#include "media_clock_client.h"
+#include "media_clock_internal.h"
+
+/* Host simulation of stream derived media clock recovery.
+ *
+ * A modelled talker samples at its nominal rate plus a ppm offset and sends
+ * class A packets stamped with presentation times. The packets arrive with a
+ * fixed latency plus random jitter and are pushed into a real media output
+ * FIFO (audio_output_fifo.c). An output sample clock, derived from the
+ * recovered word length by a first order PLL model running off a local
+ * oscillator with its own ppm offset, pulls the samples. The buffer control
+ * exchange is played out in process: buffer info goes through
+ * media_clock_manage_buffer() and the word length is updated every
+ * CLOCK_RECOVERY_PERIOD by update_media_clock() (media_clock_support.c),
+ * the same code that runs on the device.
+ *
+ * The listener's PTP time can be stepped part way through to see how the
+ * loop rides out a grandmaster change, and given measurement noise. Either
+ * servo can be run, with its parameters overridden for tuning. At the end
+ * the lock time, the time the phase error settled within SETTLE_NS, the
+ * steady state phase error over the second half of the run and the FIFO
+ * fill excursion are reported. The exit status is 0 if the output was
+ * locked at the end.
+ */
+
+#define NS_PER_LOCAL_TICK 10.0
+#define CLASS_A_PACKET_NS 125000.0
+#define SETTLE_NS 1000
+
+typedef struct sim_config_t {
+  int rate;
+  double talker_ppm;
+  double local_ppm;
+  double latency_ns;
+  double jitter_ns;
+  double presentation_ns;
+  double pll_tau_ns;
+  double duration_ns;
+  double step_at_ns;
+  double step_ns;
+  double noise_ns;
+  unsigned seed;
+  int trace;
+} sim_config_t;
+
+typedef struct sim_stats_t {
+  double lock_time_ns;
+  double settle_time_ns;
+  int locks;
+  int unlocks;
+  int resets;
+  unsigned reports;
+  double diff_sum, diff_sq_sum, diff_max;
+  int fill_min, fill_max;
+  double f_out_sum;
+  unsigned f_out_count;
+} sim_stats_t;
+
+static sim_config_t cfg;
+static sim_stats_t stats;
+
+/* The in process buffer control channel. The FIFO side calls the
+ * media_clock_client.h functions below, the server side sets the command
+ * it would have sent and calls audio_output_fifo_handle_buf_ctl().
+ */
+static int pending_new_stream;
+static int pending_info;
+static int next_cmd;
+static int next_adjust;
+static struct {
+  int locked;
+  unsigned int ptp_ts;
+  unsigned int local_ts;
+  unsigned int fill;
+  unsigned int size;
+} reported;
+
+void notify_buf_ctl_of_info(chanend buf_ctl, int fifo) { pending_info = 1; }
+void notify_buf_ctl_of_new_stream(chanend buf_ctl, int fifo) { pending_new_stream = 1; }
+void buf_ctl_ack(chanend buf_ctl) { }
+int get_buf_ctl_adjust(chanend buf_ctl) { return next_adjust; }
+int get_buf_ctl_cmd(chanend buf_ctl) { return next_cmd; }
+
+void send_buf_ctl_info(chanend buf_ctl, int active, unsigned int ptp_ts,
+                       unsigned int local_ts, unsigned int fill,
+                       unsigned int size, timer tmr)
+{
+  reported.locked = active;
+  reported.ptp_ts = ptp_ts;
+  reported.local_ts = local_ts;
+  reported.fill = fill;
+  reported.size = size;
+}
+
+void send_buf_ctl_new_stream_info(chanend buf_ctl, int media_clock) { }
+
+// Repeatable on every host, unlike rand()
+static unsigned rng_state;
+
+static double uniform(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state / 4294967296.0;
+}
+
+// True time is in ns. The talker's PTP time is true time, the listener's
+// is true time plus the step once it has happened.
+static double listener_ptp(double t)
+{
+  return t >= cfg.step_at_ns ? t + cfg.step_ns : t;
+}
+
+static unsigned int local_ticks(double t)
+{
+  return (unsigned int) (long long) floor(t * (1 + cfg.local_ppm * 1e-6) / NS_PER_LOCAL_TICK);
+}
+
+// The true time of a recent local timestamp
+static double local_to_true(unsigned int ts, double now)
+{
+  unsigned int ago = local_ticks(now) - ts;
+  return now - ago * NS_PER_LOCAL_TICK / (1 + cfg.local_ppm * 1e-6);
+}
+
+// The output sample rate, in true Hz, that a word length asks the PLL for
+static double target_output_rate(unsigned int word_length, int base_rate)
+{
+  double word_ticks = word_length / (double) (1 << WC_FRACTIONAL_BITS);
+  double local_hz = 1e9 / NS_PER_LOCAL_TICK * (1 + cfg.local_ppm * 1e-6);
+  return local_hz / word_ticks * cfg.rate / base_rate;
+}
+
+static ofifo_t fifo;
+static audio_output_fifo_arena_t arena;
+static struct output_finfo finfo;
+static buffer_handle_t h = &finfo;
+static int notified;
+static buf_info_t b;
+static media_clock_t mclock;
+
+static void send_cmd(int cmd)
+{
+  next_cmd = cmd;
+  audio_output_fifo_handle_buf_ctl(0, h, 0, &notified, 0);
+}
+
+// The media clock server's handling of a buffer info notification, as
+// manage_buffer() in media_clock_server.xc
+static void serve_info(double now)
+{
+  unsigned int ptp_outgoing_actual;
+  int diff, sample_diff;
+
+  if (b.media_clock == -1) {
+    send_cmd(BUF_CTL_ACK);
+    return;
+  }
+
+  send_cmd(BUF_CTL_REQUEST_INFO);
+  ptp_outgoing_actual = (unsigned int) (long long) (listener_ptp(local_to_true(reported.local_ts, now)) +
+                                                    cfg.noise_ns * (2 * uniform() - 1));
+  diff = (signed) ptp_outgoing_actual - (signed) reported.ptp_ts;
+
+  update_media_clock_stream_info(0, reported.local_ts, ptp_outgoing_actual,
+                                 reported.ptp_ts, reported.locked, reported.fill);
+
+  if (cfg.trace)
+    printf("trace %.6f diff %d fill %u word_length %u locked %d\n",
+           now * 1e-9, diff, reported.fill, mclock.wordLength, reported.locked);
+
+  switch (media_clock_manage_buffer(&b, mclock.wordLength, cfg.rate, diff, reported.locked,
+                                    reported.fill, reported.size, &sample_diff)) {
+    case MEDIA_CLOCK_BUF_LOCK:
+      inform_media_clock_of_lock(0);
+      next_adjust = sample_diff;
+      send_cmd(BUF_CTL_ADJUST_FILL);
+      stats.locks++;
+      stats.lock_time_ns = now;
+      break;
+    case MEDIA_CLOCK_BUF_ADJUST_TOO_LARGE:
+      send_cmd(BUF_CTL_RESET);
+      stats.resets++;
+      break;
+    case MEDIA_CLOCK_BUF_LOST_LOCK:
+    case MEDIA_CLOCK_BUF_LOST_LOCK_LARGE:
+      send_cmd(BUF_CTL_RESET);
+      stats.unlocks++;
+      stats.lock_time_ns = -1;
+      break;
+    default:
+      send_cmd(BUF_CTL_ACK);
+      break;
+  }
+
+  // The last report that was unlocked or outside SETTLE_NS
+  if (!reported.locked || diff > SETTLE_NS || diff < -SETTLE_NS)
+    stats.settle_time_ns = now;
+
+  if (reported.locked && now >= cfg.duration_ns / 2) {
+    double d = diff;
+    stats.reports++;
+    stats.diff_sum += d;
+    stats.diff_sq_sum += d * d;
+    if (fabs(d) > stats.diff_max)
+      stats.diff_max = fabs(d);
+  }
+}
+
+static void serve_notifications(double now)
+{
+  if (pending_new_stream) {
+    pending_new_stream = 0;
+    send_cmd(BUF_CTL_REQUEST_NEW_STREAM_INFO);
+    b.media_clock = 0;
+  }
+  if (pending_info) {
+    pending_info = 0;
+    serve_info(now);
+  }
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -r rate       stream sample rate in Hz (48000)\n"
+          "  -t ppm        talker media clock offset (0)\n"
+          "  -l ppm        listener local oscillator offset (0)\n"
+          "  -L us         network latency (50)\n"
+          "  -j us         peak network jitter added to the latency (0)\n"
+          "  -P us         presentation time offset (2000)\n"
+          "  -p ms         PLL settling time constant (1)\n"
+          "  -d s          simulated duration (30)\n"
+          "  -s s:ns       step the listener's PTP time by ns at s seconds\n"
+          "  -n ns         peak PTP time measurement noise (0)\n"
+          "  -m pi|at      servo, fixed gain PI or acquire/track (AVB_MEDIA_CLOCK_SERVO)\n"
+          "  -g a:f:p:s    acquire/track gains in 1/65536ths and error filter shift\n"
+          "  -T ns:n       acquire/track tracking threshold and count\n"
+          "  -S seed       jitter random seed (1)\n"
+          "  -v            trace every buffer info report\n",
+          name);
+  exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+  int base_rate, format;
+  double t_packet, t_arrival = 0, t_out, t_recovery;
+  double talker_period, f_out;
+  unsigned long long next_sample = 0;
+  unsigned int clk_time;
+  int opt;
+
+  cfg.rate = 48000;
+  cfg.latency_ns = 50000;
+  cfg.presentation_ns = AVB_DEFAULT_PRESENTATION_TIME_DELAY_NS;
+  cfg.pll_tau_ns = 1e6;
+  cfg.duration_ns = 30e9;
+  cfg.step_at_ns = INFINITY;
+  cfg.seed = 1;
+
+  media_clock_servo_init(&mclock.info.servo);
+
+  while ((opt = getopt(argc, argv, "r:t:l:L:j:P:p:d:s:n:m:g:T:S:v")) != -1) {
+    switch (opt) {
+      case 'r': cfg.rate = atoi(optarg); break;
+      case 't': cfg.talker_ppm = atof(optarg); break;
+      case 'l': cfg.local_ppm = atof(optarg); break;
+      case 'L': cfg.latency_ns = atof(optarg) * 1e3; break;
+      case 'j': cfg.jitter_ns = atof(optarg) * 1e3; break;
+      case 'P': cfg.presentation_ns = atof(optarg) * 1e3; break;
+      case 'p': cfg.pll_tau_ns = atof(optarg) * 1e6; break;
+      case 'd': cfg.duration_ns = atof(optarg) * 1e9; break;
+      case 's':
+        if (sscanf(optarg, "%lf:%lf", &cfg.step_at_ns, &cfg.step_ns) != 2)
+          usage(argv[0]);
+        cfg.step_at_ns *= 1e9;
+        break;
+      case 'n': cfg.noise_ns = atof(optarg); break;
+      case 'm':
+        if (strcmp(optarg, "pi") == 0)
+          mclock.info.servo.type = MEDIA_CLOCK_SERVO_PI;
+        else if (strcmp(optarg, "at") == 0)
+          mclock.info.servo.type = MEDIA_CLOCK_SERVO_ACQUIRE_TRACK;
+        else
+          usage(argv[0]);
+        break;
+      case 'g':
+        if (sscanf(optarg, "%d:%d:%d:%d", &mclock.info.servo.acquire_gain,
+                   &mclock.info.servo.track_freq_gain, &mclock.info.servo.track_phase_gain,
+                   &mclock.info.servo.error_filter_shift) != 4)
+          usage(argv[0]);
+        break;
+      case 'T':
+        if (sscanf(optarg, "%d:%d", &mclock.info.servo.track_threshold_ns,
+                   &mclock.info.servo.track_count) != 2)
+          usage(argv[0]);
+        break;
+      case 'S': cfg.seed = strtoul(optarg, NULL, 0); break;
+      case 'v': cfg.trace = 1; break;
+      default: usage(argv[0]);
+    }
+  }
+
+  format = avb1722_format_from_rate(cfg.rate);
+  if (format < 0) {
+    fprintf(stderr, "unsupported rate %d\n", cfg.rate);
+    return 2;
+  }
+  base_rate = avb1722_formats[format].base_rate;
+  rng_state = cfg.seed ? cfg.seed : 1;
+
+  finfo.p_buffer[0] = (unsigned int *) &fifo;
+  finfo.p_arena = (unsigned int *) &arena;
+  audio_output_fifo_arena_init(h);
+  audio_output_fifo_init(h, 0);
+  enable_audio_output_fifo(h, 0, 0, cfg.rate, (unsigned) cfg.presentation_ns);
+
+  b.media_clock = -1;
+  mclock.info.active = 1;
+  mclock.info.clock_type = DEVICE_MEDIA_CLOCK_INPUT_STREAM_DERIVED;
+  mclock.info.source = 0;
+  mclock.info.rate = cfg.rate;
+  mclock.wordLength = 0x8235556; // as init_media_clock()
+  init_media_clock_recovery(0, 0, 0, cfg.rate);
+
+  stats.lock_time_ns = -1;
+  stats.fill_min = fifo.mask + 1;
+  stats.fill_max = 0;
+
+  talker_period = 1e9 / (cfg.rate * (1 + cfg.talker_ppm * 1e-6));
+  f_out = target_output_rate(mclock.wordLength, base_rate);
+  t_packet = CLASS_A_PACKET_NS;
+  t_out = 1e9 / f_out;
+  clk_time = CLOCK_RECOVERY_PERIOD;
+  t_recovery = clk_time * NS_PER_LOCAL_TICK / (1 + cfg.local_ppm * 1e-6);
+
+  while (1) {
+    double arrival = t_packet + cfg.latency_ns + cfg.jitter_ns * uniform();
+
+    // The network does not reorder a stream
+    if (arrival < t_arrival)
+      arrival = t_arrival;
+
+    if (arrival <= t_out && arrival <= t_recovery) {
+      // A packet carries the samples captured since the last one, the first
+      // of them marked with its presentation time
+      unsigned long long last = (unsigned long long) (t_packet / talker_period);
+      unsigned int samples[64] = { 0 };
+      int n = (int) (last - next_sample);
+
+      if (arrival > cfg.duration_ns)
+        break;
+      t_arrival = arrival;
+      if (n > 0) {
+        unsigned int ts = (unsigned int) (long long) (next_sample * talker_period + cfg.presentation_ns);
+        audio_output_fifo_set_ptp_timestamp(h, 0, ts, 0);
+        audio_output_fifo_maintain(h, 0, 0, &notified);
+        audio_output_fifo_strided_push(h, 0, samples, 1, n);
+        next_sample = last;
+        serve_notifications(arrival);
+      }
+      t_packet += CLASS_A_PACKET_NS;
+    }
+    else if (t_out <= t_recovery) {
+      int fill;
+
+      audio_output_fifo_pull_sample(h, 0, local_ticks(t_out));
+      if (fifo.state == LOCKED) {
+        fill = audio_output_fifo_ring_fill(&fifo.ring, fifo.mask);
+        if (t_out >= cfg.duration_ns / 2) {
+          if (fill < stats.fill_min) stats.fill_min = fill;
+          if (fill > stats.fill_max) stats.fill_max = fill;
+          stats.f_out_sum += f_out;
+          stats.f_out_count++;
+        }
+      }
+
+      // The PLL output settles towards the rate the word length asks for
+      f_out += (target_output_rate(mclock.wordLength, base_rate) - f_out) *
+               (cfg.pll_tau_ns > 0 ? 1 - exp(-1e9 / f_out / cfg.pll_tau_ns) : 1);
+      t_out += 1e9 / f_out;
+    }
+    else {
+      mclock.wordLength = update_media_clock(0, 0, &mclock, clk_time, CLOCK_RECOVERY_PERIOD);
+      clk_time += CLOCK_RECOVERY_PERIOD;
+      t_recovery += CLOCK_RECOVERY_PERIOD * NS_PER_LOCAL_TICK / (1 + cfg.local_ppm * 1e-6);
+    }
+  }
+
+  printf("rate %d talker_ppm %g local_ppm %g latency_us %g jitter_us %g noise_ns %g presentation_us %g pll_tau_ms %g servo %s\n",
+         cfg.rate, cfg.talker_ppm, cfg.local_ppm, cfg.latency_ns * 1e-3, cfg.jitter_ns * 1e-3,
+         cfg.noise_ns, cfg.presentation_ns * 1e-3, cfg.pll_tau_ns * 1e-6,
+         mclock.info.servo.type == MEDIA_CLOCK_SERVO_PI ? "pi" : "at");
+  if (stats.lock_time_ns >= 0)
+    printf("lock_time_s %.3f", stats.lock_time_ns * 1e-9);
+  else
+    printf("lock_time_s none");
+  printf(" locks %d unlocks %d resets %d\n", stats.locks, stats.unlocks, stats.resets);
+  if (stats.lock_time_ns >= 0 && stats.settle_time_ns < cfg.duration_ns)
+    printf("settle_time_s %.3f\n", stats.settle_time_ns * 1e-9);
+  else
+    printf("settle_time_s none\n");
+  if (stats.reports) {
+    double mean = stats.diff_sum / stats.reports;
+    printf("phase_error_ns mean %.1f rms %.1f max %.0f\n",
+           mean, sqrt(stats.diff_sq_sum / stats.reports), stats.diff_max);
+  }
+  if (stats.f_out_count) {
+    double talker_rate = cfg.rate * (1 + cfg.talker_ppm * 1e-6);
+    printf("fill min %d max %d of %u\n", stats.fill_min, stats.fill_max, fifo.mask + 1);
+    printf("rate_error_ppm %.3f\n", (stats.f_out_sum / stats.f_out_count / talker_rate - 1) * 1e6);
+  }
+
+  return fifo.state == LOCKED ? 0 : 1;
+}
@@ -0,0 +1,465 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "avb_mrp_index.h"
+#include "avb_srp_pdu.h"
+#include "avb_mvrp_pdu.h"
+
+/* Host test and benchmark of the MRP attribute index (avb_mrp_index.c).
+ *
+ * The attributes of a two port bridge are set up and every value of a
+ * storm of MSRP and MVRP MRPDUs is matched against them, both by offering
+ * it to every attribute as avb_mrp_process_packet() used to and through
+ * the index. The two must find the same attributes in the same order.
+ *
+ * The storm is generated, or with -r read from a pcap capture, in which
+ * case every frame is taken to have arrived on the port given with -p.
+ * -w writes the generated storm out as a capture.
+ */
+
+#define SRP_ETHERTYPE 0x22ea
+#define MVRP_ETHERTYPE 0x88f5
+
+#define MAX_FRAME 1518
+#define MAX_FRAMES 20000
+#define MAX_MATCHES 8
+
+// Our streams are this plus a small index, the storm's mostly other talkers'
+#define OUR_STREAM_ID 0x0022970000010000ULL
+#define OUR_VLAN 2
+
+#define STREAMS_PER_PORT 12
+
+typedef struct frame_t {
+  int len;
+  int port;
+  unsigned char data[MAX_FRAME];
+} frame_t;
+
+static frame_t frames[MAX_FRAMES];
+static int num_frames;
+
+static mrp_attribute_state attrs[MRP_MAX_ATTRS];
+static avb_source_info_t talkers[MRP_NUM_PORTS][STREAMS_PER_PORT];
+static avb_sink_info_t listeners[MRP_NUM_PORTS][STREAMS_PER_PORT];
+static int vlans[MRP_NUM_PORTS];
+static mrp_attr_index_t attr_index;
+
+static int failures;
+
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    if (failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } \
+  } \
+} while (0)
+
+// Repeatable on every host, unlike rand()
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned rand32(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (unsigned) (rng_state >> 32);
+}
+
+static double seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void set_stream_id(avb_srp_info_t *reservation, unsigned long long id)
+{
+  reservation->stream_id[0] = (unsigned) (id >> 32);
+  reservation->stream_id[1] = (unsigned) id;
+}
+
+/* Per port: a Talker attribute for each of our streams, a Listener for
+   each, the domain and a VLAN, as in a bridge with every slot in use */
+static void setup_attrs(void)
+{
+  int n = 0;
+
+  memset(attrs, 0, sizeof(attrs));
+  for (int p=0;p<MRP_NUM_PORTS;p++) {
+    for (int s=0;s<STREAMS_PER_PORT && n < MRP_MAX_ATTRS;s++, n++) {
+      set_stream_id(&talkers[p][s].reservation, OUR_STREAM_ID + s);
+      attrs[n].attribute_type = (s % 4 == 3) ? MSRP_TALKER_FAILED : MSRP_TALKER_ADVERTISE;
+      attrs[n].attribute_info = &talkers[p][s];
+    }
+    for (int s=0;s<STREAMS_PER_PORT && n < MRP_MAX_ATTRS;s++, n++) {
+      set_stream_id(&listeners[p][s].reservation, OUR_STREAM_ID + s);
+      attrs[n].attribute_type = MSRP_LISTENER;
+      attrs[n].attribute_info = &listeners[p][s];
+    }
+    if (n < MRP_MAX_ATTRS) {
+      attrs[n].attribute_type = MSRP_DOMAIN_VECTOR;
+      n++;
+    }
+    if (n < MRP_MAX_ATTRS) {
+      vlans[p] = OUR_VLAN;
+      attrs[n].attribute_type = MVRP_VID_VECTOR;
+      attrs[n].attribute_info = &vlans[p];
+      n++;
+    }
+  }
+  for (int i=0;i<MRP_MAX_ATTRS;i++) {
+    attrs[i].port_num = i * MRP_NUM_PORTS / MRP_MAX_ATTRS;
+    // Some of each kind are disabled or free
+    attrs[i].applicant_state = (i % 11 == 5) ? MRP_DISABLED : (i % 13 == 7) ? MRP_UNUSED : MRP_QA;
+  }
+  mrp_attr_index_init(&attr_index, attrs, MRP_MAX_ATTRS);
+}
+
+/* Whether a value would be matched to st by match_attribute_of_same_type()
+   and the SRP and MVRP match functions it calls */
+static int attr_matches(int attr_type, mrp_attribute_state *st, unsigned port_num,
+                        unsigned long long value, int four_packed_event)
+{
+  unsigned long long attr_value;
+
+  if (st->applicant_state == MRP_UNUSED || st->applicant_state == MRP_DISABLED)
+    return 0;
+  if (st->port_num != port_num)
+    return 0;
+  if (!((st->attribute_type <= MSRP_TALKER_FAILED) && (attr_type <= MSRP_TALKER_FAILED)) &&
+      st->attribute_type != attr_type)
+    return 0;
+  if (st->attribute_info == NULL)
+    return 0;
+
+  switch (attr_type) {
+  case MSRP_TALKER_ADVERTISE:
+  case MSRP_TALKER_FAILED:
+  case MSRP_LISTENER: {
+    avb_srp_info_t *reservation = (avb_srp_info_t *) st->attribute_info;
+    if (attr_type == MSRP_LISTENER && four_packed_event == AVB_SRP_FOUR_PACKED_EVENT_IGNORE)
+      return 0;
+    attr_value = ((unsigned long long) reservation->stream_id[0] << 32) + reservation->stream_id[1];
+    return attr_value == value;
+  }
+  case MVRP_VID_VECTOR:
+    return (unsigned) *(int *) st->attribute_info == (unsigned) value;
+  default:
+    return 0;
+  }
+}
+
+typedef struct stats_t {
+  long values;
+  long matches;
+  unsigned long long checksum;   ///< Of the attributes matched, in order
+} stats_t;
+
+static void matched(stats_t *stats, mrp_attribute_state *st)
+{
+  stats->matches++;
+  stats->checksum = stats->checksum * 31 + (st - attrs) + 1;
+}
+
+static int decode_attr_type(int etype, int atype)
+{
+  if (etype == SRP_ETHERTYPE) {
+    switch (atype) {
+    case AVB_SRP_ATTRIBUTE_TYPE_TALKER_ADVERTISE: return MSRP_TALKER_ADVERTISE;
+    case AVB_SRP_ATTRIBUTE_TYPE_TALKER_FAILED: return MSRP_TALKER_FAILED;
+    case AVB_SRP_ATTRIBUTE_TYPE_LISTENER: return MSRP_LISTENER;
+    case AVB_SRP_ATTRIBUTE_TYPE_DOMAIN: return MSRP_DOMAIN_VECTOR;
+    }
+  }
+  else if (etype == MVRP_ETHERTYPE && atype == AVB_MVRP_VID_VECTOR_ATTRIBUTE_TYPE) {
+    return MVRP_VID_VECTOR;
+  }
+  return -1;
+}
+
+/* Walk the values of an MRPDU as avb_mrp_process_packet() does, matching
+   each by scanning every attribute or through the index */
+static void process_frame(frame_t *f, int use_index, stats_t *stats)
+{
+  unsigned char *buf = f->data + 12;
+  char *end = (char *) f->data + f->len;
+  int etype;
+  char *msg;
+
+  if (buf[0] == 0x81 && buf[1] == 0x00)
+    buf += 4;
+  etype = (buf[0] << 8) | buf[1];
+  if (etype != SRP_ETHERTYPE && etype != MVRP_ETHERTYPE)
+    return;
+  msg = (char *) buf + 2 + sizeof(mrp_header);
+
+  attr_index.stale = 1;
+
+  while (msg + sizeof(mrp_msg_header) <= end && (msg[0]!=0 || msg[1]!=0)) {
+    mrp_msg_header *hdr = (mrp_msg_header *) msg;
+    int first_value_len = hdr->AttributeLength;
+    int attr_type = decode_attr_type(etype, hdr->AttributeType);
+    enum mrp_index_class index_class = mrp_attr_index_class(attr_type);
+
+    if (attr_type == -1)
+      return;
+    msg += sizeof(mrp_msg_header);
+    if (etype != SRP_ETHERTYPE) msg -= 2;
+
+    while (msg + sizeof(mrp_vector_header) <= end && (msg[0]!=0 || msg[1]!=0)) {
+      mrp_vector_header *vector_hdr = (mrp_vector_header *) msg;
+      char *first_value = msg + sizeof(mrp_vector_header);
+      int numvalues = ((vector_hdr->LeaveAllEventNumberOfValuesHigh & 0x1f)<<8) +
+                      vector_hdr->NumberOfValuesLow;
+      int threepacked_len = (numvalues+2)/3;
+      int fourpacked_len = attr_type == MSRP_LISTENER ? (numvalues+3)/4 : 0;
+      int len = sizeof(mrp_vector_header) + first_value_len + threepacked_len + fourpacked_len;
+
+      if (msg + len > end)
+        return;
+
+      for (int i=0;i<numvalues;i++) {
+        unsigned char four = fourpacked_len ? first_value[first_value_len + threepacked_len + i/4] : 0;
+        int four_packed_event = attr_type == MSRP_LISTENER ? (four >> (2 * (3 - i%4))) & 3 : 0;
+        unsigned long long value = mrp_attr_index_value(attr_type, first_value, i);
+
+        stats->values++;
+        if (use_index && index_class != MRP_INDEX_NONE) {
+          for (int pos = mrp_attr_index_find(&attr_index, index_class, f->port, value);
+               mrp_attr_index_match(&attr_index, pos, index_class, f->port, value);
+               pos++) {
+            mrp_attribute_state *st = attr_index.entries[pos].attr;
+            if (attr_matches(attr_type, st, f->port, value, four_packed_event))
+              matched(stats, st);
+          }
+        }
+        else {
+          for (int j=0;j<MRP_MAX_ATTRS;j++) {
+            if (attr_matches(attr_type, &attrs[j], f->port, value, four_packed_event))
+              matched(stats, &attrs[j]);
+          }
+        }
+      }
+      msg += len;
+    }
+    msg += 2;
+  }
+}
+
+static void put16(unsigned char *p, unsigned x)
+{
+  p[0] = x >> 8;
+  p[1] = x;
+}
+
+// Append a vector of n values from first, returning its length
+static int put_vector(unsigned char *p, int attr_type, unsigned long long first, int n)
+{
+  unsigned char *start = p;
+  int first_value_len = attr_type == MSRP_LISTENER ? sizeof(srp_listener_first_value) :
+                        attr_type == MVRP_VID_VECTOR ? sizeof(mvrp_vid_vector_first_value) :
+                        sizeof(srp_talker_first_value);
+
+  put16(p, n);
+  p += sizeof(mrp_vector_header);
+  memset(p, 0, first_value_len);
+  if (attr_type == MVRP_VID_VECTOR) {
+    put16(p, (unsigned) first);
+  }
+  else {
+    for (int j=0;j<8;j++)
+      p[j] = first >> (56 - 8*j);
+  }
+  p += first_value_len;
+  for (int i=0;i<n;i+=3)
+    *p++ = (rand32() % 6) * 36 + (rand32() % 6) * 6 + rand32() % 6;
+  if (attr_type == MSRP_LISTENER) {
+    for (int i=0;i<n;i+=4)
+      *p++ = 0xaa;   // Ready
+  }
+  return p - start;
+}
+
+// Most values in a storm are other talkers' streams, some are ours
+static unsigned long long storm_stream_id(void)
+{
+  if (rand32() % 8 == 0)
+    return OUR_STREAM_ID + rand32() % (STREAMS_PER_PORT + 2);
+  return ((unsigned long long) (rand32() % 64) << 40) + ((unsigned long long) rand32() << 8);
+}
+
+static void generate_storm(int count)
+{
+  for (num_frames=0; num_frames < count && num_frames < MAX_FRAMES; num_frames++) {
+    frame_t *f = &frames[num_frames];
+    unsigned char *p = f->data;
+    int mvrp = num_frames % 10 == 9;
+
+    memset(p, 0, 12);
+    put16(p + 12, mvrp ? MVRP_ETHERTYPE : SRP_ETHERTYPE);
+    p += 14;
+    *p++ = 0;  // ProtocolVersion
+
+    if (mvrp) {
+      p[0] = AVB_MVRP_VID_VECTOR_ATTRIBUTE_TYPE;
+      p[1] = sizeof(mvrp_vid_vector_first_value);
+      p += 2;
+      for (int v=0;v<4;v++)
+        p += put_vector(p, MVRP_VID_VECTOR, 1 + rand32() % 8, 1 + rand32() % 4);
+      p[0] = p[1] = 0;
+      p += 2;
+    }
+    else {
+      static const int types[] = {MSRP_TALKER_ADVERTISE, MSRP_LISTENER};
+      for (int t=0;t<2;t++) {
+        unsigned char *hdr = p;
+        hdr[0] = types[t] == MSRP_LISTENER ? AVB_SRP_ATTRIBUTE_TYPE_LISTENER : AVB_SRP_ATTRIBUTE_TYPE_TALKER_ADVERTISE;
+        hdr[1] = types[t] == MSRP_LISTENER ? sizeof(srp_listener_first_value) : sizeof(srp_talker_first_value);
+        p += sizeof(mrp_msg_header);
+        // Fill the frame as a storm of declarations would
+        for (int v=0;v<(types[t] == MSRP_LISTENER ? 24 : 12);v++)
+          p += put_vector(p, types[t], storm_stream_id(), 1 + rand32() % 4);
+        p[0] = p[1] = 0;
+        p += 2;
+        put16(hdr + 2, p - (hdr + sizeof(mrp_msg_header)));
+      }
+    }
+    p[0] = p[1] = 0;
+    p += 2;
+    f->len = p - f->data;
+    f->port = rand32() % MRP_NUM_PORTS;
+  }
+}
+
+static unsigned get32(const unsigned char *p, int swap)
+{
+  return swap ? (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+              : (p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+static int read_pcap(const char *filename, int port)
+{
+  FILE *fp = fopen(filename, "rb");
+  unsigned char hdr[24];
+  int swap;
+
+  if (!fp) {
+    perror(filename);
+    return 0;
+  }
+  if (fread(hdr, 1, 24, fp) != 24) {
+    fclose(fp);
+    return 0;
+  }
+  swap = (hdr[0] == 0xa1);
+  num_frames = 0;
+  while (num_frames < MAX_FRAMES && fread(hdr, 1, 16, fp) == 16) {
+    unsigned len = get32(hdr + 8, swap);
+    frame_t *f = &frames[num_frames];
+    unsigned keep = len < MAX_FRAME ? len : MAX_FRAME;
+
+    if (fread(f->data, 1, keep, fp) != keep)
+      break;
+    if (len > keep)
+      fseek(fp, len - keep, SEEK_CUR);
+    f->len = keep;
+    f->port = port;
+    if (keep >= 16)
+      num_frames++;
+  }
+  fclose(fp);
+  return 1;
+}
+
+static void write_pcap(const char *filename)
+{
+  FILE *fp = fopen(filename, "wb");
+  static const unsigned char hdr[24] = {0xd4, 0xc3, 0xb2, 0xa1, 2, 0, 4, 0,
+                                        0, 0, 0, 0, 0, 0, 0, 0,
+                                        0xff, 0xff, 0, 0, 1, 0, 0, 0};
+  if (!fp) {
+    perror(filename);
+    return;
+  }
+  fwrite(hdr, 1, 24, fp);
+  for (int i=0;i<num_frames;i++) {
+    unsigned char rec[16] = {0};
+    unsigned len = frames[i].len;
+    rec[4] = i & 0xff;
+    for (int j=0;j<4;j++)
+      rec[8+j] = rec[12+j] = len >> (8*j);
+    fwrite(rec, 1, 16, fp);
+    fwrite(frames[i].data, 1, len, fp);
+  }
+  fclose(fp);
+}
+
+static double run(int use_index, int repeats, stats_t *stats)
+{
+  double start = seconds();
+
+  for (int r=0;r<repeats;r++) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i=0;i<num_frames;i++)
+      process_frame(&frames[i], use_index, stats);
+  }
+  return seconds() - start;
+}
+
+static void usage(void)
+{
+  printf("usage: mrp_attr_index [-n frames] [-w out.pcap] [-r capture.pcap [-p port]]\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *read_file = NULL, *write_file = NULL;
+  int count = 2000, port = 0, repeats;
+  stats_t scan, index;
+  double t_scan, t_index;
+
+  for (int i=1;i<argc;i++) {
+    if (strcmp(argv[i], "-n") == 0 && i+1 < argc) count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i+1 < argc) read_file = argv[++i];
+    else if (strcmp(argv[i], "-w") == 0 && i+1 < argc) write_file = argv[++i];
+    else if (strcmp(argv[i], "-p") == 0 && i+1 < argc) port = atoi(argv[++i]);
+    else usage();
+  }
+  if (port < 0 || port >= MRP_NUM_PORTS)
+    usage();
+
+  setup_attrs();
+  if (read_file) {
+    if (!read_pcap(read_file, port))
+      return 1;
+  }
+  else {
+    generate_storm(count);
+    if (write_file)
+      write_pcap(write_file);
+  }
+
+  repeats = 1 + 2000000 / (num_frames * MRP_MAX_ATTRS + 1);
+  t_scan = run(0, repeats, &scan);
+  t_index = run(1, repeats, &index);
+
+  CHECK(scan.matches == index.matches && scan.checksum == index.checksum,
+        "the index matched %ld values, scanning %ld", index.matches, scan.matches);
+
+  printf("%d frames, %ld values, %ld matched, %d attributes\n",
+         num_frames, scan.values, scan.matches, MRP_MAX_ATTRS);
+  if (scan.values) {
+    printf("scan  %8.1f ns per value\n", t_scan * 1e9 / repeats / scan.values);
+    printf("index %8.1f ns per value, including a refresh per frame\n",
+           t_index * 1e9 / repeats / index.values);
+  }
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
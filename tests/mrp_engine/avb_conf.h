@@ -0,0 +1,10 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __avb_conf_h__
+#define __avb_conf_h__
+
+// Room for the load benchmark's 1000 streams through the bridge, each with
+// a Talker and a Listener attribute on both ports
+#define MRP_EXTRA_ATTRS 4096
+#define AVB_STREAM_TABLE_ENTRIES 1100
+
+#endif
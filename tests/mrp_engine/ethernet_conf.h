@@ -0,0 +1,7 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// A two port bridge, which propagates declarations between its ports
+#include "default_avb_conf.h"
+
+#define NUM_ETHERNET_PORTS 2
+
+#define NUM_ETHERNET_MASTER_PORTS 2
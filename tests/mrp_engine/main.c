@@ -0,0 +1,910 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "shim.h"
+#include "avb_mvrp.h"
+#include "avb_srp_pdu.h"
+#include "avb_mvrp_pdu.h"
+
+/* Host tests of the MRP, MSRP and MVRP engine (avb_mrp.c, avb_srp.c,
+ * avb_mvrp.c) as a two port bridge, run through the transport shim in
+ * shim.c.
+ *
+ * The default run plays the MRPDUs of neighbouring Talkers and Listeners
+ * to the bridge and checks the MRPDUs it sends: that declarations are
+ * propagated to the other port, that consecutive streams are sent in one
+ * vector, that a Listener for a local source enables it, that leaves
+ * propagate, that the bridge's VLAN is declared again after a leave and
+ * that a Stream ID changed in place is sent as its new value.
+ *
+ * -r replays a pcap capture as received on the port given with -p, and -w
+ * writes what the bridge sends to <prefix><port>.pcap. The capture's
+ * timestamps pace the replay.
+ *
+ * -v lists the values that the bridge sent in each test, or in the replay.
+ *
+ * -b reports the time per received MRPDU once the bridge has registered
+ * 10, 100 and 1000 streams, each run in a fresh process as the engine has
+ * no way to be torn down.
+ */
+
+#define MAX_CAPTURE 4096
+#define MAX_FRAMES 20000
+
+#define PEER_STREAM_ID 0x0022970000020000ULL
+#define PEER_DEST_MAC  0x91e0f0000e00ULL
+#define PEER_VLAN 2
+#define PEER_FRAME_SIZE 224
+
+// Events, as in the three packed event vectors
+#define NEW MRP_ATTRIBUTE_EVENT_NEW
+#define JOININ MRP_ATTRIBUTE_EVENT_JOININ
+#define LV MRP_ATTRIBUTE_EVENT_LV
+
+static shim_frame_t sent[MAX_CAPTURE];
+
+static int failures;
+
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    if (failures++ < 20) { printf("FAIL: " __VA_ARGS__); printf("\n"); } \
+  } \
+} while (0)
+
+// Repeatable on every host, unlike rand()
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned rand32(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (unsigned) (rng_state >> 32);
+}
+
+static double seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Building a neighbour's MRPDUs */
+
+static void put16(unsigned char *p, unsigned x)
+{
+  p[0] = x >> 8;
+  p[1] = x;
+}
+
+static void put_be(unsigned char *p, unsigned long long x, int n)
+{
+  for (int i=0;i<n;i++)
+    p[i] = x >> (8 * (n - 1 - i));
+}
+
+typedef struct pdu_t {
+  unsigned char data[SHIM_MAX_FRAME];
+  unsigned char *ptr;
+  unsigned char *msg;   ///< The open message
+  int etype;
+} pdu_t;
+
+static void pdu_start(pdu_t *pdu, int etype)
+{
+  static const unsigned char srp_mac[6] = AVB_SRP_MACADDR;
+  static const unsigned char mvrp_mac[6] = AVB_MVRP_MACADDR;
+  static const unsigned char peer_mac[6] = {0x00, 0x22, 0x97, 0x00, 0x00, 0x02};
+
+  memcpy(pdu->data, etype == AVB_SRP_ETHERTYPE ? srp_mac : mvrp_mac, 6);
+  memcpy(pdu->data + 6, peer_mac, 6);
+  put16(pdu->data + 12, etype);
+  pdu->data[14] = 0;  // ProtocolVersion
+  pdu->ptr = pdu->data + 15;
+  pdu->msg = NULL;
+  pdu->etype = etype;
+}
+
+static void pdu_message(pdu_t *pdu, int attribute_type, int first_value_len)
+{
+  pdu->msg = pdu->ptr;
+  pdu->ptr[0] = attribute_type;
+  pdu->ptr[1] = first_value_len;
+  pdu->ptr += (pdu->etype == AVB_SRP_ETHERTYPE) ? sizeof(mrp_msg_header) : 2;
+}
+
+static void pdu_end_message(pdu_t *pdu)
+{
+  pdu->ptr[0] = pdu->ptr[1] = 0;
+  pdu->ptr += 2;
+  if (pdu->etype == AVB_SRP_ETHERTYPE)
+    put16(pdu->msg + 2, pdu->ptr - (pdu->msg + sizeof(mrp_msg_header)));
+}
+
+static int pdu_end(pdu_t *pdu)
+{
+  unsigned char *end;
+
+  pdu->ptr[0] = pdu->ptr[1] = 0;
+  pdu->ptr += 2;
+  end = pdu->ptr < pdu->data + 60 ? pdu->data + 60 : pdu->ptr;
+  memset(pdu->ptr, 0, end - pdu->ptr);
+  return end - pdu->data;
+}
+
+// Append a vector of n values, each with the event and, for Listeners, the
+// four packed event
+static void pdu_vector(pdu_t *pdu, const unsigned char *first_value, int first_value_len,
+                       int n, int leave_all, int event, int four_packed_event)
+{
+  unsigned char *p = pdu->ptr;
+
+  put16(p, (leave_all << 13) | n);
+  p += sizeof(mrp_vector_header);
+  memcpy(p, first_value, first_value_len);
+  p += first_value_len;
+  for (int i=0;i<n;i+=3) {
+    int k = n - i < 3 ? n - i : 3;
+    int packed = 0;
+    for (int j=0;j<3;j++)
+      packed = packed * 6 + (j < k ? event : 0);
+    *p++ = packed;
+  }
+  if (four_packed_event >= 0) {
+    for (int i=0;i<n;i+=4) {
+      int k = n - i < 4 ? n - i : 4;
+      int packed = 0;
+      for (int j=0;j<4;j++)
+        packed = packed * 4 + (j < k ? four_packed_event : 0);
+      *p++ = packed;
+    }
+  }
+  pdu->ptr = p;
+}
+
+static int pdu_room(pdu_t *pdu, int len)
+{
+  // Leaving room for the message and PDU end marks
+  return pdu->ptr + len + 4 <= pdu->data + 1514;
+}
+
+static void talker_first_value(unsigned char *fv, unsigned long long stream_id,
+                               unsigned long long dest_mac)
+{
+  srp_talker_first_value *first_value = (srp_talker_first_value *) fv;
+
+  memset(fv, 0, sizeof(srp_talker_first_value));
+  put_be(first_value->StreamId, stream_id, 8);
+  put_be(first_value->DestMacAddr, dest_mac, 6);
+  put16(first_value->VlanID, PEER_VLAN);
+  put16(first_value->TSpecMaxFrameSize, PEER_FRAME_SIZE);
+  put16(first_value->TSpecMaxIntervalFrames, 1);
+  first_value->TSpec = (AVB_SRP_TSPEC_PRIORITY_DEFAULT << 5) | (AVB_SRP_TSPEC_RANK_DEFAULT << 4);
+  put_be(first_value->AccumulatedLatency, 2000, 4);
+}
+
+static void pdu_domain(pdu_t *pdu, int event)
+{
+  srp_domain_first_value first_value;
+
+  first_value.SRclassID = AVB_SRP_SRCLASS_DEFAULT;
+  first_value.SRclassPriority = AVB_SRP_TSPEC_PRIORITY_DEFAULT;
+  put16(first_value.SRclassVID, PEER_VLAN);
+  pdu_message(pdu, AVB_SRP_ATTRIBUTE_TYPE_DOMAIN, sizeof(first_value));
+  pdu_vector(pdu, (unsigned char *) &first_value, sizeof(first_value), 1, 0, event, -1);
+  pdu_end_message(pdu);
+}
+
+// One message of n Talker Advertises from stream_id, in runs of run
+// consecutive streams
+static void pdu_talkers(pdu_t *pdu, unsigned long long stream_id, int n, int run, int event)
+{
+  unsigned char first_value[sizeof(srp_talker_first_value)];
+
+  pdu_message(pdu, AVB_SRP_ATTRIBUTE_TYPE_TALKER_ADVERTISE, sizeof(first_value));
+  for (int i=0;i<n;i+=run) {
+    int k = n - i < run ? n - i : run;
+    talker_first_value(first_value, stream_id + i, PEER_DEST_MAC + i);
+    pdu_vector(pdu, first_value, sizeof(first_value), k, 0, event, -1);
+  }
+  pdu_end_message(pdu);
+}
+
+static void pdu_listeners(pdu_t *pdu, unsigned long long stream_id, int n, int run,
+                          int event, int four_packed_event)
+{
+  unsigned char first_value[sizeof(srp_listener_first_value)];
+
+  pdu_message(pdu, AVB_SRP_ATTRIBUTE_TYPE_LISTENER, sizeof(first_value));
+  for (int i=0;i<n;i+=run) {
+    int k = n - i < run ? n - i : run;
+    put_be(first_value, stream_id + i, 8);
+    pdu_vector(pdu, first_value, sizeof(first_value), k, 0, event, four_packed_event);
+  }
+  pdu_end_message(pdu);
+}
+
+static void pdu_vid(pdu_t *pdu, int vid, int event)
+{
+  mvrp_vid_vector_first_value first_value;
+
+  put16(first_value.vlan, vid);
+  pdu_message(pdu, AVB_MVRP_VID_VECTOR_ATTRIBUTE_TYPE, sizeof(first_value));
+  pdu_vector(pdu, (unsigned char *) &first_value, sizeof(first_value), 1, 0, event, -1);
+  pdu_end_message(pdu);
+}
+
+static void receive(pdu_t *pdu, int port)
+{
+  int len = pdu_end(pdu);
+  shim_receive(pdu->data, len, port);
+}
+
+/* Decoding the bridge's MRPDUs */
+
+typedef struct decoded_t {
+  int vectors;             ///< In all of the frames
+  int values;
+  int max_vector;          ///< The most values in one vector
+  int leave_alls;
+} decoded_t;
+
+typedef void (*value_fn)(void *arg, int port, int attr_type, unsigned long long value,
+                         int event, int four_packed_event);
+
+static int decode_attr_type(int etype, int atype)
+{
+  if (etype == AVB_SRP_ETHERTYPE) {
+    switch (atype) {
+    case AVB_SRP_ATTRIBUTE_TYPE_TALKER_ADVERTISE: return MSRP_TALKER_ADVERTISE;
+    case AVB_SRP_ATTRIBUTE_TYPE_TALKER_FAILED: return MSRP_TALKER_FAILED;
+    case AVB_SRP_ATTRIBUTE_TYPE_LISTENER: return MSRP_LISTENER;
+    case AVB_SRP_ATTRIBUTE_TYPE_DOMAIN: return MSRP_DOMAIN_VECTOR;
+    }
+  }
+  else if (etype == AVB_MVRP_ETHERTYPE && atype == AVB_MVRP_VID_VECTOR_ATTRIBUTE_TYPE) {
+    return MVRP_VID_VECTOR;
+  }
+  return -1;
+}
+
+static int first_value_length(int attr_type)
+{
+  switch (attr_type) {
+  case MSRP_TALKER_ADVERTISE: return sizeof(srp_talker_first_value);
+  case MSRP_TALKER_FAILED: return sizeof(srp_talker_failed_first_value);
+  case MSRP_LISTENER: return sizeof(srp_listener_first_value);
+  case MSRP_DOMAIN_VECTOR: return sizeof(srp_domain_first_value);
+  case MVRP_VID_VECTOR: return sizeof(mvrp_vid_vector_first_value);
+  default: return -1;
+  }
+}
+
+/* Walk every value of a frame that the bridge sent, checking that it is
+   well formed. Returns 0 if it is not. */
+static int decode_frame(shim_frame_t *f, decoded_t *d, value_fn fn, void *arg)
+{
+  unsigned char *end = f->data + f->len;
+  unsigned char *msg = f->data + 14 + sizeof(mrp_header);
+  int etype = (f->data[12] << 8) | f->data[13];
+
+  if (etype != AVB_SRP_ETHERTYPE && etype != AVB_MVRP_ETHERTYPE)
+    return 0;
+
+  while (1) {
+    int attr_type, first_value_len;
+    unsigned char *list_end = NULL;
+
+    if (msg + 2 > end)
+      return 0;
+    if (msg[0] == 0 && msg[1] == 0)
+      return 1;
+
+    attr_type = decode_attr_type(etype, msg[0]);
+    first_value_len = first_value_length(attr_type);
+    if (attr_type < 0 || msg[1] != first_value_len)
+      return 0;
+    if (etype == AVB_SRP_ETHERTYPE) {
+      list_end = msg + sizeof(mrp_msg_header) + ((msg[2] << 8) | msg[3]);
+      msg += sizeof(mrp_msg_header);
+    }
+    else {
+      msg += 2;
+    }
+
+    while (1) {
+      unsigned char *first_value = msg + sizeof(mrp_vector_header);
+      int numvalues, leave_all, threepacked_len, fourpacked_len;
+
+      if (msg + 2 > end)
+        return 0;
+      if (msg[0] == 0 && msg[1] == 0) {
+        msg += 2;
+        break;
+      }
+      numvalues = ((msg[0] & 0x1f) << 8) | msg[1];
+      leave_all = msg[0] >> 5;
+      threepacked_len = (numvalues + 2) / 3;
+      fourpacked_len = attr_type == MSRP_LISTENER ? (numvalues + 3) / 4 : 0;
+      if (first_value + first_value_len + threepacked_len + fourpacked_len > end)
+        return 0;
+
+      d->vectors++;
+      d->values += numvalues;
+      if (numvalues > d->max_vector)
+        d->max_vector = numvalues;
+      d->leave_alls += leave_all == 1;
+
+      for (int i=0;i<numvalues;i++) {
+        unsigned char three = first_value[first_value_len + i/3];
+        int event = (three / (i%3 == 0 ? 36 : i%3 == 1 ? 6 : 1)) % 6;
+        int four_packed_event = -1;
+        unsigned long long value = 0;
+
+        if (fourpacked_len) {
+          unsigned char four = first_value[first_value_len + threepacked_len + i/4];
+          four_packed_event = (four >> (2 * (3 - i%4))) & 3;
+        }
+        if (attr_type == MVRP_VID_VECTOR) {
+          value = ((first_value[0] << 8) | first_value[1]) + i;
+        }
+        else if (attr_type != MSRP_DOMAIN_VECTOR) {
+          for (int j=0;j<8;j++)
+            value = (value << 8) | first_value[j];
+          value += i;
+        }
+        if (fn)
+          fn(arg, f->port, attr_type, value, event, four_packed_event);
+      }
+      msg = first_value + first_value_len + threepacked_len + fourpacked_len;
+    }
+    if (list_end && msg != list_end)
+      return 0;
+  }
+}
+
+/* Every frame sent since the capture started must be well formed */
+static decoded_t decode_sent(value_fn fn, void *arg)
+{
+  decoded_t d = {0};
+  int n = shim_tx_frames();
+
+  for (int i=0;i<n;i++) {
+    CHECK(decode_frame(&sent[i], &d, fn, arg),
+          "frame %d sent on port %d is malformed", i, sent[i].port);
+  }
+  return d;
+}
+
+typedef struct find_t {
+  int port;
+  int attr_type;
+  unsigned long long value;
+  int found;
+  int event;               ///< Of the last declaration found
+  int four_packed_event;
+} find_t;
+
+static void find_value(void *arg, int port, int attr_type, unsigned long long value,
+                       int event, int four_packed_event)
+{
+  find_t *find = (find_t *) arg;
+
+  if (port == find->port && attr_type == find->attr_type && value == find->value) {
+    find->found++;
+    find->event = event;
+    find->four_packed_event = four_packed_event;
+  }
+}
+
+// How many times a value was sent on a port, and its last events
+static find_t sent_value(int port, int attr_type, unsigned long long value)
+{
+  find_t find = {port, attr_type, value, 0, -1, -1};
+  decode_sent(find_value, &find);
+  return find;
+}
+
+static int verbose;
+
+static const char *type_name[] = {"Talker Advertise", "Talker Failed", "Listener",
+                                  "Domain", "MMRP", "VID"};
+static const char *event_name[] = {"New", "JoinIn", "In", "JoinMt", "Mt", "Lv"};
+
+static void print_value(void *arg, int port, int attr_type, unsigned long long value,
+                        int event, int four_packed_event)
+{
+  printf("  port %d  %-16s %016llx  %s", port, type_name[attr_type], value,
+         event < 6 ? event_name[event] : "?");
+  if (four_packed_event >= 0)
+    printf(" %d", four_packed_event);
+  printf("\n");
+}
+
+static void print_sent(const char *what)
+{
+  if (verbose) {
+    printf("%s: %d frames\n", what, shim_tx_frames());
+    decode_sent(print_value, NULL);
+  }
+}
+
+static void start_capture(void)
+{
+  shim_capture(sent, MAX_CAPTURE);
+}
+
+/* The neighbours on both ports declare the SRP domain, so that neither
+   port is a domain boundary */
+static void join_domain(void)
+{
+  for (int port=0;port<MRP_NUM_PORTS;port++) {
+    pdu_t pdu;
+    pdu_start(&pdu, AVB_SRP_ETHERTYPE);
+    pdu_domain(&pdu, NEW);
+    receive(&pdu, port);
+  }
+  shim_advance(500);
+}
+
+static void test_domain(void)
+{
+  find_t find;
+
+  start_capture();
+  join_domain();
+
+  for (int port=0;port<MRP_NUM_PORTS;port++) {
+    find = sent_value(port, MSRP_DOMAIN_VECTOR, 0);
+    CHECK(find.found, "no domain declaration sent on port %d", port);
+  }
+  print_sent("domain");
+}
+
+static void test_talker_propagation(void)
+{
+  find_t find;
+  pdu_t pdu;
+
+  start_capture();
+  pdu_start(&pdu, AVB_SRP_ETHERTYPE);
+  pdu_talkers(&pdu, PEER_STREAM_ID, 1, 1, NEW);
+  receive(&pdu, 0);
+  shim_advance(1000);
+
+  find = sent_value(1, MSRP_TALKER_ADVERTISE, PEER_STREAM_ID);
+  CHECK(find.found, "Talker Advertise received on port 0 was not declared on port 1");
+  find = sent_value(0, MSRP_TALKER_ADVERTISE, PEER_STREAM_ID);
+  CHECK(!find.found, "Talker Advertise was declared back on the port it arrived on");
+  print_sent("talker_propagation");
+}
+
+static void test_listener_propagation(void)
+{
+  find_t find;
+  pdu_t pdu;
+  unsigned forwarding = shim_stats.forwarding_enabled;
+
+  start_capture();
+  pdu_start(&pdu, AVB_SRP_ETHERTYPE);
+  pdu_listeners(&pdu, PEER_STREAM_ID, 1, 1, NEW, AVB_SRP_FOUR_PACKED_EVENT_READY);
+  receive(&pdu, 1);
+  shim_advance(1000);
+
+  find = sent_value(0, MSRP_LISTENER, PEER_STREAM_ID);
+  CHECK(find.found, "Listener received on port 1 was not declared towards the Talker on port 0");
+  CHECK(find.four_packed_event == AVB_SRP_FOUR_PACKED_EVENT_READY,
+        "Listener declared with %d, not Ready", find.four_packed_event);
+  CHECK(shim_stats.forwarding_enabled > forwarding, "stream forwarding was not enabled");
+  print_sent("listener_propagation");
+}
+
+static void test_listener_leave(void)
+{
+  find_t find;
+  pdu_t pdu;
+  unsigned forwarding = shim_stats.forwarding_disabled;
+
+  start_capture();
+  pdu_start(&pdu, AVB_SRP_ETHERTYPE);
+  pdu_listeners(&pdu, PEER_STREAM_ID, 1, 1, LV, AVB_SRP_FOUR_PACKED_EVENT_READY);
+  receive(&pdu, 1);
+  shim_advance(3000);
+
+  find = sent_value(0, MSRP_LISTENER, PEER_STREAM_ID);
+  CHECK(find.found && find.event == LV, "Listener leave was not propagated to port 0 (%d)", find.event);
+  CHECK(shim_stats.forwarding_disabled > forwarding, "stream forwarding was not disabled");
+  print_sent("listener_leave");
+}
+
+// Consecutive streams are received as one vector and must be sent as one
+static void test_vector_aggregation(void)
+{
+  const int n = 40;
+  const unsigned long long first = PEER_STREAM_ID + 0x100;
+  decoded_t d;
+  find_t find;
+  pdu_t pdu;
+  int frames;
+
+  start_capture();
+  pdu_start(&pdu, AVB_SRP_ETHERTYPE);
+  pdu_talkers(&pdu, first, n, n, NEW);
+  receive(&pdu, 0);
+  shim_advance(1000);
+  frames = shim_tx_frames();
+  d = decode_sent(NULL, NULL);
+
+  for (int i=0;i<n;i++) {
+    find = sent_value(1, MSRP_TALKER_ADVERTISE, first + i);
+    CHECK(find.found, "stream %d of the run was not declared on port 1", i);
+  }
+  CHECK(d.max_vector >= n, "%d consecutive streams were split, at most %d in a vector",
+        n, d.max_vector);
+  // The New is sent twice and then a JoinMt, as for a single stream
+  CHECK(frames <= 3, "%d frames sent for one declaration", frames);
+  print_sent("vector_aggregation");
+}
+
+static void test_local_talker(void)
+{
+  const unsigned long long stream_id = 0x0022970000010000ULL;
+  avb_srp_info_t reservation;
+  find_t find;
+  pdu_t pdu;
+
+  memset(&reservation, 0, sizeof(reservation));
+  reservation.stream_id[0] = (unsigned) (stream_id >> 32);
+  reservation.stream_id[1] = (unsigned) stream_id;
+  put_be(reservation.dest_mac_addr, PEER_DEST_MAC + 0x80, 6);
+  reservation.vlan_id = PEER_VLAN;
+  reservation.tspec_max_frame_size = PEER_FRAME_SIZE;
+  reservation.tspec_max_interval = 1;
+  reservation.tspec = (AVB_SRP_TSPEC_PRIORITY_DEFAULT << 5) | (AVB_SRP_TSPEC_RANK_DEFAULT << 4);
+
+  shim_add_local_source(reservation.stream_id);
+
+  start_capture();
+  avb_srp_create_and_join_talker_advertise_attrs(&reservation);
+  shim_advance(1000);
+
+  for (int port=0;port<MRP_NUM_PORTS;port++) {
+    find = sent_value(port, MSRP_TALKER_ADVERTISE, stream_id);
+    CHECK(find.found, "local Talker was not declared on port %d", port);
+  }
+  find = sent_value(0, MVRP_VID_VECTOR, PEER_VLAN);
+  CHECK(find.found, "the local Talker's VLAN was not declared");
+
+  pdu_start(&pdu, AVB_SRP_ETHERTYPE);
+  pdu_listeners(&pdu, stream_id, 1, 1, JOININ, AVB_SRP_FOUR_PACKED_EVENT_READY);
+  receive(&pdu, 0);
+  shim_advance(1000);
+
+  CHECK(shim_source_state(0) == AVB_SOURCE_STATE_ENABLED,
+        "a Listener Ready did not enable the local source");
+  print_sent("local_talker");
+}
+
+// A neighbour's leave of the VLAN the bridge declares for its Talker must
+// not leave it undeclared
+static void test_vid_redeclare(void)
+{
+  find_t find;
+  pdu_t pdu;
+
+  start_capture();
+  pdu_start(&pdu, AVB_MVRP_ETHERTYPE);
+  pdu_vid(&pdu, PEER_VLAN, LV);
+  receive(&pdu, 0);
+  shim_advance(1000);
+
+  find = sent_value(0, MVRP_VID_VECTOR, PEER_VLAN);
+  CHECK(find.found && find.event != LV, "the VLAN was not declared again after a neighbour's leave");
+  print_sent("vid_redeclare");
+}
+
+// SRP keeps a reservation's Stream ID in its stream table entry, which
+// avb_srp.h only declares for XC
+avb_stream_entry *srp_add_reservation_entry(avb_srp_info_t *reservation);
+
+// A Stream ID that changes in place must be sent as its new value, and its
+// old neighbours must no longer be sent as one vector through it
+static void test_stream_id_change(void)
+{
+  const unsigned long long first = 0x0022970000030000ULL;
+  const unsigned long long moved = first + 0x10;
+  avb_srp_info_t reservation;
+  avb_stream_entry *entry = NULL;
+  find_t find;
+
+  memset(&reservation, 0, sizeof(reservation));
+  reservation.vlan_id = PEER_VLAN;
+  reservation.tspec_max_frame_size = PEER_FRAME_SIZE;
+  reservation.tspec_max_interval = 1;
+  reservation.tspec = (AVB_SRP_TSPEC_PRIORITY_DEFAULT << 5) | (AVB_SRP_TSPEC_RANK_DEFAULT << 4);
+
+  start_capture();
+  for (int i=0;i<3;i++) {
+    reservation.stream_id[0] = (unsigned) ((first + i) >> 32);
+    reservation.stream_id[1] = (unsigned) (first + i);
+    put_be(reservation.dest_mac_addr, PEER_DEST_MAC + 0x100 + i, 6);
+    avb_srp_create_and_join_talker_advertise_attrs(&reservation);
+  }
+  shim_advance(1000);
+
+  for (int i=0;i<3;i++) {
+    find = sent_value(1, MSRP_TALKER_ADVERTISE, first + i);
+    CHECK(find.found, "local Talker %d was not declared", i);
+  }
+
+  // The middle Talker's Stream ID moves past the last, leaving its MAC, and
+  // MRP is told as SRP tells it of a stream table entry that changes
+  reservation.stream_id[0] = (unsigned) ((first + 1) >> 32);
+  reservation.stream_id[1] = (unsigned) (first + 1);
+  put_be(reservation.dest_mac_addr, PEER_DEST_MAC + 0x101, 6);
+  entry = srp_add_reservation_entry(&reservation);
+  CHECK(entry != NULL, "no stream table entry for the local Talker");
+  if (entry == NULL)
+    return;
+  entry->reservation.stream_id[0] = (unsigned) (moved >> 32);
+  entry->reservation.stream_id[1] = (unsigned) moved;
+  mrp_attribute_info_changed(entry);
+
+  // A LeaveAll sends every declaration again
+  start_capture();
+  shim_advance(20000);
+
+  for (int port=0;port<MRP_NUM_PORTS;port++) {
+    find = sent_value(port, MSRP_TALKER_ADVERTISE, moved);
+    CHECK(find.found, "the changed Stream ID was not sent on port %d", port);
+    find = sent_value(port, MSRP_TALKER_ADVERTISE, first + 1);
+    CHECK(!find.found, "the old Stream ID was still sent on port %d", port);
+    find = sent_value(port, MSRP_TALKER_ADVERTISE, first);
+    CHECK(find.found, "the first Talker was no longer sent on port %d", port);
+    find = sent_value(port, MSRP_TALKER_ADVERTISE, first + 2);
+    CHECK(find.found, "the last Talker was no longer sent on port %d", port);
+  }
+  print_sent("stream_id_change");
+}
+
+static void run_tests(void)
+{
+  shim_init();
+  test_domain();
+  test_talker_propagation();
+  test_listener_propagation();
+  test_listener_leave();
+  test_vector_aggregation();
+  test_local_talker();
+  test_vid_redeclare();
+  test_stream_id_change();
+}
+
+/* Replaying a capture */
+
+typedef struct frame_t {
+  unsigned long long us;
+  int len;
+  unsigned char data[SHIM_MAX_FRAME];
+} frame_t;
+
+static frame_t frames[MAX_FRAMES];
+static int num_frames;
+
+static unsigned get32(const unsigned char *p, int swap)
+{
+  return swap ? (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+              : (p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+static int read_pcap(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  unsigned char hdr[24];
+  int swap, nanoseconds;
+
+  if (!fp) {
+    perror(filename);
+    return 0;
+  }
+  if (fread(hdr, 1, 24, fp) != 24) {
+    fclose(fp);
+    return 0;
+  }
+  swap = (hdr[0] == 0xa1);
+  nanoseconds = (get32(hdr, swap) == 0xa1b23c4d);
+  num_frames = 0;
+  while (num_frames < MAX_FRAMES && fread(hdr, 1, 16, fp) == 16) {
+    unsigned len = get32(hdr + 8, swap);
+    frame_t *f = &frames[num_frames];
+    unsigned keep = len < SHIM_MAX_FRAME ? len : SHIM_MAX_FRAME;
+
+    if (fread(f->data, 1, keep, fp) != keep)
+      break;
+    if (len > keep)
+      fseek(fp, len - keep, SEEK_CUR);
+    f->len = keep;
+    f->us = get32(hdr, swap) * 1000000ULL + get32(hdr + 4, swap) / (nanoseconds ? 1000 : 1);
+    if (keep >= 16)
+      num_frames++;
+  }
+  fclose(fp);
+  return 1;
+}
+
+static void replay(int port)
+{
+  unsigned long long start = num_frames ? frames[0].us : 0;
+  unsigned long long elapsed_ms = 0;
+  decoded_t d;
+
+  shim_init();
+  start_capture();
+  for (int i=0;i<num_frames;i++) {
+    unsigned long long ms = (frames[i].us - start) / 1000;
+    if (ms > elapsed_ms) {
+      shim_advance(ms - elapsed_ms);
+      elapsed_ms = ms;
+    }
+    shim_receive(frames[i].data, frames[i].len, port);
+  }
+  // Long enough for leaves to time out
+  shim_advance(2000);
+
+  d = decode_sent(NULL, NULL);
+  print_sent("replay");
+  printf("%d frames replayed on port %d, %u sent with %d values in %d vectors and %d LeaveAlls\n",
+         num_frames, port, shim_stats.tx_frames, d.values, d.vectors, d.leave_alls);
+}
+
+/* The load benchmark */
+
+static unsigned long long bench_stream_id(int i)
+{
+  // Scattered, as the streams of many Talkers would be
+  return ((unsigned long long) (i + 1) << 40) | (rand32() & 0xffff00);
+}
+
+// Fill frames[] with the neighbours' declarations of n streams, Talkers
+// from port 0's neighbour and Listeners from port 1's
+static int bench_frames(unsigned long long ids[], int n, int ports[])
+{
+  int count = 0;
+
+  for (int type=0;type<2;type++) {
+    int i = 0;
+    while (i < n) {
+      pdu_t pdu;
+      pdu_start(&pdu, AVB_SRP_ETHERTYPE);
+      pdu_message(&pdu, type ? AVB_SRP_ATTRIBUTE_TYPE_LISTENER : AVB_SRP_ATTRIBUTE_TYPE_TALKER_ADVERTISE,
+                  type ? sizeof(srp_listener_first_value) : sizeof(srp_talker_first_value));
+      while (i < n && pdu_room(&pdu, sizeof(mrp_vector_header) + sizeof(srp_talker_first_value) + 2)) {
+        unsigned char first_value[sizeof(srp_talker_first_value)];
+        if (type) {
+          put_be(first_value, ids[i], 8);
+          pdu_vector(&pdu, first_value, sizeof(srp_listener_first_value), 1, 0, JOININ,
+                     AVB_SRP_FOUR_PACKED_EVENT_READY);
+        }
+        else {
+          talker_first_value(first_value, ids[i], PEER_DEST_MAC + i);
+          pdu_vector(&pdu, first_value, sizeof(first_value), 1, 0, JOININ, -1);
+        }
+        i++;
+      }
+      pdu_end_message(&pdu);
+      frames[count].len = pdu_end(&pdu);
+      memcpy(frames[count].data, pdu.data, frames[count].len);
+      ports[count] = type ? 1 : 0;
+      count++;
+    }
+  }
+  return count;
+}
+
+static void bench(int n)
+{
+  static unsigned long long ids[1000];
+  static int ports[MAX_FRAMES];
+  const int rounds = 50;
+  int count;
+  double start, rx, periodic;
+  struct avb_debug_counters counters;
+
+  for (int i=0;i<n;i++)
+    ids[i] = bench_stream_id(i);
+  count = bench_frames(ids, n, ports);
+
+  shim_init();
+  join_domain();
+  for (int i=0;i<count;i++)
+    shim_receive(frames[i].data, frames[i].len, ports[i]);
+  shim_advance(2000);
+  CHECK(shim_stats.forwarding_enabled == n, "%d streams: %u forwarded", n, shim_stats.forwarding_enabled);
+
+  // The neighbours re-declare every stream each join period
+  start_capture();
+  rx = periodic = 0;
+  for (int r=0;r<rounds;r++) {
+    start = seconds();
+    for (int i=0;i<count;i++)
+      shim_receive(frames[i].data, frames[i].len, ports[i]);
+    rx += seconds() - start;
+
+    start = seconds();
+    shim_advance(MRP_JOINTIMER_PERIOD_CENTISECONDS * 10);
+    periodic += seconds() - start;
+  }
+  decode_sent(NULL, NULL);
+  mrp_get_attr_counters(&counters);
+
+  printf("%5d streams  %4d MRPDUs received per join period  %8.2f us per MRPDU  %6.3f us per value  "
+         "%6.1f MRPDUs sent per join period  %8.1f us of periodic processing per join period\n",
+         n, count, rx * 1e6 / (rounds * count), rx * 1e6 / (rounds * 2 * n),
+         (double) shim_tx_frames() / rounds, periodic * 1e6 / rounds);
+  CHECK(counters.mrp_attr_exhausted == 0, "%d streams: %u attributes could not be allocated",
+        n, counters.mrp_attr_exhausted);
+}
+
+static int run_bench(void)
+{
+  static const int streams[] = {10, 100, 1000};
+
+  for (int i=0;i<sizeof(streams)/sizeof(streams[0]);i++) {
+    int status;
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      bench(streams[i]);
+      exit(failures ? 1 : 0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+      failures++;
+  }
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *read_file = NULL, *write_prefix = NULL;
+  int port = 0, benchmark = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r:p:w:bv")) != -1) {
+    switch (opt) {
+    case 'r': read_file = optarg; break;
+    case 'p': port = atoi(optarg); break;
+    case 'w': write_prefix = optarg; break;
+    case 'b': benchmark = 1; break;
+    case 'v': verbose = 1; break;
+    default:
+      fprintf(stderr, "usage: %s [-r capture.pcap [-p port]] [-w prefix] [-b] [-v]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (write_prefix && !shim_write_pcap(write_prefix))
+    return 1;
+
+  if (benchmark)
+    run_bench();
+  else if (read_file) {
+    if (!read_pcap(read_file))
+      return 1;
+    replay(port);
+  }
+  else
+    run_tests();
+
+  shim_close_pcap();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
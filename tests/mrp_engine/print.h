@@ -0,0 +1,7 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the lib_logging header, output is dropped
+#ifndef __PRINT_H__
+#define __PRINT_H__
+#define printchar(c) ((void) (c))
+#define printhex(x) ((void) (x))
+#endif
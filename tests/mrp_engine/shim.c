@@ -0,0 +1,251 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <string.h>
+#include "shim.h"
+#include "avb_internal.h"
+#include "avb_mvrp.h"
+#include "avb_1722_router.h"
+#include "ethernet_wrappers.h"
+#include "misc_timer.h"
+
+// avb_mrp.c:
+extern unsigned char srp_dest_mac[6];
+extern unsigned char mvrp_dest_mac[6];
+
+shim_stats_t shim_stats;
+
+static unsigned now;
+
+static shim_frame_t *capture;
+static int capture_max;
+static int captured;
+
+static FILE *pcap[MRP_NUM_PORTS];
+
+static unsigned local_sources[SHIM_MAX_LOCAL_SOURCES][2];
+static int num_local_sources;
+static enum avb_source_state_t source_state[SHIM_MAX_LOCAL_SOURCES];
+
+unsigned shim_time(void)
+{
+  return now;
+}
+
+void shim_init(void)
+{
+  unsigned char mac_addr[6] = {0x00, 0x22, 0x97, 0x00, 0x00, 0x01};
+
+  srp_store_ethernet_interface(0);
+  mrp_store_ethernet_interface(0);
+  mrp_init((char *) mac_addr);
+  srp_domain_init();
+  avb_mvrp_init();
+
+  // The link up status that avb_srp_task() would receive
+  srp_domain_join();
+}
+
+void shim_advance(unsigned ms)
+{
+  // avb_srp_task() polls every 50us, but the MRP timers are in centiseconds
+  for (unsigned i=0; i < ms; i++) {
+    now += SHIM_TICKS_PER_MS;
+    mrp_periodic(0);
+  }
+}
+
+void shim_receive(unsigned char *frame, int len, int port)
+{
+  int has_qtag = frame[12] == 0x81 && frame[13] == 0x00;
+  int eth_hdr_size = has_qtag ? 18 : 14;
+  int etype = (frame[eth_hdr_size-2] << 8) | frame[eth_hdr_size-1];
+
+  if (len < eth_hdr_size)
+    return;
+
+  if (etype == AVB_SRP_ETHERTYPE) {
+    if (memcmp(frame, srp_dest_mac, 6) != 0)
+      return;
+  }
+  else if (etype == AVB_MVRP_ETHERTYPE) {
+    if (memcmp(frame, mvrp_dest_mac, 6) != 0)
+      return;
+  }
+  else {
+    return;
+  }
+
+  avb_mrp_process_packet(&frame[eth_hdr_size], etype, len - eth_hdr_size, port);
+}
+
+void shim_capture(shim_frame_t *frames, int max)
+{
+  capture = frames;
+  capture_max = max;
+  captured = 0;
+}
+
+int shim_tx_frames(void)
+{
+  return captured;
+}
+
+static void put32(FILE *fp, unsigned x)
+{
+  unsigned char b[4] = {x, x >> 8, x >> 16, x >> 24};
+  fwrite(b, 1, 4, fp);
+}
+
+int shim_write_pcap(const char *prefix)
+{
+  static const unsigned char hdr[24] = {0xd4, 0xc3, 0xb2, 0xa1, 2, 0, 4, 0,
+                                        0, 0, 0, 0, 0, 0, 0, 0,
+                                        0xff, 0xff, 0, 0, 1, 0, 0, 0};
+  for (int p=0; p < MRP_NUM_PORTS; p++) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s%d.pcap", prefix, p);
+    pcap[p] = fopen(filename, "wb");
+    if (!pcap[p]) {
+      perror(filename);
+      return 0;
+    }
+    fwrite(hdr, 1, 24, pcap[p]);
+  }
+  return 1;
+}
+
+void shim_close_pcap(void)
+{
+  for (int p=0; p < MRP_NUM_PORTS; p++) {
+    if (pcap[p])
+      fclose(pcap[p]);
+    pcap[p] = NULL;
+  }
+}
+
+void shim_add_local_source(unsigned stream_id[2])
+{
+  if (num_local_sources < SHIM_MAX_LOCAL_SOURCES) {
+    local_sources[num_local_sources][0] = stream_id[0];
+    local_sources[num_local_sources][1] = stream_id[1];
+    source_state[num_local_sources] = AVB_SOURCE_STATE_POTENTIAL;
+    num_local_sources++;
+  }
+}
+
+enum avb_source_state_t shim_source_state(int source_num)
+{
+  return source_state[source_num];
+}
+
+/* The Ethernet server */
+
+void eth_send_packet(unsigned i, char *packet, unsigned n, unsigned dst_port)
+{
+  shim_stats.tx_frames++;
+
+  if (dst_port < MRP_NUM_PORTS && pcap[dst_port]) {
+    unsigned long long us = now / (SHIM_TICKS_PER_MS / 1000);
+    put32(pcap[dst_port], (unsigned) (us / 1000000));
+    put32(pcap[dst_port], (unsigned) (us % 1000000));
+    put32(pcap[dst_port], n);
+    put32(pcap[dst_port], n);
+    fwrite(packet, 1, n, pcap[dst_port]);
+  }
+
+  if (captured < capture_max && n <= SHIM_MAX_FRAME) {
+    shim_frame_t *f = &capture[captured++];
+    f->time = now;
+    f->port = dst_port;
+    f->len = n;
+    memcpy(f->data, packet, n);
+  }
+}
+
+/* The reference clock, for the avb_timers of misc_timer.c */
+
+unsigned get_local_time(void)
+{
+  return now;
+}
+
+/* The 1722 router */
+
+void avb_1722_enable_stream_forwarding(unsigned i_eth, unsigned int stream_id[2])
+{
+  shim_stats.forwarding_enabled++;
+}
+
+void avb_1722_disable_stream_forwarding(unsigned i_eth, unsigned int stream_id[2])
+{
+  shim_stats.forwarding_disabled++;
+}
+
+void avb_1722_remove_stream_from_table(unsigned i_eth, unsigned int streamId[2])
+{
+  shim_stats.streams_removed++;
+}
+
+/* The AVB manager, with local sources but no sinks */
+
+unsigned avb_get_source_stream_index_from_stream_id(unsigned int stream_id[2])
+{
+  for (int i=0; i < num_local_sources; i++) {
+    if (local_sources[i][0] == stream_id[0] && local_sources[i][1] == stream_id[1])
+      return i;
+  }
+  return -1u;
+}
+
+unsigned avb_get_sink_stream_index_from_stream_id(unsigned int stream_id[2])
+{
+  return -1u;
+}
+
+unsigned avb_get_sink_stream_index_from_pointer(avb_sink_info_t *p)
+{
+  return -1u;
+}
+
+int set_avb_source_port(unsigned source_num, int srcport)
+{
+  return 1;
+}
+
+int avb_get_source_state(unsigned avb, unsigned source_num, enum avb_source_state_t *state)
+{
+  if (source_num >= num_local_sources)
+    return 0;
+  *state = source_state[source_num];
+  return 1;
+}
+
+int avb_set_source_state(unsigned avb, unsigned source_num, enum avb_source_state_t state)
+{
+  if (source_num >= num_local_sources)
+    return 0;
+  source_state[source_num] = state;
+  return 1;
+}
+
+int avb_get_source_vlan(unsigned avb, unsigned source_num, int *vlan)
+{
+  *vlan = 0;
+  return 1;
+}
+
+int avb_set_source_vlan(unsigned avb, unsigned source_num, int vlan)
+{
+  return 1;
+}
+
+int avb_get_sink_vlan(unsigned avb, unsigned sink_num, int *vlan)
+{
+  *vlan = 0;
+  return 1;
+}
+
+int avb_set_sink_vlan(unsigned avb, unsigned sink_num, int vlan)
+{
+  return 1;
+}
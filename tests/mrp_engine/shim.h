@@ -0,0 +1,70 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __shim_h__
+#define __shim_h__
+
+#include "avb.h"
+#include "avb_srp.h"
+#include "avb_mrp.h"
+
+/* A host stand-in for the tasks that the MRP, MSRP and MVRP code
+ * (avb_mrp.c, avb_srp.c, avb_mvrp.c) is called from and calls out to:
+ * avb_srp_task()'s packet reception and periodic processing, the Ethernet
+ * server, the 1722 router and the AVB manager.
+ *
+ * Time is simulated, in 10ns reference clock ticks from get_local_time(),
+ * and only moves when shim_advance() is called. Transmitted frames are kept
+ * for the test to inspect and can be written to a capture per port.
+ */
+
+#define SHIM_MAX_FRAME 1518
+#define SHIM_TICKS_PER_MS 100000
+
+#define SHIM_MAX_LOCAL_SOURCES 4
+
+typedef struct shim_frame_t {
+  unsigned time;    ///< Reference clock ticks at transmission
+  int port;
+  int len;
+  unsigned char data[SHIM_MAX_FRAME];
+} shim_frame_t;
+
+typedef struct shim_stats_t {
+  unsigned tx_frames;             ///< MRPDUs transmitted
+  unsigned forwarding_enabled;    ///< avb_1722_enable_stream_forwarding() calls
+  unsigned forwarding_disabled;   ///< avb_1722_disable_stream_forwarding() calls
+  unsigned streams_removed;       ///< avb_1722_remove_stream_from_table() calls
+} shim_stats_t;
+
+/** Start MRP as avb_srp_task() does, with the link up on every port */
+void shim_init(void);
+
+/** Run the periodic processing for ms of simulated time */
+void shim_advance(unsigned ms);
+
+/** Receive a frame on a port, as avb_process_srp_control_packet() does */
+void shim_receive(unsigned char *frame, int len, int port);
+
+/** Keep transmitted frames for shim_tx_frames(), up to max of them. Frames
+ *  beyond that are counted but dropped. */
+void shim_capture(shim_frame_t *frames, int max);
+
+/** The number of frames kept since shim_capture() */
+int shim_tx_frames(void);
+
+/** Also write every transmitted frame to a pcap file for its port */
+int shim_write_pcap(const char *prefix);
+
+/** Close the files opened by shim_write_pcap() */
+void shim_close_pcap(void);
+
+/** The stream ID of a local source, so that a Listener for it enables it */
+void shim_add_local_source(unsigned stream_id[2]);
+
+/** The state the AVB manager has been asked to put a local source in */
+enum avb_source_state_t shim_source_state(int source_num);
+
+unsigned shim_time(void);
+
+extern shim_stats_t shim_stats;
+
+#endif // __shim_h__
@@ -0,0 +1,6 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+// Host stand-in for the xCORE tools header, for misc_timer.c's tick rate
+#ifndef __XS1_H__
+#define __XS1_H__
+#define XS1_TIMER_KHZ 100000
+#endif
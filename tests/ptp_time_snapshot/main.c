@@ -0,0 +1,127 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "gptp.h"
+#include "gptp_internal.h"
+
+/* Host stress test and benchmark of the PTP time snapshot. A publisher
+ * thread publishes numbered time information back to back, far faster than
+ * the PTP server does, while reader threads take snapshots. Every snapshot
+ * must be one whole publish and a reader must never go back in time.
+ */
+
+#define NUM_PUBLISHES 2000000u
+#define NUM_READERS 3
+
+static int publisher_done;
+
+static void make_info(ptp_time_info_mod64 *info, unsigned int n)
+{
+  info->local_ts = n;
+  info->ptp_ts_hi = n * 3;
+  info->ptp_ts_lo = ~n;
+  info->ptp_adjust = n * 5;
+  info->inv_ptp_adjust = -n;
+}
+
+static void *publisher(void *arg)
+{
+  ptp_time_info_mod64 info;
+
+  for (unsigned int n = 1; n <= NUM_PUBLISHES; n++) {
+    make_info(&info, n);
+    ptp_time_snapshot_publish(&info);
+  }
+
+  __atomic_store_n(&publisher_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void *reader(void *arg)
+{
+  unsigned int *reads = arg;
+  unsigned int last = 1;
+
+  while (!__atomic_load_n(&publisher_done, __ATOMIC_ACQUIRE)) {
+    ptp_time_info_mod64 info, expect;
+
+    if (!ptp_get_time_snapshot_mod64(&info)) {
+      printf("FAIL: no snapshot after the first publish\n");
+      exit(1);
+    }
+    make_info(&expect, info.local_ts);
+    if (memcmp(&info, &expect, sizeof info) != 0) {
+      printf("FAIL: snapshot %u is torn\n", info.local_ts);
+      exit(1);
+    }
+    if (info.local_ts < last) {
+      printf("FAIL: snapshot %u after %u\n", info.local_ts, last);
+      exit(1);
+    }
+    last = info.local_ts;
+    (*reads)++;
+  }
+  return NULL;
+}
+
+static double seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Single threaded cost of a snapshot read, in nanoseconds
+static double benchmark(void)
+{
+  volatile unsigned int sink = 0;
+  ptp_time_info_mod64 info;
+  double start = seconds();
+
+  for (unsigned int n = 0; n < NUM_PUBLISHES * 10; n++) {
+    ptp_get_time_snapshot_mod64(&info);
+    sink += info.ptp_ts_lo;
+  }
+  return (seconds() - start) * 1e9 / (NUM_PUBLISHES * 10);
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t p, r[NUM_READERS];
+  unsigned int reads[NUM_READERS] = { 0 };
+  ptp_time_info_mod64 info;
+
+  if (ptp_get_time_snapshot_mod64(&info)) {
+    printf("FAIL: snapshot before the first publish\n");
+    return 1;
+  }
+  printf("PASS\n");
+
+  // Readers start once there is something to read, as clients do once the
+  // server has answered their first request
+  make_info(&info, 1);
+  ptp_time_snapshot_publish(&info);
+  for (int i = 0; i < NUM_READERS; i++)
+    pthread_create(&r[i], NULL, reader, &reads[i]);
+  pthread_create(&p, NULL, publisher, NULL);
+  pthread_join(p, NULL);
+  for (int i = 0; i < NUM_READERS; i++)
+    pthread_join(r[i], NULL);
+
+  if (!ptp_get_time_snapshot_mod64(&info) || info.local_ts != NUM_PUBLISHES) {
+    printf("FAIL: last snapshot is not the last publish\n");
+    return 1;
+  }
+  printf("PASS\n");
+
+  if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+    for (int i = 0; i < NUM_READERS; i++)
+      printf("reader %d: %u snapshots\n", i, reads[i]);
+    printf("read: %.2f ns\n", benchmark());
+  }
+
+  return 0;
+}
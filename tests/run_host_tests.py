@@ -0,0 +1,53 @@
+#!/usr/bin/env python
+"""Builds and runs the tests that are built with the host C compiler
+(those whose Makefile includes host.mk) and checks their exit status.
+
+A test with a check target is run with make check, any other by running
+its binary with no arguments. Exits non-zero if any test fails to build
+or run, so that it can be used on its own or from runtests.py."""
+import os
+import re
+import subprocess
+import sys
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def host_tests():
+    tests = []
+    for name in sorted(os.listdir(TESTS_DIR)):
+        makefile = os.path.join(TESTS_DIR, name, 'Makefile')
+        if os.path.isfile(makefile):
+            with open(makefile) as f:
+                text = f.read()
+            if re.search(r'^include \.\./host\.mk$', text, re.M):
+                has_check = re.search(r'^check:', text, re.M) is not None
+                tests.append((name, has_check))
+    return tests
+
+
+def run():
+    failures = []
+    for name, has_check in host_tests():
+        test_dir = os.path.join(TESTS_DIR, name)
+        if subprocess.call(['make', '-s'], cwd=test_dir) != 0:
+            failures.append(name + ' (build)')
+            continue
+        if has_check:
+            cmd = ['make', '-s', 'check']
+        else:
+            cmd = [os.path.join('bin', name)]
+        sys.stdout.write('%s: ' % name)
+        sys.stdout.flush()
+        status = subprocess.call(cmd, cwd=test_dir, stdout=open(os.devnull, 'w'))
+        print('PASS' if status == 0 else 'FAIL (exit status %d)' % status)
+        if status != 0:
+            failures.append(name)
+
+    if failures:
+        print('Host tests failed: ' + ', '.join(failures))
+    return len(failures)
+
+
+if __name__ == '__main__':
+    sys.exit(1 if run() else 0)
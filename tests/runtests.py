@@ -1,7 +1,11 @@
 #!/usr/bin/env python
+import sys
 import xmostest
+import run_host_tests
 
 if __name__ == '__main__':
+    host_failures = run_host_tests.run()
+
     xmostest.init()
     xmostest.register_group('lib_tsn',
                             'lib_tsn_tests',
@@ -11,3 +15,6 @@ TSN library tests
 ''')
     xmostest.runtests()
     xmostest.finish()
+
+    if host_failures:
+        sys.exit(1)
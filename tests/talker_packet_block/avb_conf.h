@@ -0,0 +1,13 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __avb_conf_h__
+#define __avb_conf_h__
+
+/* Large enough for the widest stream exercised by the test */
+#define AVB_NUM_MEDIA_INPUTS 64
+#define AVB_MAX_CHANNELS_PER_TALKER_STREAM 64
+
+/* Check the fixed format packetizer against the block one too */
+#define AVB_1722_TALKER_FAST_PATHS \
+  AVB_1722_TALKER_FAST_PATH(8, 48000, MBLA_24BIT)
+
+#endif
@@ -0,0 +1,15 @@
+#!/usr/bin/env python
+import xmostest
+
+def runtest():
+    testlevel = 'smoke'
+    resources = xmostest.request_resource('xsim')
+
+    binary = 'aaf_packet/bin/aaf_packet.xe'.format()
+    tester = xmostest.ComparisonTester(open('aaf_packet.expect'),
+                                       'lib_tsn',
+                                       'lib_tsn_tests',
+                                       'aaf_packet',
+                                       {})
+    tester.set_min_testlevel(testlevel)
+    xmostest.run_on_simulator(resources['xsim'], binary, simargs=[], tester=tester)
@@ -0,0 +1,15 @@
+#!/usr/bin/env python
+import xmostest
+
+def runtest():
+    testlevel = 'smoke'
+    resources = xmostest.request_resource('xsim')
+
+    binary = 'am824_conversion/bin/am824_conversion.xe'.format()
+    tester = xmostest.ComparisonTester(open('am824_conversion.expect'),
+                                       'lib_tsn',
+                                       'lib_tsn_tests',
+                                       'am824_conversion',
+                                       {})
+    tester.set_min_testlevel(testlevel)
+    xmostest.run_on_simulator(resources['xsim'], binary, simargs=[], tester=tester)
@@ -0,0 +1,15 @@
+#!/usr/bin/env python
+import xmostest
+
+def runtest():
+    testlevel = 'smoke'
+    resources = xmostest.request_resource('xsim')
+
+    binary = 'talker_packet_block/bin/talker_packet_block.xe'.format()
+    tester = xmostest.ComparisonTester(open('talker_packet_block.expect'),
+                                       'lib_tsn',
+                                       'lib_tsn_tests',
+                                       'talker_packet_block',
+                                       {})
+    tester.set_min_testlevel(testlevel)
+    xmostest.run_on_simulator(resources['xsim'], binary, simargs=[], tester=tester)